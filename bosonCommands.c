@@ -5,6 +5,8 @@
 */
 #include <string.h>
 
+#include "i2cBus.h"
+#include "i2cTrace.h"
 #include "Client_API.h"
 #include "UART_Connector.h"
 #include "os_common.h"
@@ -14,8 +16,6 @@
 #include "helpers.h"
 #include "bosonCommands.h"
 
-static uint16_t _cmd[64];
-
 static void
 _StringToCommand(uint16_t *cmdBody, char *cmdStr) {
     uint8_t tempCmd[4];
@@ -42,16 +42,24 @@ PackingToString(uint32_t val, char *outStr) {
     }
 }
 
+static uint32_t
+_CommandId(uint16_t *cmdBody)
+{
+    return (cmdBody[0] << 24) | (cmdBody[1] << 16) | (cmdBody[2] << 8) |
+        cmdBody[3];
+}
+
 static NvMediaStatus
 _RunCommandWithResponseHelper(int32_t i2cDevice, uint32_t sensorAddress, 
     uint16_t *cmdBody)
 {
     NvMediaStatus status = NVMEDIA_STATUS_OK;
+    BosonFrame frame;
 
-    BuildCommand(cmdBody, NULL, _cmd);
+    EncodeCommand(cmdBody, NULL, &frame);
     ResetI2CBuffer(i2cDevice, sensorAddress);
     nvsleep(100);
-    status = SendCommand(i2cDevice, sensorAddress, _cmd);
+    status = SendCommand(i2cDevice, sensorAddress, &frame);
     if(status != NVMEDIA_STATUS_OK) {
         LOG_ERR("%s: Error sending command", __func__);
         return status;
@@ -67,14 +75,18 @@ RunCommandWithInt32Response(uint32_t i2cDevice, uint32_t sensorAddress,
 {
     NvMediaStatus status = NVMEDIA_STATUS_OK;
 
+    I2cTraceMark(I2C_TRACE_CMD_BEGIN, sensorAddress, _CommandId(cmdBody), 0);
+    // no other transaction may come between the command and its response
+    I2cBusLock(i2cDevice);
     status = _RunCommandWithResponseHelper(i2cDevice, sensorAddress, cmdBody);
-    if(status != NVMEDIA_STATUS_OK) {
-        return;
-    }
-    status = ReceiveData(i2cDevice, sensorAddress, 0, resp);
-    if(status != NVMEDIA_STATUS_OK) {
-        LOG_ERR("%s: Error receiving data", __func__);
+    if(status == NVMEDIA_STATUS_OK) {
+        status = ReceiveData(i2cDevice, sensorAddress, 0, resp);
+        if(status != NVMEDIA_STATUS_OK) {
+            LOG_ERR("%s: Error receiving data", __func__);
+        }
     }
+    I2cBusUnlock(i2cDevice);
+    I2cTraceMark(I2C_TRACE_CMD_END, sensorAddress, _CommandId(cmdBody), 0);
 
     return status;
 }
@@ -85,14 +97,18 @@ RunCommandWithStringResponse(uint32_t i2cDevice, uint32_t sensorAddress,
 {
     NvMediaStatus status = NVMEDIA_STATUS_OK;
 
+    I2cTraceMark(I2C_TRACE_CMD_BEGIN, sensorAddress, _CommandId(cmdBody), 0);
+    // no other transaction may come between the command and its response
+    I2cBusLock(i2cDevice);
     status = _RunCommandWithResponseHelper(i2cDevice, sensorAddress, cmdBody);
-    if(status != NVMEDIA_STATUS_OK) {
-        return;
-    }
-    status = ReceiveStringData(i2cDevice, sensorAddress, 0, resp, length);
-    if(status != NVMEDIA_STATUS_OK) {
-        LOG_ERR("%s: Error receiving data", __func__);
+    if(status == NVMEDIA_STATUS_OK) {
+        status = ReceiveStringData(i2cDevice, sensorAddress, 0, resp, length);
+        if(status != NVMEDIA_STATUS_OK) {
+            LOG_ERR("%s: Error receiving data", __func__);
+        }
     }
+    I2cBusUnlock(i2cDevice);
+    I2cTraceMark(I2C_TRACE_CMD_END, sensorAddress, _CommandId(cmdBody), 0);
 
     return status;
 }
@@ -101,8 +117,17 @@ NvMediaStatus
 RunVoidCommand(uint32_t i2cDevice, uint32_t sensorAddress, uint16_t *cmdBody,
     uint32_t *param)
 {
-    BuildCommand(cmdBody, param, _cmd);
-    return SendCommand(i2cDevice, sensorAddress, _cmd);
+    NvMediaStatus status;
+    BosonFrame frame;
+
+    I2cTraceMark(I2C_TRACE_CMD_BEGIN, sensorAddress, _CommandId(cmdBody), 0);
+    EncodeCommand(cmdBody, param, &frame);
+    I2cBusLock(i2cDevice);
+    status = SendCommand(i2cDevice, sensorAddress, &frame);
+    I2cBusUnlock(i2cDevice);
+    I2cTraceMark(I2C_TRACE_CMD_END, sensorAddress, _CommandId(cmdBody), 0);
+
+    return status;
 }
 
 NvMediaStatus
@@ -199,8 +224,7 @@ SetIntValue(uint32_t i2cDevice, uint32_t sensorAddress, char *cmdStr,
     uint32_t param = (uint32_t)strtol(arg, NULL, 16);
     _StringToCommand(cmdBody, cmdStr);
 
-    BuildCommand(cmdBody, &param, _cmd);
-    return SendCommand(i2cDevice, sensorAddress, _cmd);
+    return RunVoidCommand(i2cDevice, sensorAddress, cmdBody, &param);
 }
 
 NvMediaStatus
@@ -208,4 +232,56 @@ GetFPS(uint32_t i2cDevice, uint32_t sensorAddress, uint32_t *fps) {
     uint16_t cmdBody[4] = {0x00, 0x0E, 0x00, 0x07};
 
     return RunCommandWithInt32Response(i2cDevice, sensorAddress, cmdBody, fps);
-}
\ No newline at end of file
+}
+
+void
+InitBatchCommand(BosonBatchCommand *cmd, uint32_t cmdId, uint32_t *param,
+    BosonResponseType responseType)
+{
+    uint8_t tempCmd[4];
+
+    memset(cmd, 0, sizeof(BosonBatchCommand));
+    LsbToMsbArr(tempCmd, cmdId);
+    for (size_t i = 0; i < 4; i++) {
+        cmd->cmdBody[i] = tempCmd[i];
+    }
+    if(param) {
+        cmd->hasParam = NVMEDIA_TRUE;
+        cmd->param = *param;
+    }
+    cmd->responseType = responseType;
+}
+
+NvMediaStatus
+RunCommandBatch(uint32_t i2cDevice, uint32_t sensorAddress,
+    BosonBatchCommand *cmds, uint32_t numCmds)
+{
+    I2cHandle handle = NULL;
+    NvMediaStatus status = NVMEDIA_STATUS_OK;
+    uint32_t i, count;
+
+    I2cBusOpen(i2cDevice, &handle);
+    if(!handle) {
+        LOG_ERR("%s: Failed to open handle with id %u\n", __func__,
+            sensorAddress);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    I2cBusLock(i2cDevice);
+    for (i = 0; i < numCmds; i += count) {
+        count = numCmds - i;
+        if(count > BOSON_MAX_BATCH_COMMANDS) {
+            count = BOSON_MAX_BATCH_COMMANDS;
+        }
+        if(SendCommandBatch(handle, sensorAddress, &cmds[i], count) !=
+            NVMEDIA_STATUS_OK)
+        {
+            status = NVMEDIA_STATUS_ERROR;
+        }
+    }
+    I2cBusUnlock(i2cDevice);
+
+    I2cBusClose(handle);
+
+    return status;
+}
@@ -11,6 +11,7 @@
 #include <stdint.h>
 
 #include "nvmedia_core.h"
+#include "bosonInterface.h"
 
 typedef enum {
     PACKING_DEFAULT = 0,
@@ -68,4 +69,12 @@ SetIntValue(uint32_t i2cDevice, uint32_t sensorAddress, char *cmdStr,
 NvMediaStatus
 GetFPS(uint32_t i2cDevice, uint32_t sensorAddress, uint32_t *fps);
 
+void
+InitBatchCommand(BosonBatchCommand *cmd, uint32_t cmdId, uint32_t *param,
+    BosonResponseType responseType);
+
+NvMediaStatus
+RunCommandBatch(uint32_t i2cDevice, uint32_t sensorAddress,
+    BosonBatchCommand *cmds, uint32_t numCmds);
+
 #endif
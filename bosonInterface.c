@@ -3,11 +3,13 @@
   * http://www.flir.com/
   * October-2019
 */
+#include <pthread.h>
 #include <string.h>
 
 #include "log_utils.h"
 #include "os_common.h"
-#include "testutil_i2c.h"
+#include "i2cBus.h"
+#include "i2cTrace.h"
 #include "helpers.h"
 
 #include "bosonInterface.h"
@@ -47,46 +49,36 @@ static uint16_t CRC16_XMODEM_TABLE[256] = {
     0x6e17, 0x7e36, 0x4e55, 0x5e74, 0x2e93, 0x3eb2, 0x0ed1, 0x1ef0,
 };
 
+#define BOSON_MAX_RESPONSE_LENGTH   64
+#define BOSON_RESPONSE_HEADER       13   // channel, sequence, command id, status
+#define BOSON_RESPONSE_DELAY        1000 // us before the first response poll
+#define BOSON_RESPONSE_RETRIES      10
+
 static uint16_t _charsToEscape[3] = {0x8E, 0x9E, 0xAE};
 static uint16_t _escapeChar = 0x9E;
 static uint16_t _cmdStart[7] = {0x902, 0x8E, 0x00, 0x12, 0xC0, 0xFF, 0xEE};
 static uint16_t _cmdEnd[2] = {0xAE, 0x900};
 
-static void
-_EscapeCmd(uint16_t *cmd) {
-    uint16_t tempCmd[64];
-    uint32_t ei = 0;
-    uint32_t i;
-    uint32_t startLen = sizeof(_cmdStart) / sizeof(_cmdStart[0]);
-
-    // copy start of command over
-    memcpy(tempCmd, cmd, sizeof(_cmdStart));
-
-    // loop over command but skip start characters
-    for (i = startLen; i < 64; i++) {
-        if(cmd[i] == _cmdEnd[0]) {
-            break;
-        }
-
-        tempCmd[i+ei] = cmd[i];
-
-        for (size_t j = 0; j < 3; j++) {
-            if(_charsToEscape[j] == cmd[i]) {
-                tempCmd[i+ei] = _escapeChar;
-                ei++;
-                tempCmd[i+ei] = cmd[i] - 0xD;
-                break;
-            }
-        }
-    }
+// Frames for fixed commands, encoded once on first use
+typedef struct {
+    uint32_t                    cmdId;
+    uint16_t                    prefixCrc;
+    uint32_t                    prefixWords;
+    BosonFrame                  frame;
+} _FrameTemplate;
+
+static _FrameTemplate _frameTemplates[] = {
+    {0x00050007},   // run FFC
+    {0x00050002},   // serial number
+    {0x000E0007},   // frame rate
+    {0x0005003F},   // part number
+    {0x00040006},   // telemetry packing
+};
 
-    // if there's no end token, just return
-    if(i == 64) {
-        return;
-    }
+#define BOSON_NUM_FRAME_TEMPLATES \
+    (sizeof(_frameTemplates) / sizeof(_frameTemplates[0]))
 
-    memcpy(cmd, tempCmd, (i + ei) * sizeof(uint8_t));    
-}
+static pthread_once_t _frameTemplatesOnce = PTHREAD_ONCE_INIT;
 
 static void
 _UnescapeResponse(uint8_t *resp, uint32_t length) {
@@ -103,20 +95,66 @@ _UnescapeResponse(uint8_t *resp, uint32_t length) {
     memcpy(resp, tempResp, length * sizeof(uint8_t));
 }
 
+static uint16_t
+_UpdateCRC(uint16_t crc, uint8_t byte) {
+    return ((crc << 8) & 0xff00) ^ CRC16_XMODEM_TABLE[((crc >> 8) & 0xff)
+        ^ byte];
+}
+
+// Appends one FIFO byte, escaping the framing characters
 static void
-_GetCRC(uint16_t *data, uint32_t length, uint16_t *outCrc) {
-    uint16_t crc = 0x1d0f;
-    uint8_t byte;
+_AppendFifoByte(BosonFrame *frame, uint8_t byte) {
+    uint32_t j;
 
-    for (size_t i = 0; i < length; i++) {
-        byte = data[i] & 0xff;
-        crc = ((crc << 8) & 0xff00) ^ CRC16_XMODEM_TABLE[((crc >> 8) & 0xff) 
-            ^ byte];
+    for (j = 0; j < 3; j++) {
+        if(_charsToEscape[j] == byte) {
+            frame->words[frame->numWords++] = _escapeChar;
+            byte -= 0xD;
+            break;
+        }
     }
-    crc = crc & 0xffff;
+    frame->words[frame->numWords++] = byte;
+}
+
+static uint16_t
+_AppendFifoBytes(BosonFrame *frame, uint16_t crc, const uint8_t *bytes,
+    uint32_t length)
+{
+    uint32_t i;
 
-    outCrc[0] = crc >> 8;
-    outCrc[1] = crc & 0xff;
+    for (i = 0; i < length; i++) {
+        crc = _UpdateCRC(crc, bytes[i]);
+        _AppendFifoByte(frame, bytes[i]);
+    }
+    return crc;
+}
+
+// Spooling off, start flag, channel, sequence, command id and status
+static void
+_EncodePrefix(uint32_t cmdId, BosonFrame *frame, uint16_t *crc) {
+    uint8_t header[13] = {0x00, 0x12, 0xC0, 0xFF, 0xEE,
+        cmdId >> 24, (cmdId >> 16) & 0xff, (cmdId >> 8) & 0xff, cmdId & 0xff,
+        0xFF, 0xFF, 0xFF, 0xFF};
+
+    frame->numWords = 0;
+    frame->words[frame->numWords++] = _cmdStart[0];
+    frame->words[frame->numWords++] = _cmdStart[1];
+    *crc = _AppendFifoBytes(frame, 0x1d0f, header, sizeof(header));
+}
+
+// Optional parameter, CRC, end flag and spooling on
+static void
+_EncodeSuffix(BosonFrame *frame, uint16_t crc, uint32_t *value) {
+    uint8_t bytes[4];
+
+    if(value) {
+        LsbToMsbArr(bytes, *value);
+        crc = _AppendFifoBytes(frame, crc, bytes, 4);
+    }
+    _AppendFifoByte(frame, crc >> 8);
+    _AppendFifoByte(frame, crc & 0xff);
+    frame->words[frame->numWords++] = _cmdEnd[0];
+    frame->words[frame->numWords++] = _cmdEnd[1];
 }
 
 static NvMediaStatus
@@ -125,7 +163,7 @@ _SendSingleCommand(uint32_t i2cDevice, uint32_t sensorAddress, uint16_t cmd) {
     NvMediaStatus status = NVMEDIA_STATUS_OK;
     uint8_t instruction[2] = {cmd >> 8, cmd & 0xFF};
 
-    testutil_i2c_open(i2cDevice, &handle);
+    I2cBusOpen(i2cDevice, &handle);
     if(!handle) {
         LOG_ERR("%s: Failed to open handle with id %u\n", __func__,
             sensorAddress);
@@ -133,7 +171,7 @@ _SendSingleCommand(uint32_t i2cDevice, uint32_t sensorAddress, uint16_t cmd) {
         goto finally;
     }
 
-    if(testutil_i2c_write_subaddr(handle, sensorAddress, 
+    if(I2cBusWrite(handle, sensorAddress, 
             &instruction, 2)) 
     {
         LOG_ERR("%s: Failed to write to I2C %02x %02x %02x",
@@ -144,11 +182,145 @@ _SendSingleCommand(uint32_t i2cDevice, uint32_t sensorAddress, uint16_t cmd) {
     }
 
 finally:
-    testutil_i2c_close(handle);
+    I2cBusClose(handle);
 
     return status;
 }
 
+static NvMediaStatus
+_WriteWord(I2cHandle handle, uint32_t sensorAddress, uint16_t word) {
+    uint8_t instruction[2] = {word >> 8, word & 0xFF};
+
+    if(I2cBusWrite(handle, sensorAddress, instruction, 2)) {
+        LOG_ERR("%s: Failed to write to I2C %02x %02x %02x",
+            __func__, sensorAddress,
+            instruction[0],
+            instruction[1]);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    return NVMEDIA_STATUS_OK;
+}
+
+// Reads one unescaped response frame (without start and end flags).
+// Returns NVMEDIA_STATUS_TIMED_OUT if the camera has not answered yet.
+static NvMediaStatus
+_ReceiveFrame(I2cHandle handle, uint32_t sensorAddress, uint8_t *frame,
+    uint32_t *length)
+{
+    uint8_t reg = 0;
+    uint8_t respByte;
+    NvMediaBool started = NVMEDIA_FALSE;
+    NvMediaBool escaped = NVMEDIA_FALSE;
+    uint32_t i;
+
+    *length = 0;
+    for (i = 0; i < 2 * BOSON_MAX_RESPONSE_LENGTH; i++) {
+        if(I2cBusRead(handle, sensorAddress, &reg,
+            sizeof(char), &respByte, sizeof(char)))
+        {
+            LOG_ERR("%s: Failed to read I2C %02x %02x", __func__,
+                sensorAddress, reg);
+            return NVMEDIA_STATUS_ERROR;
+        }
+
+        if(!started) {
+            if(respByte == _cmdStart[1]) {
+                started = NVMEDIA_TRUE;
+            } else if(i >= BOSON_MAX_RESPONSE_LENGTH) {
+                return NVMEDIA_STATUS_TIMED_OUT;
+            }
+            continue;
+        }
+        if(respByte == _cmdEnd[0]) {
+            return NVMEDIA_STATUS_OK;
+        }
+        if(respByte == _escapeChar) {
+            escaped = NVMEDIA_TRUE;
+            continue;
+        }
+        if(*length == BOSON_MAX_RESPONSE_LENGTH) {
+            break;
+        }
+        frame[(*length)++] = escaped ? respByte + 0xD : respByte;
+        escaped = NVMEDIA_FALSE;
+    }
+
+    LOG_ERR("%s: No termination character found", __func__);
+    return NVMEDIA_STATUS_ERROR;
+}
+
+static uint32_t
+_BatchCommandId(BosonBatchCommand *cmd) {
+    uint32_t cmdId = 0;
+    uint32_t i;
+
+    for (i = 0; i < 4; i++) {
+        cmdId = (cmdId << 8) | (cmd->cmdBody[i] & 0xff);
+    }
+    return cmdId;
+}
+
+static NvMediaStatus
+_ParseBatchResponse(BosonBatchCommand *cmd, uint8_t *frame, uint32_t length) {
+    uint16_t crc = 0x1d0f;
+    uint32_t expectedId = _BatchCommandId(cmd);
+    uint32_t cmdId;
+    uint32_t payloadLength;
+    uint32_t i;
+
+    if(length < BOSON_RESPONSE_HEADER + 2) {
+        LOG_ERR("%s: Response too short (%u bytes)", __func__, length);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    for (i = 0; i < length - 2; i++) {
+        crc = _UpdateCRC(crc, frame[i]);
+    }
+    if(frame[length-2] != (crc >> 8) || frame[length-1] != (crc & 0xff)) {
+        LOG_ERR("%s: Response CRC mismatch", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    MsbToLsb32(&cmdId, &frame[5]);
+    if(cmdId != expectedId) {
+        LOG_ERR("%s: Response for %08x while expecting %08x", __func__,
+            cmdId, expectedId);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    MsbToLsb32(&cmd->cameraStatus, &frame[9]);
+    if(cmd->cameraStatus) {
+        LOG_ERR("%s: Command %08x failed - %d", __func__, cmdId,
+            cmd->cameraStatus);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    payloadLength = length - BOSON_RESPONSE_HEADER - 2;
+    switch (cmd->responseType) {
+        case BOSON_RESPONSE_INT:
+            if(payloadLength < 4) {
+                LOG_ERR("%s: Missing value for %08x", __func__, cmdId);
+                return NVMEDIA_STATUS_ERROR;
+            }
+            MsbToLsb32(&cmd->intResponse, &frame[BOSON_RESPONSE_HEADER]);
+            break;
+        case BOSON_RESPONSE_STRING:
+            if(payloadLength > sizeof(cmd->stringResponse) - 1) {
+                payloadLength = sizeof(cmd->stringResponse) - 1;
+            }
+            memcpy(cmd->stringResponse, &frame[BOSON_RESPONSE_HEADER],
+                payloadLength);
+            cmd->stringResponse[payloadLength] = '\0';
+            break;
+        case BOSON_RESPONSE_NONE:
+        default:
+            break;
+    }
+
+    return NVMEDIA_STATUS_OK;
+}
+
 static NvMediaStatus
 _ReceiveHelper(uint32_t i2cDevice, uint32_t sensorAddress, uint8_t reg, 
     uint8_t *buffer)
@@ -159,7 +331,7 @@ _ReceiveHelper(uint32_t i2cDevice, uint32_t sensorAddress, uint8_t reg,
     int startIdx = -1;
     uint32_t cmdStatus;
 
-    testutil_i2c_open(i2cDevice, &handle);
+    I2cBusOpen(i2cDevice, &handle);
     if(!handle) {
         LOG_ERR("%s: Failed to open handle with id %u\n", __func__,
             sensorAddress);
@@ -169,7 +341,7 @@ _ReceiveHelper(uint32_t i2cDevice, uint32_t sensorAddress, uint8_t reg,
 
     for (size_t i = 0; i < 64; i++)
     {
-        testutil_i2c_read_subaddr(handle, sensorAddress, &reg, 
+        I2cBusRead(handle, sensorAddress, &reg, 
             sizeof(char), &respByte, sizeof(char));
         if(respByte == 0x8e) {
             startIdx = i + 1;
@@ -197,97 +369,89 @@ _ReceiveHelper(uint32_t i2cDevice, uint32_t sensorAddress, uint8_t reg,
     }
 
 finally:
-    testutil_i2c_close(handle);
+    I2cBusClose(handle);
 
     return status;
 }
 
 
-void
-BuildCommand(uint16_t *cmdBody, uint32_t *value, uint16_t *outCmd) {
-    // stop spooling, send start flag and arbitrary start data
-    uint16_t totalCmd[64];
-    uint16_t crc[2];
-    uint32_t cmdIdx = 0;
-    
-    //copy start of command
-    memcpy(totalCmd, _cmdStart, sizeof(_cmdStart));
-    cmdIdx += sizeof(_cmdStart) / sizeof(_cmdStart[0]);
-    // copy data type and value
-    memcpy(&totalCmd[cmdIdx], cmdBody, sizeof(cmdBody));
-    cmdIdx += sizeof(cmdBody) / sizeof(cmdBody[0]);
-    // sending a command so status is 4 0xFF bytes
-    for (size_t i = cmdIdx; i < cmdIdx + 4; i++) {
-        totalCmd[i] = 0xFF;
-    }
-    cmdIdx += 4;
+static void
+_InitFrameTemplates(void) {
+    uint32_t i;
 
-    if(value) {
-        uint8_t valBytes[4];
+    for (i = 0; i < BOSON_NUM_FRAME_TEMPLATES; i++) {
+        _FrameTemplate *t = &_frameTemplates[i];
 
-        LsbToMsbArr(valBytes, *value);
-        for (size_t i = 0; i < 4; i++) {
-            totalCmd[cmdIdx+i] = valBytes[i];
-        }
-        
-        cmdIdx += 4;
+        _EncodePrefix(t->cmdId, &t->frame, &t->prefixCrc);
+        t->prefixWords = t->frame.numWords;
+        _EncodeSuffix(&t->frame, t->prefixCrc, NULL);
     }
+}
 
-    _GetCRC(&totalCmd[2], cmdIdx - 2, crc);
-    memcpy(&totalCmd[cmdIdx], crc, sizeof(crc));
-    cmdIdx += sizeof(crc) / sizeof(crc[0]);
+NvMediaStatus
+EncodeCommand(uint16_t *cmdBody, uint32_t *value, BosonFrame *frame) {
+    uint32_t cmdId = 0;
+    uint16_t crc;
+    uint32_t i;
+
+    if(!cmdBody || !frame) {
+        return NVMEDIA_STATUS_BAD_PARAMETER;
+    }
+
+    for (i = 0; i < 4; i++) {
+        cmdId = (cmdId << 8) | (cmdBody[i] & 0xff);
+    }
+
+    pthread_once(&_frameTemplatesOnce, _InitFrameTemplates);
+    for (i = 0; i < BOSON_NUM_FRAME_TEMPLATES; i++) {
+        _FrameTemplate *t = &_frameTemplates[i];
+
+        if(t->cmdId != cmdId) {
+            continue;
+        }
+        if(!value) {
+            memcpy(frame, &t->frame, sizeof(BosonFrame));
+            return NVMEDIA_STATUS_OK;
+        }
+        // resume from the cached prefix and encode only the parameter
+        memcpy(frame->words, t->frame.words,
+            t->prefixWords * sizeof(uint16_t));
+        frame->numWords = t->prefixWords;
+        _EncodeSuffix(frame, t->prefixCrc, value);
+        return NVMEDIA_STATUS_OK;
+    }
 
-    // send stop flag and start spooling
-    memcpy(&totalCmd[cmdIdx], _cmdEnd, sizeof(_cmdEnd));
-    cmdIdx += sizeof(_cmdEnd) / sizeof(_cmdEnd[0]);
+    _EncodePrefix(cmdId, frame, &crc);
+    _EncodeSuffix(frame, crc, value);
 
-    memcpy(outCmd, totalCmd, sizeof(totalCmd));
+    return NVMEDIA_STATUS_OK;
 }
 
 NvMediaStatus
-SendCommand(uint32_t i2cDevice, uint32_t sensorAddress, uint16_t *cmd) {
+SendCommand(uint32_t i2cDevice, uint32_t sensorAddress,
+    const BosonFrame *frame)
+{
     I2cHandle handle = NULL;
     NvMediaStatus status = NVMEDIA_STATUS_OK;
-    uint32_t cmdEndLength = sizeof(_cmdEnd) / sizeof(_cmdEnd[0]);
     uint32_t i;
 
-    uint16_t tempCmd[64];
-
-    testutil_i2c_open(i2cDevice, &handle);
+    I2cBusOpen(i2cDevice, &handle);
     if(!handle) {
         LOG_ERR("%s: Failed to open handle with id %u\n", __func__,
             sensorAddress);
         return NVMEDIA_STATUS_ERROR;
     }
 
-    memcpy(tempCmd, cmd, 64 * sizeof(uint16_t));
-    _EscapeCmd(cmd);
-    
-    for (i = 0; i < 64; i++) {
-        uint8_t instruction[2] = {cmd[i] >> 8, cmd[i] & 0xFF};
-
-        if(testutil_i2c_write_subaddr(handle, sensorAddress, 
-            &instruction, 2)) 
+    for (i = 0; i < frame->numWords; i++) {
+        if(_WriteWord(handle, sensorAddress, frame->words[i]) !=
+            NVMEDIA_STATUS_OK)
         {
-            LOG_ERR("%s: Failed to write to I2C %02x %02x %02x",
-                __func__, sensorAddress,
-                instruction[0],
-                instruction[1]);
             status = NVMEDIA_STATUS_ERROR;
             break;
         }
-
-        if(cmd[i] == _cmdEnd[cmdEndLength-1]) {
-            break;
-        }
     }
 
-    if(i == 64) {
-        LOG_ERR("%s: No I2C termination character found", __func__);
-        status = NVMEDIA_STATUS_ERROR;
-    }    
-
-    testutil_i2c_close(handle);
+    I2cBusClose(handle);
 
     return status;
 }
@@ -337,4 +501,99 @@ ResetI2CBuffer(uint32_t i2cDevice, uint32_t sensorAddress) {
     _SendSingleCommand(i2cDevice, sensorAddress, off);
     nvsleep(10000);
     _SendSingleCommand(i2cDevice, sensorAddress, on);
-}
\ No newline at end of file
+}
+
+NvMediaStatus
+SendCommandBatch(I2cHandle handle, uint32_t sensorAddress,
+    BosonBatchCommand *cmds, uint32_t numCmds)
+{
+    NvMediaStatus status = NVMEDIA_STATUS_OK;
+    BosonFrame frame;
+    uint8_t response[BOSON_MAX_RESPONSE_LENGTH];
+    uint32_t length;
+    uint32_t i, j, retry;
+
+    if(!handle || !cmds || !numCmds) {
+        LOG_ERR("%s: Bad parameter", __func__);
+        return NVMEDIA_STATUS_BAD_PARAMETER;
+    }
+
+    // drop stale responses so the replies line up with this batch
+    if(_WriteWord(handle, sensorAddress, 0x0A02) != NVMEDIA_STATUS_OK) {
+        return NVMEDIA_STATUS_ERROR;
+    }
+    nvsleep(10000);
+    if(_WriteWord(handle, sensorAddress, 0x0A00) != NVMEDIA_STATUS_OK) {
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    I2cTraceMark(I2C_TRACE_BATCH_BEGIN, sensorAddress, 0, numCmds);
+
+    // stop spooling once for the whole batch
+    if(_WriteWord(handle, sensorAddress, _cmdStart[0]) != NVMEDIA_STATUS_OK) {
+        goto failed;
+    }
+
+    for (i = 0; i < numCmds; i++) {
+        EncodeCommand(cmds[i].cmdBody,
+            cmds[i].hasParam ? &cmds[i].param : NULL, &frame);
+        I2cTraceMark(I2C_TRACE_CMD_BEGIN, sensorAddress,
+            _BatchCommandId(&cmds[i]), 0);
+
+        // skip the per-command spooling words at either end of the frame
+        for (j = 1; j + 1 < frame.numWords; j++) {
+            if(_WriteWord(handle, sensorAddress, frame.words[j]) !=
+                NVMEDIA_STATUS_OK)
+            {
+                status = NVMEDIA_STATUS_ERROR;
+                break;
+            }
+        }
+        if(status != NVMEDIA_STATUS_OK) {
+            break;
+        }
+    }
+
+    // start spooling so the camera runs the queued commands
+    if(_WriteWord(handle, sensorAddress, _cmdEnd[1]) != NVMEDIA_STATUS_OK ||
+        status != NVMEDIA_STATUS_OK)
+    {
+        goto failed;
+    }
+
+    nvsleep(BOSON_RESPONSE_DELAY);
+
+    for (i = 0; i < numCmds; i++) {
+        cmds[i].status = _ReceiveFrame(handle, sensorAddress, response,
+            &length);
+        for (retry = 0; cmds[i].status == NVMEDIA_STATUS_TIMED_OUT &&
+            retry < BOSON_RESPONSE_RETRIES; retry++)
+        {
+            nvsleep(BOSON_RESPONSE_DELAY);
+            cmds[i].status = _ReceiveFrame(handle, sensorAddress, response,
+                &length);
+        }
+
+        if(cmds[i].status == NVMEDIA_STATUS_OK) {
+            cmds[i].status = _ParseBatchResponse(&cmds[i], response, length);
+        } else {
+            LOG_ERR("%s: No response for batch command %u", __func__, i);
+        }
+
+        I2cTraceMark(I2C_TRACE_CMD_END, sensorAddress,
+            _BatchCommandId(&cmds[i]), 0);
+
+        if(cmds[i].status != NVMEDIA_STATUS_OK) {
+            status = NVMEDIA_STATUS_ERROR;
+        }
+    }
+
+    I2cTraceMark(I2C_TRACE_BATCH_END, sensorAddress, 0, numCmds);
+    return status;
+failed:
+    for (i = 0; i < numCmds; i++) {
+        cmds[i].status = NVMEDIA_STATUS_ERROR;
+    }
+    I2cTraceMark(I2C_TRACE_BATCH_END, sensorAddress, 0, numCmds);
+    return NVMEDIA_STATUS_ERROR;
+}
@@ -11,12 +11,43 @@
 #include <stdint.h>
 
 #include "nvmedia_core.h"
+#include "testutil_i2c.h"
 
-void
-BuildCommand(uint16_t *cmdBody, uint32_t *value, uint16_t *outCmd);
+#define BOSON_MAX_BATCH_COMMANDS    16   // commands sent in one spooling window
+#define BOSON_MAX_FRAME_WORDS       64
+
+typedef enum {
+    BOSON_RESPONSE_NONE = 0,
+    BOSON_RESPONSE_INT,
+    BOSON_RESPONSE_STRING
+} BosonResponseType;
+
+typedef struct {
+    uint16_t                    cmdBody[4];
+    NvMediaBool                 hasParam;
+    uint32_t                    param;
+    BosonResponseType           responseType;
+
+    /* filled in from the camera response */
+    NvMediaStatus               status;
+    uint32_t                    cameraStatus;
+    uint32_t                    intResponse;
+    char                        stringResponse[32];
+} BosonBatchCommand;
+
+/* I2C words ready to be written: spooling control, flags and the escaped
+ * command body with its CRC */
+typedef struct {
+    uint16_t                    words[BOSON_MAX_FRAME_WORDS];
+    uint32_t                    numWords;
+} BosonFrame;
 
 NvMediaStatus
-SendCommand(uint32_t i2cDevice, uint32_t sensorAddress, uint16_t *cmd);
+EncodeCommand(uint16_t *cmdBody, uint32_t *value, BosonFrame *frame);
+
+NvMediaStatus
+SendCommand(uint32_t i2cDevice, uint32_t sensorAddress,
+    const BosonFrame *frame);
 
 NvMediaStatus
 ReceiveData(uint32_t i2cDevice, uint32_t sensorAddress, uint8_t reg, 
@@ -30,4 +61,8 @@ ReceiveStringData(uint32_t i2cDevice, uint32_t sensorAddress, uint8_t reg,
 void
 ResetI2CBuffer(uint32_t i2cDevice, uint32_t sensorAddress);
 
+NvMediaStatus
+SendCommandBatch(I2cHandle handle, uint32_t sensorAddress,
+    BosonBatchCommand *cmds, uint32_t numCmds);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,706 @@
+/* NVIDIA CORPORATION gave permission to FLIR Systems, Inc to modify this code
+  * and distribute it as part of the ADAS GMSL Kit.
+  * http://www.flir.com/
+  * October-2019
+*/
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "log_utils.h"
+
+#include "bosonSim.h"
+
+#define SIM_MAX_ATTRIBUTES          64
+#define SIM_MAX_FRAME_LENGTH        512
+#define SIM_MAX_RESPONSES           32
+#define SIM_MAX_RESPONSE_LENGTH     128
+#define SIM_MAX_STRING_LENGTH       32
+#define SIM_REGISTER_SLOTS          8192    // power of two
+#define SIM_MAX_DEVICES             128
+
+#define SIM_FIFO_REG                0x00
+#define SIM_SPOOL_REG               0x09
+#define SIM_RESET_REG               0x0A
+#define SIM_START_FLAG              0x8E
+#define SIM_ESCAPE_FLAG             0x9E
+#define SIM_END_FLAG                0xAE
+#define SIM_FRAME_HEADER            13      // channel, seq, cmd id, status
+
+typedef enum {
+    SIM_ATTRIBUTE_INT = 0,
+    SIM_ATTRIBUTE_STRING,
+    SIM_ATTRIBUTE_VOID,
+} SimAttributeType;
+
+typedef struct {
+    uint32_t                    getId;
+    uint32_t                    setId;
+    SimAttributeType            type;
+    uint32_t                    value;
+    char                        string[SIM_MAX_STRING_LENGTH];
+} SimAttribute;
+
+typedef struct {
+    uint8_t                     data[SIM_MAX_RESPONSE_LENGTH];
+    uint32_t                    length;
+    uint32_t                    position;
+    uint64_t                    readyNs;
+} SimResponse;
+
+typedef struct {
+    NvMediaBool                 used;
+    uint8_t                     device;
+    uint16_t                    subAddress;
+    uint8_t                     value;
+} SimRegister;
+
+typedef struct {
+    int                         bus;
+} SimHandle;
+
+static pthread_mutex_t _lock = PTHREAD_MUTEX_INITIALIZER;
+static BosonSimConfig _config;
+static BosonSimStats _stats;
+static NvMediaBool _initialized = NVMEDIA_FALSE;
+
+static SimAttribute _attributes[SIM_MAX_ATTRIBUTES];
+static uint32_t _numAttributes = 0;
+
+/* Boson FIFO state */
+static uint8_t _rxFrame[SIM_MAX_FRAME_LENGTH];
+static uint32_t _rxLength = 0;
+static NvMediaBool _spoolingOff = NVMEDIA_FALSE;
+static SimResponse _responses[SIM_MAX_RESPONSES];
+static uint32_t _responseHead = 0;
+static uint32_t _numResponses = 0;
+static uint64_t _lastReadyNs = 0;
+
+static uint32_t _faults[BOSON_SIM_MAX_FAULTS];
+
+static SimRegister *_registers = NULL;
+static uint8_t _registerWidth[SIM_MAX_DEVICES];
+
+static uint64_t
+_NowNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Holds the caller for the time the transfer would take on the wire */
+static void
+_BusDelay(unsigned int numBytes)
+{
+    struct timespec deadline;
+    uint64_t ns;
+
+    if (!_config.byteTime) {
+        return;
+    }
+
+    ns = _NowNs() + (uint64_t)numBytes * _config.byteTime * 1000;
+    deadline.tv_sec = ns / 1000000000ULL;
+    deadline.tv_nsec = ns % 1000000000ULL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline,
+                           NULL) == EINTR);
+}
+
+/* Bitwise CRC16 (poly 0x1021, init 0x1d0f), independent of the table used
+ * by bosonInterface so that the two check each other */
+static uint16_t
+_Crc16(uint8_t *data, uint32_t length)
+{
+    uint16_t crc = 0x1d0f;
+    uint32_t i, bit;
+
+    for (i = 0; i < length; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+static NvMediaBool
+_TakeFault(BosonSimFault fault)
+{
+    if (!_faults[fault]) {
+        return NVMEDIA_FALSE;
+    }
+    _faults[fault]--;
+    _stats.faultsInjected++;
+    return NVMEDIA_TRUE;
+}
+
+static uint32_t
+_ReadBE32(uint8_t *data)
+{
+    return (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+}
+
+static void
+_WriteBE32(uint8_t *data, uint32_t value)
+{
+    data[0] = value >> 24;
+    data[1] = (value >> 16) & 0xff;
+    data[2] = (value >> 8) & 0xff;
+    data[3] = value & 0xff;
+}
+
+static SimAttribute *
+_FindAttribute(uint32_t cmdId, NvMediaBool *isSet)
+{
+    uint32_t i;
+
+    for (i = 0; i < _numAttributes; i++) {
+        if (_attributes[i].getId == cmdId) {
+            *isSet = NVMEDIA_FALSE;
+            return &_attributes[i];
+        }
+        if (_attributes[i].setId && _attributes[i].setId == cmdId) {
+            *isSet = NVMEDIA_TRUE;
+            return &_attributes[i];
+        }
+    }
+    return NULL;
+}
+
+static SimAttribute *
+_AddAttribute(uint32_t getId)
+{
+    NvMediaBool isSet;
+    SimAttribute *attribute = _FindAttribute(getId, &isSet);
+
+    if (attribute && !isSet) {
+        return attribute;
+    }
+    if (_numAttributes == SIM_MAX_ATTRIBUTES) {
+        LOG_ERR("%s: Attribute table full\n", __func__);
+        return NULL;
+    }
+    attribute = &_attributes[_numAttributes++];
+    memset(attribute, 0, sizeof(*attribute));
+    attribute->getId = getId;
+    return attribute;
+}
+
+static void
+_QueueResponse(uint8_t *frame, uint32_t length)
+{
+    SimResponse *response;
+    uint64_t now = _NowNs();
+    uint16_t crc;
+    uint32_t i;
+
+    if (_numResponses == SIM_MAX_RESPONSES) {
+        _stats.responsesDropped++;
+        return;
+    }
+
+    crc = _Crc16(frame, length);
+    if (_TakeFault(BOSON_SIM_FAULT_CORRUPT_CRC)) {
+        crc ^= 0x5a5a;
+    }
+    frame[length++] = crc >> 8;
+    frame[length++] = crc & 0xff;
+
+    response = &_responses[(_responseHead + _numResponses) %
+                           SIM_MAX_RESPONSES];
+    response->length = 0;
+    response->position = 0;
+    response->data[response->length++] = SIM_START_FLAG;
+    for (i = 0; i < length; i++) {
+        if (response->length + 3 > SIM_MAX_RESPONSE_LENGTH) {
+            _stats.responsesDropped++;
+            return;
+        }
+        if (frame[i] == SIM_START_FLAG || frame[i] == SIM_ESCAPE_FLAG ||
+            frame[i] == SIM_END_FLAG) {
+            response->data[response->length++] = SIM_ESCAPE_FLAG;
+            response->data[response->length++] = frame[i] - 0xD;
+        } else {
+            response->data[response->length++] = frame[i];
+        }
+    }
+    response->data[response->length++] = SIM_END_FLAG;
+
+    /* The camera works through its queue one command at a time */
+    _lastReadyNs = ((_lastReadyNs > now) ? _lastReadyNs : now) +
+                   (uint64_t)_config.commandLatency * 1000;
+    response->readyNs = _lastReadyNs;
+    _numResponses++;
+}
+
+/* Runs one unescaped frame: channel, seq, cmd id, status, payload, crc */
+static void
+_ExecuteFrame(uint8_t *frame, uint32_t length)
+{
+    uint8_t response[SIM_MAX_RESPONSE_LENGTH];
+    uint32_t responseLength = SIM_FRAME_HEADER;
+    uint32_t cmdId, status = 0;
+    uint32_t payloadLength;
+    SimAttribute *attribute;
+    NvMediaBool isSet = NVMEDIA_FALSE;
+
+    _stats.framesReceived++;
+
+    if (length < SIM_FRAME_HEADER + 2) {
+        _stats.crcErrors++;
+        return;
+    }
+    if (_Crc16(frame, length - 2) !=
+        ((frame[length - 2] << 8) | frame[length - 1])) {
+        LOG_DBG("%s: Dropping frame with bad CRC\n", __func__);
+        _stats.crcErrors++;
+        return;
+    }
+
+    cmdId = _ReadBE32(&frame[5]);
+    payloadLength = length - SIM_FRAME_HEADER - 2;
+
+    /* Echo channel, sequence and command id */
+    memcpy(response, frame, 9);
+
+    attribute = _FindAttribute(cmdId, &isSet);
+    if (!attribute) {
+        status = BOSON_SIM_STATUS_UNKNOWN_COMMAND;
+        _stats.unknownCommands++;
+    } else if (isSet) {
+        if (payloadLength < 4) {
+            status = BOSON_SIM_STATUS_BAD_ARGUMENT;
+        } else {
+            attribute->value = _ReadBE32(&frame[SIM_FRAME_HEADER]);
+        }
+    } else if (attribute->type == SIM_ATTRIBUTE_INT) {
+        _WriteBE32(&response[responseLength], attribute->value);
+        responseLength += 4;
+    } else if (attribute->type == SIM_ATTRIBUTE_STRING) {
+        /* Boson string attributes are fixed size, zero padded fields */
+        memcpy(&response[responseLength], attribute->string,
+               SIM_MAX_STRING_LENGTH);
+        responseLength += SIM_MAX_STRING_LENGTH;
+    }
+    _WriteBE32(&response[9], status);
+    _stats.commandsExecuted++;
+
+    if (_TakeFault(BOSON_SIM_FAULT_DROP_RESPONSE)) {
+        _stats.responsesDropped++;
+        return;
+    }
+    _QueueResponse(response, responseLength);
+}
+
+/* Splits the received FIFO bytes into frames and executes them */
+static void
+_ProcessFifo(void)
+{
+    uint8_t frame[SIM_MAX_FRAME_LENGTH];
+    uint32_t frameLength = 0;
+    NvMediaBool started = NVMEDIA_FALSE;
+    NvMediaBool escaped = NVMEDIA_FALSE;
+    uint32_t i;
+
+    for (i = 0; i < _rxLength; i++) {
+        uint8_t byte = _rxFrame[i];
+
+        if (byte == SIM_START_FLAG) {
+            started = NVMEDIA_TRUE;
+            escaped = NVMEDIA_FALSE;
+            frameLength = 0;
+        } else if (!started) {
+            continue;
+        } else if (byte == SIM_END_FLAG) {
+            _ExecuteFrame(frame, frameLength);
+            started = NVMEDIA_FALSE;
+        } else if (byte == SIM_ESCAPE_FLAG) {
+            escaped = NVMEDIA_TRUE;
+        } else {
+            frame[frameLength++] = escaped ? byte + 0xD : byte;
+            escaped = NVMEDIA_FALSE;
+        }
+    }
+
+    /* Keep a partial frame around until the rest of it arrives */
+    if (started) {
+        for (i = _rxLength; i > 0 && _rxFrame[i - 1] != SIM_START_FLAG; i--);
+        _rxLength -= i - 1;
+        memmove(_rxFrame, &_rxFrame[i - 1], _rxLength);
+    } else {
+        _rxLength = 0;
+    }
+}
+
+static void
+_BosonWrite(uint8_t reg, uint8_t value)
+{
+    switch (reg) {
+        case SIM_FIFO_REG:
+            if (_rxLength == SIM_MAX_FRAME_LENGTH) {
+                _rxLength = 0;
+            }
+            _rxFrame[_rxLength++] = value;
+            if (value == SIM_END_FLAG && !_spoolingOff) {
+                _ProcessFifo();
+            }
+            break;
+        case SIM_SPOOL_REG:
+            _spoolingOff = (value & 0x02) ? NVMEDIA_TRUE : NVMEDIA_FALSE;
+            if (!_spoolingOff) {
+                _ProcessFifo();
+            }
+            break;
+        case SIM_RESET_REG:
+            if (value & 0x02) {
+                _rxLength = 0;
+                _numResponses = 0;
+                _lastReadyNs = 0;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static uint8_t
+_BosonRead(void)
+{
+    SimResponse *response;
+    uint8_t byte;
+
+    if (!_numResponses) {
+        return 0;
+    }
+    response = &_responses[_responseHead];
+    if (response->readyNs > _NowNs()) {
+        return 0;
+    }
+
+    byte = response->data[response->position++];
+    if (response->position == response->length) {
+        _responseHead = (_responseHead + 1) % SIM_MAX_RESPONSES;
+        _numResponses--;
+    }
+    return byte;
+}
+
+static SimRegister *
+_FindRegister(uint8_t device, uint16_t subAddress, NvMediaBool create)
+{
+    uint32_t key = ((uint32_t)device << 16) | subAddress;
+    uint32_t slot = (key * 2654435761U) & (SIM_REGISTER_SLOTS - 1);
+    uint32_t i;
+
+    for (i = 0; i < SIM_REGISTER_SLOTS; i++) {
+        SimRegister *reg = &_registers[(slot + i) & (SIM_REGISTER_SLOTS - 1)];
+
+        if (!reg->used) {
+            if (!create) {
+                return NULL;
+            }
+            reg->used = NVMEDIA_TRUE;
+            reg->device = device;
+            reg->subAddress = subAddress;
+            reg->value = 0;
+            return reg;
+        }
+        if (reg->device == device && reg->subAddress == subAddress) {
+            return reg;
+        }
+    }
+    return NULL;
+}
+
+static int
+_SimOpen(int i2cDevice, I2cHandle *handle)
+{
+    SimHandle *simHandle = calloc(1, sizeof(SimHandle));
+
+    if (!simHandle) {
+        *handle = NULL;
+        return -1;
+    }
+    simHandle->bus = i2cDevice;
+    *handle = simHandle;
+    return 0;
+}
+
+static void
+_SimClose(I2cHandle handle)
+{
+    free(handle);
+}
+
+static int
+_SimWrite(I2cHandle handle, unsigned int deviceAddress, void *data,
+          unsigned int length)
+{
+    uint8_t *bytes = (uint8_t *)data;
+    uint32_t width, i;
+    uint16_t subAddress = 0;
+    int result = 0;
+
+    if (!handle || !data || !length) {
+        return -1;
+    }
+
+    _BusDelay(length + 1);
+
+    pthread_mutex_lock(&_lock);
+    if (_TakeFault(BOSON_SIM_FAULT_NAK)) {
+        result = -1;
+        goto done;
+    }
+    _stats.bytesWritten += length;
+
+    if (deviceAddress == _config.bosonAddress) {
+        /* Boson registers do not auto-increment, bursts go to one register */
+        for (i = 1; i < length; i++) {
+            _BosonWrite(bytes[0], bytes[i]);
+        }
+        goto done;
+    }
+
+    width = _registerWidth[deviceAddress % SIM_MAX_DEVICES];
+    if (length <= width) {
+        goto done;
+    }
+    for (i = 0; i < width; i++) {
+        subAddress = (subAddress << 8) | bytes[i];
+    }
+    for (i = width; i < length; i++, subAddress++) {
+        SimRegister *reg = _FindRegister(deviceAddress, subAddress,
+                                         NVMEDIA_TRUE);
+        if (!reg) {
+            result = -1;
+            break;
+        }
+        reg->value = bytes[i];
+    }
+
+done:
+    pthread_mutex_unlock(&_lock);
+    return result;
+}
+
+static int
+_SimRead(I2cHandle handle, unsigned int deviceAddress, void *subAddress,
+         unsigned int subAddressLength, void *data, unsigned int length)
+{
+    uint8_t *sub = (uint8_t *)subAddress;
+    uint8_t *bytes = (uint8_t *)data;
+    uint16_t address = 0;
+    uint32_t i;
+    int result = 0;
+
+    if (!handle || !data) {
+        return -1;
+    }
+
+    _BusDelay(subAddressLength + length + 2);
+
+    pthread_mutex_lock(&_lock);
+    if (_TakeFault(BOSON_SIM_FAULT_NAK)) {
+        result = -1;
+        goto done;
+    }
+    _stats.bytesRead += length;
+
+    if (deviceAddress == _config.bosonAddress) {
+        for (i = 0; i < length; i++) {
+            bytes[i] = _BosonRead();
+        }
+        goto done;
+    }
+
+    for (i = 0; i < subAddressLength && i < 2; i++) {
+        address = (address << 8) | sub[i];
+    }
+    for (i = 0; i < length; i++, address++) {
+        SimRegister *reg = _FindRegister(deviceAddress, address,
+                                         NVMEDIA_FALSE);
+        bytes[i] = reg ? reg->value : 0;
+    }
+
+done:
+    pthread_mutex_unlock(&_lock);
+    return result;
+}
+
+static const I2cBusBackend _simBackend = {
+    .name = "boson-sim",
+    .open = _SimOpen,
+    .close = _SimClose,
+    .write = _SimWrite,
+    .read = _SimRead,
+};
+
+NvMediaStatus
+BosonSimInit(BosonSimConfig *config)
+{
+    if (_initialized) {
+        return NVMEDIA_STATUS_OK;
+    }
+
+    _registers = calloc(SIM_REGISTER_SLOTS, sizeof(SimRegister));
+    if (!_registers) {
+        LOG_ERR("%s: Out of memory\n", __func__);
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+
+    if (config) {
+        _config = *config;
+    } else {
+        _config.bosonAddress = BOSON_SIM_DEFAULT_ADDRESS;
+        _config.byteTime = BOSON_SIM_DEFAULT_BYTE_TIME;
+        _config.commandLatency = BOSON_SIM_DEFAULT_COMMAND_LATENCY;
+    }
+    memset(&_stats, 0, sizeof(_stats));
+    memset(_faults, 0, sizeof(_faults));
+    memset(_registerWidth, 1, sizeof(_registerWidth));
+    _numAttributes = 0;
+    _rxLength = 0;
+    _numResponses = 0;
+    _responseHead = 0;
+    _lastReadyNs = 0;
+    _spoolingOff = NVMEDIA_FALSE;
+    _initialized = NVMEDIA_TRUE;
+
+    /* Commands used by this application */
+    BosonSimSetIntAttribute(0x00050002, 0, 123456);         // serial number
+    BosonSimSetStringAttribute(0x0005003F, "20640A050-6PAAX"); // part number
+    BosonSimSetIntAttribute(0x00040006, 0x00040005, 0);     // telemetry packing
+    BosonSimSetIntAttribute(0x000E0007, 0, 60);             // frame rate
+    BosonSimSetIntAttribute(0x00050013, 0x00050012, 0);     // FFC mode
+    BosonSimSetIntAttribute(0x000B0004, 0x000B0003, 0);     // color LUT
+    BosonSimAddVoidCommand(0x00050007);                     // run FFC
+
+    LOG_MSG("%s: Simulating Boson at 0x%02x\n", __func__,
+            _config.bosonAddress);
+    return NVMEDIA_STATUS_OK;
+}
+
+void
+BosonSimFini(void)
+{
+    pthread_mutex_lock(&_lock);
+    free(_registers);
+    _registers = NULL;
+    _initialized = NVMEDIA_FALSE;
+    pthread_mutex_unlock(&_lock);
+}
+
+const I2cBusBackend *
+BosonSimGetBackend(void)
+{
+    return &_simBackend;
+}
+
+NvMediaStatus
+BosonSimSetIntAttribute(uint32_t getId, uint32_t setId, uint32_t value)
+{
+    SimAttribute *attribute;
+
+    pthread_mutex_lock(&_lock);
+    attribute = _AddAttribute(getId);
+    if (attribute) {
+        attribute->setId = setId;
+        attribute->type = SIM_ATTRIBUTE_INT;
+        attribute->value = value;
+    }
+    pthread_mutex_unlock(&_lock);
+
+    return attribute ? NVMEDIA_STATUS_OK : NVMEDIA_STATUS_OUT_OF_MEMORY;
+}
+
+NvMediaStatus
+BosonSimSetStringAttribute(uint32_t getId, const char *value)
+{
+    SimAttribute *attribute;
+
+    if (!value) {
+        return NVMEDIA_STATUS_BAD_PARAMETER;
+    }
+
+    pthread_mutex_lock(&_lock);
+    attribute = _AddAttribute(getId);
+    if (attribute) {
+        attribute->type = SIM_ATTRIBUTE_STRING;
+        memset(attribute->string, 0, SIM_MAX_STRING_LENGTH);
+        strncpy(attribute->string, value, SIM_MAX_STRING_LENGTH - 1);
+    }
+    pthread_mutex_unlock(&_lock);
+
+    return attribute ? NVMEDIA_STATUS_OK : NVMEDIA_STATUS_OUT_OF_MEMORY;
+}
+
+NvMediaStatus
+BosonSimAddVoidCommand(uint32_t cmdId)
+{
+    SimAttribute *attribute;
+
+    pthread_mutex_lock(&_lock);
+    attribute = _AddAttribute(cmdId);
+    if (attribute) {
+        attribute->type = SIM_ATTRIBUTE_VOID;
+    }
+    pthread_mutex_unlock(&_lock);
+
+    return attribute ? NVMEDIA_STATUS_OK : NVMEDIA_STATUS_OUT_OF_MEMORY;
+}
+
+void
+BosonSimInjectFault(BosonSimFault fault, uint32_t count)
+{
+    if (fault >= BOSON_SIM_MAX_FAULTS) {
+        return;
+    }
+
+    pthread_mutex_lock(&_lock);
+    _faults[fault] += count;
+    pthread_mutex_unlock(&_lock);
+}
+
+void
+BosonSimSetRegisterWidth(uint8_t device, uint32_t width)
+{
+    if (width < 1 || width > 2) {
+        LOG_ERR("%s: Unsupported sub-address width %u\n", __func__, width);
+        return;
+    }
+
+    pthread_mutex_lock(&_lock);
+    _registerWidth[device % SIM_MAX_DEVICES] = width;
+    pthread_mutex_unlock(&_lock);
+}
+
+void
+BosonSimGetStats(BosonSimStats *stats)
+{
+    pthread_mutex_lock(&_lock);
+    *stats = _stats;
+    pthread_mutex_unlock(&_lock);
+}
+
+void
+BosonSimPrintStats(void)
+{
+    BosonSimStats stats;
+
+    BosonSimGetStats(&stats);
+    LOG_MSG("Boson simulator:\n");
+    LOG_MSG("  Bytes written/read:  %llu / %llu\n",
+            (unsigned long long)stats.bytesWritten,
+            (unsigned long long)stats.bytesRead);
+    LOG_MSG("  Frames received:     %u (%u CRC errors)\n",
+            stats.framesReceived, stats.crcErrors);
+    LOG_MSG("  Commands executed:   %u (%u unknown)\n",
+            stats.commandsExecuted, stats.unknownCommands);
+    LOG_MSG("  Responses dropped:   %u\n", stats.responsesDropped);
+    LOG_MSG("  Faults injected:     %u\n", stats.faultsInjected);
+}
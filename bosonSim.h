@@ -0,0 +1,82 @@
+/* NVIDIA CORPORATION gave permission to FLIR Systems, Inc to modify this code
+  * and distribute it as part of the ADAS GMSL Kit.
+  * http://www.flir.com/
+  * October-2019
+*/
+#ifndef __BOSON_SIM_H__
+#define __BOSON_SIM_H__
+
+#include <stdint.h>
+
+#include "nvmedia_core.h"
+#include "i2cBus.h"
+
+/* In-process I2C backend answering like a Boson. FIFO frames written to
+ * the Boson address are decoded, CRC checked and answered from an
+ * attribute table; every other address behaves as a plain register file. */
+
+#define BOSON_SIM_DEFAULT_ADDRESS           0x6C    // 0xD8 >> 1
+#define BOSON_SIM_DEFAULT_BYTE_TIME         23      // us per byte at 400 kHz
+#define BOSON_SIM_DEFAULT_COMMAND_LATENCY   500     // us
+
+#define BOSON_SIM_STATUS_UNKNOWN_COMMAND    0x0000FFFF
+#define BOSON_SIM_STATUS_BAD_ARGUMENT       0x0000FFFE
+
+typedef enum {
+    BOSON_SIM_FAULT_NAK = 0,                // fail the next transfers
+    BOSON_SIM_FAULT_CORRUPT_CRC,            // flip the CRC of the next responses
+    BOSON_SIM_FAULT_DROP_RESPONSE,          // never answer the next commands
+    BOSON_SIM_MAX_FAULTS
+} BosonSimFault;
+
+typedef struct {
+    uint8_t                     bosonAddress;
+    uint32_t                    byteTime;
+    uint32_t                    commandLatency;
+} BosonSimConfig;
+
+typedef struct {
+    uint64_t                    bytesWritten;
+    uint64_t                    bytesRead;
+    uint32_t                    framesReceived;
+    uint32_t                    crcErrors;
+    uint32_t                    commandsExecuted;
+    uint32_t                    unknownCommands;
+    uint32_t                    responsesDropped;
+    uint32_t                    faultsInjected;
+} BosonSimStats;
+
+/* NULL config selects the defaults above */
+NvMediaStatus
+BosonSimInit(BosonSimConfig *config);
+
+void
+BosonSimFini(void);
+
+const I2cBusBackend *
+BosonSimGetBackend(void);
+
+/* setId may be 0 for read-only attributes */
+NvMediaStatus
+BosonSimSetIntAttribute(uint32_t getId, uint32_t setId, uint32_t value);
+
+NvMediaStatus
+BosonSimSetStringAttribute(uint32_t getId, const char *value);
+
+NvMediaStatus
+BosonSimAddVoidCommand(uint32_t cmdId);
+
+void
+BosonSimInjectFault(BosonSimFault fault, uint32_t count);
+
+/* Sub-address width in bytes used to decode writes to a register device */
+void
+BosonSimSetRegisterWidth(uint8_t device, uint32_t width);
+
+void
+BosonSimGetStats(BosonSimStats *stats);
+
+void
+BosonSimPrintStats(void);
+
+#endif
@@ -0,0 +1,371 @@
+/* NVIDIA CORPORATION gave permission to FLIR Systems, Inc to modify this code
+  * and distribute it as part of the ADAS GMSL Kit.
+  * http://www.flir.com/
+  * October-2019
+*/
+
+/* Host self test of the Boson simulator, built with "make simtest". Drives
+ * the I2C backend directly with its own frame encoder and CRC so that the
+ * simulator is checked against an independent implementation. */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "log_utils.h"
+
+#include "bosonSim.h"
+
+#define TEST_BUS                0
+#define TEST_BOSON              BOSON_SIM_DEFAULT_ADDRESS
+#define TEST_DESER              0x29    // 0x52 >> 1
+#define TEST_SERIALIZER         0x42    // 0x84 >> 1
+#define TEST_MAX_FRAME          256
+
+#define TEST_FIFO_REG           0x00
+#define TEST_SPOOL_REG          0x09
+#define TEST_START_FLAG         0x8E
+#define TEST_ESCAPE_FLAG        0x9E
+#define TEST_END_FLAG           0xAE
+
+#define TEST_SERIAL_GET         0x00050002
+#define TEST_PART_GET           0x0005003F
+#define TEST_GAIN_GET           0x00070002
+#define TEST_GAIN_SET           0x00070001
+#define TEST_RUN_FFC            0x00050007
+
+typedef struct {
+    uint32_t                    sequence;
+    uint32_t                    cmdId;
+    uint32_t                    status;
+    uint8_t                     payload[TEST_MAX_FRAME];
+    uint32_t                    payloadLength;
+    NvMediaBool                 crcValid;
+} TestResponse;
+
+static const I2cBusBackend *_backend;
+static I2cHandle _handle;
+static uint32_t _sequence = 0;
+static uint32_t _numChecks = 0;
+static uint32_t _numFailed = 0;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        _numChecks++;                                                       \
+        if (!(cond)) {                                                      \
+            _numFailed++;                                                   \
+            LOG_ERR("%s:%d: check failed: %s\n", __func__, __LINE__, #cond); \
+        }                                                                   \
+    } while (0)
+
+/* CRC-16/AUG-CCITT, the Boson frame checksum */
+static uint16_t
+_Crc16(const uint8_t *data, uint32_t length)
+{
+    uint16_t crc = 0x1d0f;
+    uint32_t i, bit;
+
+    for (i = 0; i < length; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+static void
+_PutBE32(uint8_t *data, uint32_t value)
+{
+    data[0] = value >> 24;
+    data[1] = (value >> 16) & 0xff;
+    data[2] = (value >> 8) & 0xff;
+    data[3] = value & 0xff;
+}
+
+static uint32_t
+_GetBE32(const uint8_t *data)
+{
+    return ((uint32_t)data[0] << 24) | (data[1] << 16) | (data[2] << 8) |
+           data[3];
+}
+
+static int
+_WriteReg(uint8_t device, uint8_t reg, uint8_t value)
+{
+    uint8_t data[2] = { reg, value };
+
+    return _backend->write(_handle, device, data, sizeof(data));
+}
+
+/* Escapes and writes one command frame to the Boson FIFO, byte by byte
+ * like the scripts do. Returns the sequence number used. */
+static uint32_t
+_SendCommand(uint32_t cmdId, const uint8_t *payload, uint32_t payloadLength,
+             NvMediaBool corruptCrc)
+{
+    uint8_t frame[TEST_MAX_FRAME];
+    uint32_t length = 0;
+    uint16_t crc;
+    uint32_t i;
+
+    frame[length++] = 0;                        // channel
+    _PutBE32(&frame[length], ++_sequence);
+    length += 4;
+    _PutBE32(&frame[length], cmdId);
+    length += 4;
+    _PutBE32(&frame[length], 0xFFFFFFFF);       // status
+    length += 4;
+    memcpy(&frame[length], payload, payloadLength);
+    length += payloadLength;
+    crc = _Crc16(frame, length);
+    if (corruptCrc) {
+        crc ^= 0x0101;
+    }
+    frame[length++] = crc >> 8;
+    frame[length++] = crc & 0xff;
+
+    _WriteReg(TEST_BOSON, TEST_FIFO_REG, TEST_START_FLAG);
+    for (i = 0; i < length; i++) {
+        if (frame[i] == TEST_START_FLAG || frame[i] == TEST_ESCAPE_FLAG ||
+            frame[i] == TEST_END_FLAG) {
+            _WriteReg(TEST_BOSON, TEST_FIFO_REG, TEST_ESCAPE_FLAG);
+            _WriteReg(TEST_BOSON, TEST_FIFO_REG, frame[i] - 0xD);
+        } else {
+            _WriteReg(TEST_BOSON, TEST_FIFO_REG, frame[i]);
+        }
+    }
+    _WriteReg(TEST_BOSON, TEST_FIFO_REG, TEST_END_FLAG);
+
+    return _sequence;
+}
+
+/* Reads and unescapes one response frame. Returns NVMEDIA_FALSE if no
+ * response is waiting. */
+static NvMediaBool
+_ReadResponse(TestResponse *response)
+{
+    uint8_t frame[TEST_MAX_FRAME];
+    uint8_t reg = TEST_FIFO_REG;
+    uint32_t length = 0;
+    NvMediaBool escaped = NVMEDIA_FALSE;
+    uint8_t byte = 0;
+
+    memset(response, 0, sizeof(*response));
+
+    _backend->read(_handle, TEST_BOSON, &reg, 1, &byte, 1);
+    if (byte != TEST_START_FLAG) {
+        return NVMEDIA_FALSE;
+    }
+
+    while (length < TEST_MAX_FRAME) {
+        _backend->read(_handle, TEST_BOSON, &reg, 1, &byte, 1);
+        if (byte == TEST_END_FLAG) {
+            break;
+        } else if (byte == TEST_ESCAPE_FLAG) {
+            escaped = NVMEDIA_TRUE;
+        } else {
+            frame[length++] = escaped ? byte + 0xD : byte;
+            escaped = NVMEDIA_FALSE;
+        }
+    }
+    if (length < 15) {
+        return NVMEDIA_FALSE;
+    }
+
+    response->sequence = _GetBE32(&frame[1]);
+    response->cmdId = _GetBE32(&frame[5]);
+    response->status = _GetBE32(&frame[9]);
+    response->payloadLength = length - 15;
+    memcpy(response->payload, &frame[13], response->payloadLength);
+    response->crcValid = _Crc16(frame, length - 2) ==
+                         ((frame[length - 2] << 8) | frame[length - 1]);
+    return NVMEDIA_TRUE;
+}
+
+static void
+_TestCrc(void)
+{
+    const uint8_t check[] = "123456789";
+
+    /* Standard check value of CRC-16/AUG-CCITT */
+    CHECK(_Crc16(check, 9) == 0xE5CC);
+}
+
+static void
+_TestIntAttribute(void)
+{
+    TestResponse response;
+    uint8_t value[4];
+    uint32_t sequence;
+
+    sequence = _SendCommand(TEST_SERIAL_GET, NULL, 0, NVMEDIA_FALSE);
+    CHECK(_ReadResponse(&response));
+    CHECK(response.crcValid);
+    CHECK(response.sequence == sequence);
+    CHECK(response.cmdId == TEST_SERIAL_GET);
+    CHECK(response.status == 0);
+    CHECK(response.payloadLength == 4);
+    CHECK(_GetBE32(response.payload) == 123456);
+
+    /* A value made of the frame flags must be escaped both ways */
+    CHECK(BosonSimSetIntAttribute(TEST_GAIN_GET, TEST_GAIN_SET, 0) ==
+          NVMEDIA_STATUS_OK);
+    _PutBE32(value, 0x8E9EAE00);
+    _SendCommand(TEST_GAIN_SET, value, sizeof(value), NVMEDIA_FALSE);
+    CHECK(_ReadResponse(&response));
+    CHECK(response.crcValid);
+    CHECK(response.status == 0);
+
+    _SendCommand(TEST_GAIN_GET, NULL, 0, NVMEDIA_FALSE);
+    CHECK(_ReadResponse(&response));
+    CHECK(response.crcValid);
+    CHECK(_GetBE32(response.payload) == 0x8E9EAE00);
+
+    /* Set without an argument */
+    _SendCommand(TEST_GAIN_SET, NULL, 0, NVMEDIA_FALSE);
+    CHECK(_ReadResponse(&response));
+    CHECK(response.status == BOSON_SIM_STATUS_BAD_ARGUMENT);
+}
+
+static void
+_TestStringAndVoid(void)
+{
+    TestResponse response;
+
+    CHECK(BosonSimSetStringAttribute(TEST_PART_GET, "TEST-PART") ==
+          NVMEDIA_STATUS_OK);
+    _SendCommand(TEST_PART_GET, NULL, 0, NVMEDIA_FALSE);
+    CHECK(_ReadResponse(&response));
+    CHECK(response.crcValid);
+    CHECK(response.payloadLength == 32);
+    CHECK(!strcmp((char *)response.payload, "TEST-PART"));
+
+    _SendCommand(TEST_RUN_FFC, NULL, 0, NVMEDIA_FALSE);
+    CHECK(_ReadResponse(&response));
+    CHECK(response.status == 0);
+    CHECK(response.payloadLength == 0);
+
+    _SendCommand(0x00DEAD00, NULL, 0, NVMEDIA_FALSE);
+    CHECK(_ReadResponse(&response));
+    CHECK(response.status == BOSON_SIM_STATUS_UNKNOWN_COMMAND);
+
+    CHECK(!_ReadResponse(&response));
+}
+
+/* With spooling off, frames wait in the FIFO and are answered in order
+ * once it is turned back on */
+static void
+_TestBatch(void)
+{
+    TestResponse response;
+    uint32_t sequences[3];
+    uint32_t i;
+
+    _WriteReg(TEST_BOSON, TEST_SPOOL_REG, 0x02);
+    for (i = 0; i < 3; i++) {
+        sequences[i] = _SendCommand(TEST_SERIAL_GET, NULL, 0, NVMEDIA_FALSE);
+    }
+    CHECK(!_ReadResponse(&response));
+
+    _WriteReg(TEST_BOSON, TEST_SPOOL_REG, 0x00);
+    for (i = 0; i < 3; i++) {
+        CHECK(_ReadResponse(&response));
+        CHECK(response.crcValid);
+        CHECK(response.sequence == sequences[i]);
+    }
+    CHECK(!_ReadResponse(&response));
+}
+
+static void
+_TestRegisterWidth(void)
+{
+    uint8_t burst[] = { 0x04, 0x0B, 0x42, 0x2A };
+    uint8_t sub[2];
+    uint8_t data[2] = { 0, 0 };
+
+    /* 16 bit sub-addresses, a burst fills consecutive registers */
+    BosonSimSetRegisterWidth(TEST_DESER, 2);
+    CHECK(!_backend->write(_handle, TEST_DESER, burst, sizeof(burst)));
+    sub[0] = 0x04;
+    sub[1] = 0x0B;
+    CHECK(!_backend->read(_handle, TEST_DESER, sub, 2, data, 2));
+    CHECK(data[0] == 0x42 && data[1] == 0x2A);
+
+    /* 8 bit sub-addresses by default */
+    CHECK(!_WriteReg(TEST_SERIALIZER, 0x07, 0xF7));
+    sub[0] = 0x07;
+    CHECK(!_backend->read(_handle, TEST_SERIALIZER, sub, 1, data, 1));
+    CHECK(data[0] == 0xF7);
+}
+
+static void
+_TestFaults(void)
+{
+    BosonSimStats before, after;
+    TestResponse response;
+
+    BosonSimGetStats(&before);
+
+    /* NAK fails exactly the requested number of transfers */
+    BosonSimInjectFault(BOSON_SIM_FAULT_NAK, 2);
+    CHECK(_WriteReg(TEST_SERIALIZER, 0x01, 0x04) < 0);
+    CHECK(_WriteReg(TEST_SERIALIZER, 0x01, 0x04) < 0);
+    CHECK(!_WriteReg(TEST_SERIALIZER, 0x01, 0x04));
+
+    /* Corrupt CRC on the response only */
+    BosonSimInjectFault(BOSON_SIM_FAULT_CORRUPT_CRC, 1);
+    _SendCommand(TEST_SERIAL_GET, NULL, 0, NVMEDIA_FALSE);
+    CHECK(_ReadResponse(&response));
+    CHECK(!response.crcValid);
+    _SendCommand(TEST_SERIAL_GET, NULL, 0, NVMEDIA_FALSE);
+    CHECK(_ReadResponse(&response));
+    CHECK(response.crcValid);
+
+    /* Dropped responses are executed but never answered */
+    BosonSimInjectFault(BOSON_SIM_FAULT_DROP_RESPONSE, 1);
+    _SendCommand(TEST_SERIAL_GET, NULL, 0, NVMEDIA_FALSE);
+    CHECK(!_ReadResponse(&response));
+
+    /* A request with a bad CRC is dropped by the camera */
+    _SendCommand(TEST_SERIAL_GET, NULL, 0, NVMEDIA_TRUE);
+    CHECK(!_ReadResponse(&response));
+
+    BosonSimGetStats(&after);
+    CHECK(after.faultsInjected - before.faultsInjected == 4);
+    CHECK(after.responsesDropped - before.responsesDropped == 1);
+    CHECK(after.crcErrors - before.crcErrors == 1);
+    CHECK(after.commandsExecuted - before.commandsExecuted == 3);
+}
+
+int main(void)
+{
+    BosonSimConfig config = {
+        .bosonAddress = TEST_BOSON,
+        .byteTime = 0,
+        .commandLatency = 0,
+    };
+
+    if (BosonSimInit(&config) != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: Failed to start the simulator\n", __func__);
+        return 1;
+    }
+    _backend = BosonSimGetBackend();
+    if (_backend->open(TEST_BUS, &_handle) < 0) {
+        LOG_ERR("%s: Failed to open the simulated bus\n", __func__);
+        BosonSimFini();
+        return 1;
+    }
+
+    _TestCrc();
+    _TestIntAttribute();
+    _TestStringAndVoid();
+    _TestBatch();
+    _TestRegisterWidth();
+    _TestFaults();
+
+    _backend->close(_handle);
+    BosonSimFini();
+
+    LOG_MSG("%u of %u checks passed\n", _numChecks - _numFailed, _numChecks);
+    return _numFailed ? 1 : 0;
+}
@@ -15,8 +15,14 @@
 #include "capture.h"
 #include "os_common.h"
 #include "helpers.h"
-#include "save.h"
+#include "pipeline.h"
 #include "opencvConnector.h"
+#include "i2cBus.h"
+#include "scriptCache.h"
+
+/* Guards mainCtx->ctxs[CAPTURE_ELEMENT] between CaptureFini and the entry
+ * points the command listener calls while the pipeline runs */
+static pthread_mutex_t _captureCtxMutex = PTHREAD_MUTEX_INITIALIZER;
 
 static NvMediaStatus
 _WriteCommandsToFile(FILE *fp,
@@ -32,6 +38,14 @@ _WriteCommandsToFile(FILE *fp,
             case I2C_ERR:
             case SECTION_START:
             case SECTION_STOP:
+            case BOSON_CMD:
+            case BURST_CFG:
+            case WRITE_SPACING:
+            case POLL_REG:
+            case LINK_SEL:
+            case BARRIER:
+            case WARM_SKIP:
+            case LINK_SEL_CFG:
                 /* Do nothing */
                 break;
             case WRITE_REG_1:
@@ -105,36 +119,50 @@ _ReadSensorRegisters(NvCaptureContext *ctx,
     return NVMEDIA_STATUS_OK;
 }
 
+/* Deserializer registers (16 bit addresses) written by the link and pipe
+ * setup: link control and enables, pipe formats, MIPI PHY and controllers */
+static const struct {
+    uint32_t start;
+    uint32_t count;
+} deserDumpRanges[] = {
+    { 0x0000, 0x100 },
+    { 0x0400, 0x020 },
+    { 0x08A0, 0x008 },
+    { 0x0900, 0x100 },
+};
+
+static NvMediaStatus
+_AddDeserRanges(NvCaptureContext *captureCtx,
+                I2cDumpConfig *config)
+{
+    NvMediaStatus status;
+    uint32_t i;
+
+    for (i = 0; i < sizeof(deserDumpRanges) / sizeof(deserDumpRanges[0]); i++) {
+        status = I2cDumpAddRange(config, captureCtx->i2cDeviceNum,
+                                 captureCtx->captureParams.deserAddress.uIntValue,
+                                 2, deserDumpRanges[i].start,
+                                 deserDumpRanges[i].count);
+        if (status != NVMEDIA_STATUS_OK)
+            return status;
+    }
+
+    return NVMEDIA_STATUS_OK;
+}
+
 static NvMediaStatus
 _ReadDeserRegisters(NvCaptureContext *captureCtx)
 {
-    I2cHandle i2cHandle;
-    int i;
-    uint8_t dbg_val[6] = "";
+    I2cDumpConfig deserConfig;
+    NvMediaStatus status;
 
-    if (testutil_i2c_open(captureCtx->i2cDeviceNum,
-                         &i2cHandle) < 0) {
-        printf("%s: i2c_open() failed\n", __func__);
-        return NVMEDIA_STATUS_ERROR;
-    }
+    memset(&deserConfig, 0, sizeof(deserConfig));
+    status = _AddDeserRanges(captureCtx, &deserConfig);
+    if (status != NVMEDIA_STATUS_OK)
+        return status;
 
     printf("\nDeserializer registers:\n-------------------\n");
-    for (i = 0; i < 256; i++)
-    {
-        dbg_val[0] = (uint8_t)i;
-        dbg_val[1] = 0;
-
-        if (testutil_i2c_read_subaddr(i2cHandle,
-                                     captureCtx->captureParams.deserAddress.uIntValue,
-                                     dbg_val, 1, &dbg_val[1], 1) < 0) {
-            printf("DEBUG: testutil_i2c_read_subaddr() failed to \
-                    read register %d\n", i);
-            return NVMEDIA_STATUS_ERROR;
-        }
-        else
-            printf("DEBUG: %d = \t%02X\n", i, dbg_val[1]);
-    }
-    return NVMEDIA_STATUS_OK;
+    return I2cDumpWrite(&deserConfig, stdout);
 }
 
 static NvMediaStatus
@@ -280,6 +308,86 @@ _SetICPSettings(CaptureThreadCtx *ctx,
     return NVMEDIA_STATUS_OK;
 }
 
+/* Restarts capture on this channel only: gives the fed buffers back to
+ * the pool, stops its ICP instance, writes the link bring-up, or the whole
+ * script of a lone channel, again and resumes. The capture loop then feeds the buffers again. */
+static NvMediaStatus
+_RecoverCapture(CaptureThreadCtx *threadCtx,
+                NvMediaICP *icpInst)
+{
+    NvMediaImage *image = NULL;
+    NvMediaStatus status;
+
+    if (threadCtx->state == CAPTURE_STATE_RUNNING) {
+        GetTimeMicroSec(&threadCtx->recoveryStart);
+        threadCtx->failedRecoveries = 0;
+        threadCtx->state = CAPTURE_STATE_RECOVERING;
+    } else if (++threadCtx->failedRecoveries >= CAPTURE_MAX_RECOVERIES) {
+        LOG_ERR("%s: VC %u did not recover after %u restarts\n", __func__,
+                threadCtx->virtualGroupIndex, threadCtx->failedRecoveries);
+        return NVMEDIA_STATUS_ERROR;
+    }
+    LOG_WARN("%s: Restarting capture on VC %u (attempt %u)\n", __func__,
+             threadCtx->virtualGroupIndex, threadCtx->failedRecoveries + 1);
+
+    while (NvMediaICPReleaseFrame(icpInst, &image) == NVMEDIA_STATUS_OK) {
+        if (image && NvQueuePut(IMAGE_POOL(image),
+                                (void *)&image,
+                                0) != NVMEDIA_STATUS_OK) {
+            LOG_ERR("%s: Failed to put image back into input queue\n", __func__);
+            return NVMEDIA_STATUS_ERROR;
+        }
+        image = NULL;
+    }
+    NvMediaICPStop(icpInst);
+
+    /* Only this link's serializer and camera are written, with the link
+     * selected and the bus held. A failed bring-up is retried by the next
+     * restart. */
+    if (threadCtx->bringUpCommands && !threadCtx->formatCommands) {
+        /* Alone on the deserializer, the whole script disturbs nobody */
+        pthread_mutex_lock(threadCtx->recoveryMutex);
+        status = I2cProcessInitialRegisters(threadCtx->bringUpCommands,
+                                            threadCtx->i2cDevice);
+        if (status == NVMEDIA_STATUS_OK) {
+            status = I2cProcessCommands(threadCtx->bringUpCommands,
+                                        I2C_WRITE,
+                                        threadCtx->i2cDevice);
+        }
+        pthread_mutex_unlock(threadCtx->recoveryMutex);
+        if (status != NVMEDIA_STATUS_OK) {
+            LOG_WARN("%s: Bring-up of VC %u failed\n", __func__,
+                     threadCtx->virtualGroupIndex);
+        }
+    } else if (threadCtx->linkCommands || threadCtx->formatCommands) {
+        status = NVMEDIA_STATUS_OK;
+        pthread_mutex_lock(threadCtx->recoveryMutex);
+        if (threadCtx->linkCommands) {
+            status = I2cProcessCommands(threadCtx->linkCommands,
+                                        I2C_WRITE,
+                                        threadCtx->i2cDevice);
+        }
+        if (status == NVMEDIA_STATUS_OK && threadCtx->formatCommands) {
+            status = I2cProcessCommands(threadCtx->formatCommands,
+                                        I2C_WRITE,
+                                        threadCtx->i2cDevice);
+        }
+        pthread_mutex_unlock(threadCtx->recoveryMutex);
+        if (status != NVMEDIA_STATUS_OK) {
+            LOG_WARN("%s: Link bring-up of VC %u failed\n", __func__,
+                     threadCtx->virtualGroupIndex);
+        }
+    }
+
+    status = NvMediaICPResume(icpInst);
+    if (status != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: NvMediaICPResume failed\n", __func__);
+        return status;
+    }
+
+    return NVMEDIA_STATUS_OK;
+}
+
 static uint32_t
 _CaptureThreadFunc(void *data)
 {
@@ -290,10 +398,11 @@ _CaptureThreadFunc(void *data)
     NvMediaStatus status;
     uint64_t tbegin = 0, tend = 0;
     NvMediaICP *icpInst = NULL;
-    uint8_t *imgData;
-    uint8_t *telemetry;
+    ImageFrame *frame = NULL;
     uint32_t retry = 0;
 
+    ThreadSchedApply(threadCtx->sched, "capture", threadCtx->virtualGroupIndex);
+
     for (i = 0; i < threadCtx->icpExCtx->numVirtualGroups; i++) {
         if (threadCtx->icpExCtx->icp[i].virtualGroupId == threadCtx->virtualGroupIndex) {
             icpInst = NVMEDIA_ICP_HANDLER(threadCtx->icpExCtx,i);
@@ -306,9 +415,20 @@ _CaptureThreadFunc(void *data)
         goto done;
     }
 
-    while (!(*threadCtx->quit)) {
+    /* Restarted after a reconfiguration that kept the ICP instance */
+    if (threadCtx->resume) {
+        threadCtx->resume = NVMEDIA_FALSE;
+        if (NvMediaICPResume(icpInst) != NVMEDIA_STATUS_OK) {
+            LOG_ERR("%s: NvMediaICPResume failed\n", __func__);
+            *threadCtx->quit = NVMEDIA_TRUE;
+            goto done;
+        }
+    }
 
-        threadCtx->currentFrame = i;
+    /* Frame numbers carry on across restarts */
+    totalCapturedFrames = lastCapturedFrame = threadCtx->currentFrame;
+
+    while (!(*threadCtx->quit) && !threadCtx->stop) {
 
         /* Feed all images to image capture object from the input Queue */
         while (NvQueueGet(threadCtx->inputQueue,
@@ -320,7 +440,7 @@ _CaptureThreadFunc(void *data)
                                          CAPTURE_FEED_FRAME_TIMEOUT);
             if (status != NVMEDIA_STATUS_OK) {
                 LOG_ERR("%s: %d: NvMediaICPFeedFrame failed\n", __func__, __LINE__);
-                if (NvQueuePut((NvQueue *)feedImage->tag,
+                if (NvQueuePut(IMAGE_POOL(feedImage),
                                (void *)&feedImage,
                                0) != NVMEDIA_STATUS_OK) {
                     LOG_ERR("%s: Failed to put image back into capture input queue", __func__);
@@ -329,7 +449,9 @@ _CaptureThreadFunc(void *data)
                     goto done;
                 }
                 feedImage = NULL;
-                *threadCtx->quit = NVMEDIA_TRUE;
+                if (_RecoverCapture(threadCtx, icpInst) != NVMEDIA_STATUS_OK) {
+                    *threadCtx->quit = NVMEDIA_TRUE;
+                }
                 goto done;
             }
             feedImage = NULL;
@@ -342,12 +464,25 @@ _CaptureThreadFunc(void *data)
         switch (status) {
             case NVMEDIA_STATUS_OK:
                 retry = 0;
+                if (threadCtx->state == CAPTURE_STATE_RECOVERING) {
+                    GetTimeMicroSec(&tend);
+                    threadCtx->recoveries++;
+                    threadCtx->state = CAPTURE_STATE_RUNNING;
+                    LOG_MSG("%s: VC %u recovered in %llu ms after %u restart(s)\n",
+                            __func__, threadCtx->virtualGroupIndex,
+                            (unsigned long long)(tend - threadCtx->recoveryStart) / 1000,
+                            threadCtx->failedRecoveries + 1);
+                }
                 break;
             case NVMEDIA_STATUS_TIMED_OUT:
                 LOG_WARN("%s: NvMediaICPGetFrameEx timed out\n", __func__);
                 if (++retry > CAPTURE_MAX_RETRY) {
                     LOG_ERR("%s: keep failing at NvMediaICPGetFrameEx for %d times\n", __func__, retry);
                     retry=0;
+                    if (_RecoverCapture(threadCtx, icpInst) != NVMEDIA_STATUS_OK) {
+                        *threadCtx->quit = NVMEDIA_TRUE;
+                        goto done;
+                    }
                 }
                 continue;
             case NVMEDIA_STATUS_INSUFFICIENT_BUFFERING:
@@ -357,7 +492,10 @@ _CaptureThreadFunc(void *data)
             case NVMEDIA_STATUS_ERROR:
             default:
                 LOG_ERR("%s: NvMediaICPGetFrameEx failed\n", __func__);
-                *threadCtx->quit = NVMEDIA_TRUE;
+                retry = 0;
+                if (_RecoverCapture(threadCtx, icpInst) != NVMEDIA_STATUS_OK) {
+                    *threadCtx->quit = NVMEDIA_TRUE;
+                }
                 goto done;
         }
 
@@ -367,30 +505,27 @@ _CaptureThreadFunc(void *data)
             correctedWidth /= 2;
         }
 
-        if(!(imgData = malloc(correctedWidth * capturedImage->height * 
-            threadCtx->rawBytesPerPixel * sizeof(uint8_t)))) 
-        {
-            LOG_ERR("%s: Out of memory", __func__);
-            goto done;
-        }
-        if(!(telemetry = malloc(correctedWidth * 
-            threadCtx->rawBytesPerPixel * sizeof(uint8_t)))) 
-        {
-            LOG_ERR("%s: Out of memory", __func__);
+        /* Converted into the buffers travelling with the image */
+        frame = IMAGE_FRAME(capturedImage);
+        if (ImageFrameReserve(frame, correctedWidth, capturedImage->height - 1,
+                              threadCtx->rawBytesPerPixel) != NVMEDIA_STATUS_OK) {
             goto done;
         }
 
-        status = ImageToBytes(capturedImage, imgData, telemetry, 
-            threadCtx->rawBytesPerPixel, threadCtx->multiplex);
+        status = ImageToBytes(capturedImage, frame->pixels, frame->telemetry, 
+            threadCtx->rawBytesPerPixel, threadCtx->multiplex,
+            threadCtx->workPool);
         if(status != NVMEDIA_STATUS_OK) {
             LOG_ERR("%s: Could not convert image to bytes", __func__);
             goto done;
         }
+        /* Once per frame for both the display and the recording */
+        ImageFrameAgc(frame, threadCtx->workPool);
 
-        Opencv_sendFrame(imgData, correctedWidth, 
-            capturedImage->height - 1, threadCtx->rawBytesPerPixel);
-        Opencv_sendTelemetry(telemetry, 
-            correctedWidth * threadCtx->rawBytesPerPixel);
+        Opencv_sendFrame(threadCtx->virtualGroupIndex, frame->pixels,
+            frame->width, frame->height, frame->bytesPerPixel);
+        Opencv_sendTelemetry(threadCtx->virtualGroupIndex, frame->telemetry,
+            frame->width * frame->bytesPerPixel);
 
         // calculate fps
         GetTimeMicroSec(&tend);
@@ -404,20 +539,25 @@ _CaptureThreadFunc(void *data)
                      threadCtx->virtualGroupIndex, threadCtx->fps, td);
         }
 
-        status = NvQueuePut(threadCtx->outputQueue,
-                            (void *)&capturedImage,
-                            CAPTURE_ENQUEUE_TIMEOUT);
+        /* Frames dropped by the queue policy still count as captured */
+        status = PipelinePut(threadCtx->output, &capturedImage);
         if (status != NVMEDIA_STATUS_OK) {
-            LOG_INFO("%s: Failed to put image onto capture output queue", __func__);
+            LOG_ERR("%s: Failed to put image onto capture output queue\n", __func__);
             goto done;
         }
 
         totalCapturedFrames++;
+        threadCtx->currentFrame = totalCapturedFrames;
+
+        /* Hand registers due at this frame to the I2C worker */
+        if (threadCtx->i2cWorker) {
+            I2cWorkerTrigger(threadCtx->i2cWorker, totalCapturedFrames);
+        }
 
         capturedImage = NULL;
 done:
         if (capturedImage) {
-            status = NvQueuePut((NvQueue *)capturedImage->tag,
+            status = NvQueuePut(IMAGE_POOL(capturedImage),
                                 (void *)&capturedImage,
                                 0);
             if (status != NVMEDIA_STATUS_OK) {
@@ -426,26 +566,18 @@ done:
             }
             capturedImage = NULL;
         }
-        if(imgData) {
-            free(imgData);
-            imgData = NULL;
-        }
-        if(telemetry) {
-            free(telemetry);
-            telemetry = NULL;
-        }
         i++;
 
         /* To stop capturing if specified number of frames are captured */
         if (threadCtx->numFramesToCapture &&
-           (totalCapturedFrames == threadCtx->numFramesToCapture))
+           (totalCapturedFrames >= threadCtx->numFramesToCapture))
             break;
     }
 
     /* Release all the frames which are fed */
     while (NvMediaICPReleaseFrame(icpInst, &capturedImage) == NVMEDIA_STATUS_OK) {
         if (capturedImage) {
-            status = NvQueuePut((NvQueue *)capturedImage->tag,
+            status = NvQueuePut(IMAGE_POOL(capturedImage),
                                 (void *)&capturedImage,
                                 0);
             if (status != NVMEDIA_STATUS_OK) {
@@ -457,11 +589,139 @@ done:
     }
     NvMediaICPStop(icpInst);
 
+    if (threadCtx->recoveries) {
+        LOG_MSG("%s: VC %u recovered %u times\n", __func__,
+                threadCtx->virtualGroupIndex, threadCtx->recoveries);
+    }
     LOG_INFO("%s: Capture thread exited\n", __func__);
-    threadCtx->exitedFlag = NVMEDIA_TRUE;
+    ThreadExitNotify(&threadCtx->exited);
     return NVMEDIA_STATUS_OK;
 }
 
+/* Appends the -linkregs scripts, capture settings come from -wrregs. Each
+ * is also kept on its own, under the link select of the main script, to
+ * bring that link up again when its capture is restarted. */
+static NvMediaStatus
+_LoadLinkScripts(NvCaptureContext *captureCtx,
+                 TestArgs *testArgs)
+{
+    I2cCommands scripts[MAX_GMSL_LINKS];
+    CaptureConfigParams params;
+    uint32_t links[MAX_GMSL_LINKS];
+    uint32_t numLinks = 0, link, i;
+    NvMediaStatus status = NVMEDIA_STATUS_OK;
+
+    memset(scripts, 0, sizeof(scripts));
+    for (link = 0; link < MAX_GMSL_LINKS; link++) {
+        if (!testArgs->linkRegs[link].isUsed) {
+            continue;
+        }
+        memset(&params, 0, sizeof(params));
+        status = LoadRegistersFile(testArgs->linkRegs[link].stringValue,
+                                   &params,
+                                   &scripts[numLinks]);
+        if (status != NVMEDIA_STATUS_OK) {
+            LOG_ERR("%s: Failed to parse register file of link %u\n",
+                    __func__, link);
+            goto done;
+        }
+        links[numLinks++] = link;
+    }
+
+    if (!numLinks) {
+        return NVMEDIA_STATUS_OK;
+    }
+
+    /* Settings of the main script only, before the link scripts are in it */
+    for (i = 0; i < numLinks && status == NVMEDIA_STATUS_OK; i++) {
+        status = I2cCopySettings(&captureCtx->linkCommands[links[i]],
+                                 &captureCtx->parsedCommands);
+    }
+    if (status != NVMEDIA_STATUS_OK) {
+        goto done;
+    }
+
+    status = I2cAppendLinkScripts(&captureCtx->parsedCommands,
+                                  scripts, links, numLinks);
+    for (i = 0; i < numLinks && status == NVMEDIA_STATUS_OK; i++) {
+        status = I2cAppendLinkScripts(&captureCtx->linkCommands[links[i]],
+                                      &scripts[i], &links[i], 1);
+    }
+
+done:
+    for (i = 0; i < MAX_GMSL_LINKS; i++) {
+        I2cFreeCommands(&scripts[i]);
+    }
+    return status;
+}
+
+/* Waits for the frames still held by later stages to come back */
+static NvMediaStatus
+_WaitForBuffers(CaptureThreadCtx *threadCtx)
+{
+    uint32_t size = 0, waited = 0;
+
+    while (NvQueueGetSize(threadCtx->inputQueue, &size) == NVMEDIA_STATUS_OK &&
+           size < threadCtx->numBuffers) {
+        if (waited >= CAPTURE_RECONFIG_TIMEOUT) {
+            LOG_ERR("%s: %u of %u buffers of VC %u still in use\n", __func__,
+                    threadCtx->numBuffers - size, threadCtx->numBuffers,
+                    threadCtx->virtualGroupIndex);
+            return NVMEDIA_STATUS_TIMED_OUT;
+        }
+        nvsleep(10000);
+        waited += 10;
+    }
+
+    return NVMEDIA_STATUS_OK;
+}
+
+static NvMediaStatus
+_StartCaptureThread(NvCaptureContext *captureCtx,
+                    uint32_t i)
+{
+    CaptureThreadCtx *threadCtx = &captureCtx->threadCtx[i];
+    NvMediaStatus status;
+
+    threadCtx->stop = NVMEDIA_FALSE;
+    ThreadExitStart(&threadCtx->exited);
+    status = NvThreadCreate(&captureCtx->captureThread[i],
+                            &_CaptureThreadFunc,
+                            (void *)threadCtx,
+                            NV_THREAD_PRIORITY_NORMAL);
+    if (status != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: Failed to create captureThread %d\n", __func__, i);
+        ThreadExitNotify(&threadCtx->exited);
+    }
+
+    return status;
+}
+
+/* Joins one capture thread, which gives its fed buffers back to the pool
+ * and stops its ICP instance on the way out */
+static NvMediaStatus
+_StopCaptureThread(NvCaptureContext *captureCtx,
+                   uint32_t i)
+{
+    CaptureThreadCtx *threadCtx = &captureCtx->threadCtx[i];
+    NvMediaStatus status;
+
+    threadCtx->stop = NVMEDIA_TRUE;
+    if (ThreadExitWait(&threadCtx->exited,
+                       CAPTURE_EXIT_TIMEOUT) != NVMEDIA_STATUS_OK) {
+        LOG_WARN("%s: Capture thread %d did not exit within %d ms\n",
+                 __func__, i, CAPTURE_EXIT_TIMEOUT);
+    }
+    status = NvThreadDestroy(captureCtx->captureThread[i]);
+    if (status != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: Failed to destroy capture thread %d\n", __func__, i);
+    }
+    captureCtx->captureThread[i] = NULL;
+    threadCtx->resume = NVMEDIA_TRUE;
+
+    return status;
+}
+
 NvMediaStatus
 CaptureInit(NvMainContext *mainCtx)
 {
@@ -492,18 +752,48 @@ CaptureInit(NvMainContext *mainCtx)
     captureCtx->inputQueueSize = testArgs->bufferPoolSize;
     captureCtx->useNvRawFormat = NVMEDIA_FALSE;
 
+    for (i = 0; i < captureCtx->numVirtualChannels; i++) {
+        ThreadExitInit(&captureCtx->threadCtx[i].exited);
+    }
+    pthread_mutex_init(&captureCtx->recoveryMutex, NULL);
+    pthread_mutex_init(&captureCtx->reconfigMutex, NULL);
+
     /* Parse registers file */
     if (testArgs->wrregs.isUsed) {
-        status = ParseRegistersFile(testArgs->wrregs.stringValue,
-                                    &captureCtx->captureParams,
-                                    &captureCtx->parsedCommands);
+        status = LoadRegistersFile(testArgs->wrregs.stringValue,
+                                   &captureCtx->captureParams,
+                                   &captureCtx->parsedCommands);
         if (status != NVMEDIA_STATUS_OK) {
             LOG_ERR("%s: Failed to parse register file\n",__func__);
             goto failed;
         }
     }
+
+    status = _LoadLinkScripts(captureCtx, testArgs);
+    if (status != NVMEDIA_STATUS_OK) {
+        goto failed;
+    }
+
+    if (captureCtx->parsedCommands.numCommands) {
+        status = I2cCoalesceWrites(&captureCtx->parsedCommands);
+        if (status != NVMEDIA_STATUS_OK) {
+            LOG_ERR("%s: Failed to optimize register file\n",__func__);
+            goto failed;
+        }
+    }
     captureCtx->i2cDeviceNum = captureCtx->captureParams.i2cDevice.uIntValue;
 
+    /* Registers taken by on-demand dumps, a partial dump is still useful */
+    if (I2cDumpAddScript(&captureCtx->dumpConfig,
+                         &captureCtx->parsedCommands,
+                         captureCtx->i2cDeviceNum) != NVMEDIA_STATUS_OK ||
+        (captureCtx->captureParams.deserAddress.isUsed &&
+         _AddDeserRanges(captureCtx, &captureCtx->dumpConfig) !=
+             NVMEDIA_STATUS_OK)) {
+        LOG_WARN("%s: Register dump limited to %u ranges\n", __func__,
+                 MAX_DUMP_RANGES);
+    }
+
     /* Create NvMedia Device */
     captureCtx->device = NvMediaDeviceCreate();
     if (!captureCtx->device) {
@@ -529,9 +819,10 @@ CaptureInit(NvMainContext *mainCtx)
     for (i = 0; i < captureCtx->icpSettingsEx.numVirtualGroups; i++) {
         captureCtx->icpSettingsEx.virtualGroups[i].numVirtualChannels = 1;
         captureCtx->icpSettingsEx.virtualGroups[i].virtualChannels[0].virtualChannelIndex = i;
+        captureCtx->channelParams[i] = captureCtx->captureParams;
         status = _SetICPSettings(&captureCtx->threadCtx[i],
                                  NVMEDIA_ICP_SETTINGS_HANDLER(captureCtx->icpSettingsEx, i, 0),
-                                 &captureCtx->captureParams,
+                                 &captureCtx->channelParams[i],
                                  captureCtx->interfaceType,
                                  captureCtx->phyMode,
                                  testArgs);
@@ -555,6 +846,33 @@ CaptureInit(NvMainContext *mainCtx)
     /* Delay for 50ms in order to let sensor power on*/
     nvsleep(50000);
 
+    /* A lone channel without a link script is recovered by writing the
+     * whole script again, including what the warm start leaves out */
+    if (captureCtx->numVirtualChannels == 1 &&
+        !captureCtx->linkCommands[testArgs->channelLink[0]].numCommands &&
+        captureCtx->parsedCommands.numCommands) {
+        status = I2cReserveCommands(&captureCtx->bringUpCommands,
+                                    captureCtx->parsedCommands.numCommands);
+        if (status != NVMEDIA_STATUS_OK) {
+            goto failed;
+        }
+        memcpy(captureCtx->bringUpCommands.commands,
+               captureCtx->parsedCommands.commands,
+               captureCtx->parsedCommands.numCommands * sizeof(Command));
+        captureCtx->bringUpCommands.numCommands =
+            captureCtx->parsedCommands.numCommands;
+    }
+
+    /* Leave out what the hardware still holds from a previous run */
+    if (testArgs->warmStart) {
+        status = I2cWarmStart(&captureCtx->parsedCommands,
+                              captureCtx->i2cDeviceNum);
+        if (status != NVMEDIA_STATUS_OK) {
+            LOG_ERR("%s: Failed to compare registers for warm start\n", __func__);
+            goto failed;
+        }
+    }
+
     /* Write pre-requsite registers over i2c */
     status = I2cProcessInitialRegisters(&captureCtx->parsedCommands,
                                         captureCtx->i2cDeviceNum);
@@ -581,25 +899,55 @@ CaptureInit(NvMainContext *mainCtx)
         LOG_ERR("%s: Failed to write to registers over I2C\n", __func__);
         goto failed;
     }
+    I2cPrintTimingStats(&captureCtx->parsedCommands);
+
+    /* Registers to write once a given frame has been captured */
+    status = I2cSetupGroups(&captureCtx->parsedCommands, &captureCtx->groups);
+    if (status != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: Failed to set up register groups\n", __func__);
+        goto failed;
+    }
+    status = I2cWorkerCreate(&captureCtx->i2cWorker,
+                             &captureCtx->parsedCommands,
+                             &captureCtx->groups,
+                             &captureCtx->dumpConfig,
+                             captureCtx->i2cDeviceNum,
+                             &captureCtx->threadCtx[0].currentFrame);
+    if (status != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: Failed to create I2C worker\n", __func__);
+        goto failed;
+    }
+    /* Frames are counted on the first virtual channel */
+    if (captureCtx->groups.numGroups)
+        captureCtx->threadCtx[0].i2cWorker = captureCtx->i2cWorker;
 
     /* Create Input Queues and set data for capture threads */
     for (i = 0; i < captureCtx->numVirtualChannels; i++) {
 
         captureCtx->threadCtx[i].icpExCtx = captureCtx->icpExCtx;
         captureCtx->threadCtx[i].quit = captureCtx->quit;
-        captureCtx->threadCtx[i].exitedFlag = NVMEDIA_TRUE;
         captureCtx->threadCtx[i].virtualGroupIndex = i;
         captureCtx->threadCtx[i].numFramesToCapture = (testArgs->frames.isUsed)?
                                                        testArgs->frames.uIntValue : 0;
         captureCtx->threadCtx[i].width  = NVMEDIA_ICP_SETTINGS_HANDLER(captureCtx->icpSettingsEx, i, 0)->width;
         captureCtx->threadCtx[i].height = NVMEDIA_ICP_SETTINGS_HANDLER(captureCtx->icpSettingsEx, i, 0)->height;
         captureCtx->threadCtx[i].settings = NVMEDIA_ICP_SETTINGS_HANDLER(captureCtx->icpSettingsEx, i, 0);
-        captureCtx->threadCtx[i].numBuffers = captureCtx->inputQueueSize;
+        captureCtx->threadCtx[i].i2cDevice = captureCtx->i2cDeviceNum;
+        captureCtx->threadCtx[i].recoveryMutex = &captureCtx->recoveryMutex;
+        if (captureCtx->linkCommands[testArgs->channelLink[i]].numCommands) {
+            captureCtx->threadCtx[i].linkCommands = &captureCtx->linkCommands[testArgs->channelLink[i]];
+        }
+        if (captureCtx->bringUpCommands.numCommands) {
+            captureCtx->threadCtx[i].bringUpCommands = &captureCtx->bringUpCommands;
+        }
+        captureCtx->threadCtx[i].numBuffers = testArgs->linkBuffers[testArgs->channelLink[i]] ?
+                                              testArgs->linkBuffers[testArgs->channelLink[i]] :
+                                              captureCtx->inputQueueSize;
 
         /* Create inputQueue for storing captured Images */
         status = CreateImageQueue(captureCtx->device,
                                    &captureCtx->threadCtx[i].inputQueue,
-                                   captureCtx->inputQueueSize,
+                                   captureCtx->threadCtx[i].numBuffers,
                                    captureCtx->threadCtx[i].width,
                                    captureCtx->threadCtx[i].height,
                                    captureCtx->threadCtx[i].surfType,
@@ -610,10 +958,11 @@ CaptureInit(NvMainContext *mainCtx)
             goto failed;
         }
 
-        LOG_DBG("%s: Capture Input Queue %d: %ux%u, images: %u \n",
-                __func__, i, captureCtx->threadCtx[i].width,
+        LOG_DBG("%s: Capture Input Queue %d (link %u): %ux%u, images: %u \n",
+                __func__, i, testArgs->channelLink[i],
+                captureCtx->threadCtx[i].width,
                 captureCtx->threadCtx[i].height,
-                captureCtx->inputQueueSize);
+                captureCtx->threadCtx[i].numBuffers);
     }
 
     return NVMEDIA_STATUS_OK;
@@ -623,11 +972,10 @@ failed:
 }
 
 NvMediaStatus
-CaptureFini(NvMainContext *mainCtx)
+CaptureStop(NvMainContext *mainCtx)
 {
     NvCaptureContext *captureCtx = NULL;
-    NvMediaImage *image = NULL;
-    NvMediaStatus status;
+    NvMediaStatus status = NVMEDIA_STATUS_OK;
     uint32_t i = 0;
 
     if (!mainCtx)
@@ -637,41 +985,61 @@ CaptureFini(NvMainContext *mainCtx)
     if (!captureCtx)
         return NVMEDIA_STATUS_OK;
 
-    /* Wait for threads to exit */
-    for (i = 0; i < captureCtx->numVirtualChannels; i++) {
-        if (captureCtx->captureThread[i]) {
-            while (!captureCtx->threadCtx[i].exitedFlag) {
-                LOG_DBG("%s: Waiting for capture thread %d to quit\n",
-                        __func__, i);
-            }
-        }
-    }
-
     *captureCtx->quit = NVMEDIA_TRUE;
 
-    /* Destroy threads */
+    /* A reconfiguration in progress restarts threads, let it finish first */
+    pthread_mutex_lock(&captureCtx->reconfigMutex);
+
+    /* Threads notice quit once the frame they wait for arrives or times out */
     for (i = 0; i < captureCtx->numVirtualChannels; i++) {
-        if (captureCtx->captureThread[i]) {
-            status = NvThreadDestroy(captureCtx->captureThread[i]);
-            if (status != NVMEDIA_STATUS_OK)
-                LOG_ERR("%s: Failed to destroy capture thread %d\n",
-                        __func__, i);
+        if (!captureCtx->captureThread[i])
+            continue;
+        if (ThreadExitWait(&captureCtx->threadCtx[i].exited,
+                           CAPTURE_EXIT_TIMEOUT) != NVMEDIA_STATUS_OK) {
+            LOG_WARN("%s: Capture thread %d did not exit within %d ms\n",
+                     __func__, i, CAPTURE_EXIT_TIMEOUT);
         }
+        status = NvThreadDestroy(captureCtx->captureThread[i]);
+        if (status != NVMEDIA_STATUS_OK)
+            LOG_ERR("%s: Failed to destroy capture thread %d\n",
+                    __func__, i);
+        captureCtx->captureThread[i] = NULL;
     }
+    pthread_mutex_unlock(&captureCtx->reconfigMutex);
+
+    return status;
+}
+
+NvMediaStatus
+CaptureFini(NvMainContext *mainCtx)
+{
+    NvCaptureContext *captureCtx = NULL;
+    NvMediaStatus status;
+    uint32_t i = 0;
+
+    if (!mainCtx)
+        return NVMEDIA_STATUS_OK;
+
+    captureCtx = mainCtx->ctxs[CAPTURE_ELEMENT];
+    if (!captureCtx)
+        return NVMEDIA_STATUS_OK;
+
+    CaptureStop(mainCtx);
+
+    /* Waits for a reconfiguration or dump request still using it */
+    pthread_mutex_lock(&_captureCtxMutex);
+    mainCtx->ctxs[CAPTURE_ELEMENT] = NULL;
+    pthread_mutex_unlock(&_captureCtxMutex);
+
+    I2cWorkerDestroy(captureCtx->i2cWorker);
 
     /* Destroy input queues */
     for (i = 0; i < captureCtx->numVirtualChannels; i++) {
         if (captureCtx->threadCtx[i].inputQueue) {
-            while ((NvQueueGet(captureCtx->threadCtx[i].inputQueue, &image,
-                        0)) == NVMEDIA_STATUS_OK) {
-                if (image) {
-                    NvMediaImageDestroy(image);
-                    image = NULL;
-                }
-            }
             LOG_DBG("%s: Destroying capture input queue %d \n", __func__, i);
-            NvQueueDestroy(captureCtx->threadCtx[i].inputQueue);
+            DestroyImageQueue(captureCtx->threadCtx[i].inputQueue);
         }
+        ThreadExitDestroy(&captureCtx->threadCtx[i].exited);
     }
 
     /* Read Sensor Registers */
@@ -697,6 +1065,18 @@ CaptureFini(NvMainContext *mainCtx)
     if (captureCtx->device)
         NvMediaDeviceDestroy(captureCtx->device);
 
+    I2cFreeCommands(&captureCtx->parsedCommands);
+    I2cFreeCommands(&captureCtx->bringUpCommands);
+    I2cFreeCommands(&captureCtx->settingsCommands);
+    for (i = 0; i < MAX_GMSL_LINKS; i++) {
+        I2cFreeCommands(&captureCtx->linkCommands[i]);
+    }
+    for (i = 0; i < NVMEDIA_ICP_MAX_VIRTUAL_GROUPS; i++) {
+        I2cFreeCommands(&captureCtx->formatCommands[i]);
+    }
+    pthread_mutex_destroy(&captureCtx->recoveryMutex);
+    pthread_mutex_destroy(&captureCtx->reconfigMutex);
+
     if (captureCtx)
         free(captureCtx);
 
@@ -705,6 +1085,319 @@ CaptureFini(NvMainContext *mainCtx)
     return NVMEDIA_STATUS_OK;
 }
 
+NvMediaStatus
+CaptureDumpRegisters(NvMainContext *mainCtx,
+                     const char *fileName)
+{
+    NvCaptureContext *captureCtx;
+    NvMediaStatus status;
+
+    if (!mainCtx || !fileName)
+        return NVMEDIA_STATUS_BAD_PARAMETER;
+
+    pthread_mutex_lock(&_captureCtxMutex);
+    captureCtx = mainCtx->ctxs[CAPTURE_ELEMENT];
+    if (!captureCtx || !captureCtx->i2cWorker) {
+        LOG_ERR("%s: Capture is not running\n", __func__);
+        status = NVMEDIA_STATUS_ERROR;
+    } else {
+        status = I2cWorkerDump(captureCtx->i2cWorker, fileName);
+    }
+    pthread_mutex_unlock(&_captureCtxMutex);
+
+    return status;
+}
+
+/* Camera commands of a reconfiguration script, under the channel's link
+ * select when the main script addresses links one at a time */
+static NvMediaStatus
+_BuildChannelFragment(NvCaptureContext *captureCtx,
+                      uint32_t virtualChannel,
+                      I2cCommands *commands,
+                      uint32_t sensorAddress,
+                      I2cCommands *fragment)
+{
+    I2cCommands camera;
+    uint32_t link = captureCtx->testArgs->channelLink[virtualChannel];
+    NvMediaStatus status;
+
+    status = I2cCopySettings(fragment, &captureCtx->parsedCommands);
+    if (status == NVMEDIA_STATUS_OK) {
+        status = I2cCopySettings(fragment, commands);
+    }
+    if (status != NVMEDIA_STATUS_OK) {
+        return status;
+    }
+    if (!I2cFindLinkSelect(fragment)) {
+        return I2cAppendDevice(fragment, commands, sensorAddress);
+    }
+
+    memset(&camera, 0, sizeof(camera));
+    status = I2cAppendDevice(&camera, commands, sensorAddress);
+    if (status == NVMEDIA_STATUS_OK) {
+        status = I2cAppendLinkScripts(fragment, &camera, &link, 1);
+    }
+    I2cFreeCommands(&camera);
+    return status;
+}
+
+static NvMediaBool
+_OtherChannelsRunning(NvCaptureContext *captureCtx,
+                      uint32_t virtualChannel)
+{
+    uint32_t i;
+
+    for (i = 0; i < captureCtx->numVirtualChannels; i++) {
+        if (i != virtualChannel && captureCtx->captureThread[i]) {
+            return NVMEDIA_TRUE;
+        }
+    }
+    return NVMEDIA_FALSE;
+}
+
+static void
+_LogSharedRegisters(I2cCommands *shared,
+                    const char *fileName)
+{
+    NvMediaBool wide;
+    uint32_t i;
+    Command *cmd;
+
+    for (i = 0; i < shared->numCommands; i++) {
+        cmd = &shared->commands[i];
+        if (cmd->commandType == I2C_DEVICE) {
+            continue;
+        }
+        wide = cmd->commandType == WRITE_REG_2;
+        LOG_ERR("%s: %s changes register %0*x of %02x, shared with the other channels\n",
+                __func__, fileName, wide ? 4 : 2,
+                wide ? (cmd->buffer[0] << 8) | cmd->buffer[1] : cmd->buffer[0],
+                cmd->deviceAddress << 1);
+    }
+}
+
+static NvMediaStatus
+_Reconfigure(NvCaptureContext *captureCtx,
+             uint32_t virtualChannel,
+             const char *fileName)
+{
+    CaptureThreadCtx *threadCtx;
+    CaptureThreadCtx newCtx;
+    CaptureConfigParams script, params;
+    NvMediaICPSettings *settings;
+    NvMediaICPSettings oldSettings, newSettings;
+    I2cCommands commands, fragment, shared;
+    NvQueue *newQueue = NULL;
+    NvMediaBool restartIcp;
+    NvMediaStatus status, threadStatus;
+    uint64_t tbegin = 0, tend = 0;
+    uint32_t stopped = 0;
+    uint32_t i;
+
+    if (virtualChannel >= captureCtx->numVirtualChannels) {
+        LOG_ERR("%s: No capture running on VC %u\n", __func__, virtualChannel);
+        return NVMEDIA_STATUS_BAD_PARAMETER;
+    }
+    threadCtx = &captureCtx->threadCtx[virtualChannel];
+    settings = threadCtx->settings;
+
+    memset(&script, 0, sizeof(script));
+    memset(&commands, 0, sizeof(commands));
+    memset(&fragment, 0, sizeof(fragment));
+    memset(&shared, 0, sizeof(shared));
+    status = LoadRegistersFile((char *)fileName, &script, &commands);
+    if (status != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: Failed to parse register file %s\n", __func__, fileName);
+        goto done;
+    }
+
+    /* Only the channel's camera is configured again, the deserializer and
+     * serializers the script also sets up are checked below */
+    status = _BuildChannelFragment(captureCtx, virtualChannel, &commands,
+                                   script.sensorAddress.uIntValue, &fragment);
+    if (status != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: Failed to extract the camera commands of %s\n", __func__,
+                fileName);
+        goto done;
+    }
+
+    /* Interface, lanes and bus are shared by all channels and stay */
+    params = captureCtx->channelParams[virtualChannel];
+    params.inputFormat = script.inputFormat;
+    params.resolution = script.resolution;
+    params.pixelOrder = script.pixelOrder;
+    params.emb = script.emb;
+    params.multiplex = script.multiplex;
+
+    newCtx = *threadCtx;
+    newSettings = oldSettings = *settings;
+    status = _SetICPSettings(&newCtx,
+                             &newSettings,
+                             &params,
+                             captureCtx->interfaceType,
+                             captureCtx->phyMode,
+                             captureCtx->testArgs);
+    if (status != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: Invalid capture settings in %s\n", __func__, fileName);
+        goto done;
+    }
+
+    /* The ICP instances of all channels are created together, a new
+     * format briefly stops the other channels to create them again */
+    restartIcp = memcmp(&newSettings, &oldSettings, sizeof(newSettings)) ?
+                 NVMEDIA_TRUE : NVMEDIA_FALSE;
+
+    pthread_mutex_lock(&captureCtx->reconfigMutex);
+    if (*captureCtx->quit) {
+        status = NVMEDIA_STATUS_ERROR;
+        goto unlock;
+    }
+    GetTimeMicroSec(&tbegin);
+
+    /* The deserializer and serializers carry every channel, only their
+     * final values are compared and they may only change when no other
+     * channel runs. Repeated sequences and delays are never written again. */
+    status = I2cChangedRegisters(&commands, captureCtx->i2cDeviceNum,
+                                 script.sensorAddress.uIntValue, &shared);
+    if (status != NVMEDIA_STATUS_OK) {
+        goto unlock;
+    }
+    if (shared.numCommands && _OtherChannelsRunning(captureCtx, virtualChannel)) {
+        _LogSharedRegisters(&shared, fileName);
+        status = NVMEDIA_STATUS_ERROR;
+        goto unlock;
+    }
+
+    for (i = 0; i < captureCtx->numVirtualChannels; i++) {
+        if ((restartIcp || i == virtualChannel) && captureCtx->captureThread[i]) {
+            _StopCaptureThread(captureCtx, i);
+            stopped |= 1 << i;
+        }
+    }
+
+    if (restartIcp) {
+        status = _WaitForBuffers(threadCtx);
+        if (status != NVMEDIA_STATUS_OK) {
+            goto restart;
+        }
+
+        /* Allocated before the old pool goes so a failure keeps it */
+        status = CreateImageQueue(captureCtx->device,
+                                  &newQueue,
+                                  threadCtx->numBuffers,
+                                  newSettings.width,
+                                  newSettings.height,
+                                  newCtx.surfType,
+                                  newCtx.surfAllocAttrs,
+                                  newCtx.numSurfAllocAttrs);
+        if (status != NVMEDIA_STATUS_OK) {
+            LOG_ERR("%s: Failed to allocate buffers for VC %u\n", __func__,
+                    virtualChannel);
+            goto restart;
+        }
+
+        NvMediaICPDestroyEx(captureCtx->icpExCtx);
+        *settings = newSettings;
+        captureCtx->icpExCtx = NvMediaICPCreateEx(&captureCtx->icpSettingsEx);
+        if (!captureCtx->icpExCtx) {
+            LOG_ERR("%s: NvMediaICPCreateEx failed with the new settings\n", __func__);
+            status = NVMEDIA_STATUS_ERROR;
+            DestroyImageQueue(newQueue);
+            *settings = oldSettings;
+            captureCtx->icpExCtx = NvMediaICPCreateEx(&captureCtx->icpSettingsEx);
+            if (!captureCtx->icpExCtx) {
+                LOG_ERR("%s: Capture cannot be restarted\n", __func__);
+                *captureCtx->quit = NVMEDIA_TRUE;
+                goto unlock;
+            }
+        }
+        for (i = 0; i < captureCtx->numVirtualChannels; i++) {
+            captureCtx->threadCtx[i].icpExCtx = captureCtx->icpExCtx;
+            captureCtx->threadCtx[i].resume = NVMEDIA_FALSE;
+        }
+        if (status != NVMEDIA_STATUS_OK) {
+            goto restart;
+        }
+
+        DestroyImageQueue(threadCtx->inputQueue);
+        threadCtx->inputQueue = newQueue;
+        threadCtx->width = newSettings.width;
+        threadCtx->height = newSettings.height;
+        threadCtx->inputFormat = newCtx.inputFormat;
+        threadCtx->surfType = newCtx.surfType;
+        threadCtx->rawBytesPerPixel = newCtx.rawBytesPerPixel;
+        threadCtx->pixelOrder = newCtx.pixelOrder;
+        threadCtx->multiplex = newCtx.multiplex;
+        memcpy(threadCtx->surfAllocAttrs, newCtx.surfAllocAttrs,
+               sizeof(threadCtx->surfAllocAttrs));
+        threadCtx->numSurfAllocAttrs = newCtx.numSurfAllocAttrs;
+    }
+    captureCtx->channelParams[virtualChannel] = params;
+
+    /* The camera fragment is kept so a capture restart writes it again */
+    pthread_mutex_lock(&captureCtx->recoveryMutex);
+    status = I2cProcessCommands(&shared, I2C_WRITE, captureCtx->i2cDeviceNum);
+    if (status == NVMEDIA_STATUS_OK) {
+        status = I2cProcessCommands(&fragment, I2C_WRITE, captureCtx->i2cDeviceNum);
+    }
+    I2cFreeCommands(&captureCtx->formatCommands[virtualChannel]);
+    captureCtx->formatCommands[virtualChannel] = fragment;
+    threadCtx->formatCommands = &captureCtx->formatCommands[virtualChannel];
+    pthread_mutex_unlock(&captureCtx->recoveryMutex);
+    memset(&fragment, 0, sizeof(fragment));
+    if (status != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: Failed to write registers of %s\n", __func__, fileName);
+    }
+
+restart:
+    for (i = 0; i < captureCtx->numVirtualChannels; i++) {
+        if (stopped & (1 << i)) {
+            threadStatus = _StartCaptureThread(captureCtx, i);
+            if (threadStatus != NVMEDIA_STATUS_OK) {
+                status = threadStatus;
+            }
+        }
+    }
+    if (status == NVMEDIA_STATUS_OK) {
+        GetTimeMicroSec(&tend);
+        LOG_MSG("%s: VC %u reconfigured from %s in %llu ms\n", __func__,
+                virtualChannel, fileName,
+                (unsigned long long)(tend - tbegin) / 1000);
+    }
+
+unlock:
+    pthread_mutex_unlock(&captureCtx->reconfigMutex);
+done:
+    I2cFreeCommands(&commands);
+    I2cFreeCommands(&fragment);
+    I2cFreeCommands(&shared);
+    return status;
+}
+
+NvMediaStatus
+CaptureReconfigure(NvMainContext *mainCtx,
+                   uint32_t virtualChannel,
+                   const char *fileName)
+{
+    NvCaptureContext *captureCtx;
+    NvMediaStatus status;
+
+    if (!mainCtx || !fileName)
+        return NVMEDIA_STATUS_BAD_PARAMETER;
+
+    pthread_mutex_lock(&_captureCtxMutex);
+    captureCtx = mainCtx->ctxs[CAPTURE_ELEMENT];
+    if (!captureCtx) {
+        LOG_ERR("%s: Capture is not running\n", __func__);
+        status = NVMEDIA_STATUS_ERROR;
+    } else {
+        status = _Reconfigure(captureCtx, virtualChannel, fileName);
+    }
+    pthread_mutex_unlock(&_captureCtxMutex);
+
+    return status;
+}
+
 NvMediaStatus
 CaptureProc(NvMainContext *mainCtx)
 {
@@ -717,28 +1410,20 @@ CaptureProc(NvMainContext *mainCtx)
     }
 
     NvCaptureContext *captureCtx = mainCtx->ctxs[CAPTURE_ELEMENT];
-    NvSaveContext *saveCtx = mainCtx->ctxs[SAVE_ELEMENT];
 
     /* Setting the queues */
     for (i = 0; i < captureCtx->numVirtualChannels; ++i) {
         CaptureThreadCtx *threadCtx = &captureCtx->threadCtx[i];
         if (threadCtx) {
-            threadCtx->outputQueue = saveCtx->threadCtx[i].inputQueue;
-            saveCtx->threadCtx[i].fps = &threadCtx->fps;
+            threadCtx->output = PipelineOutput(mainCtx, CAPTURE_ELEMENT, i);
+            threadCtx->workPool = mainCtx->workPool;
+            threadCtx->sched = PipelineThreadSched(mainCtx, CAPTURE_ELEMENT, i);
 
             // set initial fps to reasonable value
             threadCtx->fps = 30;
 
-            /* Create capture threads */
-            threadCtx->exitedFlag = NVMEDIA_FALSE;
-            status = NvThreadCreate(&captureCtx->captureThread[i],
-                                    &_CaptureThreadFunc,
-                                    (void *)threadCtx,
-                                    NV_THREAD_PRIORITY_NORMAL);
+            status = _StartCaptureThread(captureCtx, i);
             if (status != NVMEDIA_STATUS_OK) {
-                LOG_ERR("%s: Failed to create captureThread %d\n",
-                        __func__, i);
-                threadCtx->exitedFlag = NVMEDIA_TRUE;
                 return status;
             }
         }
@@ -23,30 +23,43 @@ extern "C" {
 #include "cmdline.h"
 #include "thread_utils.h"
 #include "parser.h"
+#include "i2cWorker.h"
+#include "i2cDump.h"
+#include "threadExit.h"
 #include "nvmedia_isc.h"
 #include "nvmedia_icp.h"
 #include "nvmedia_surface.h"
 
 #define CAPTURE_INPUT_QUEUE_SIZE             5     /* min no. of buffers needed to capture without any frame drops */
 #define CAPTURE_DEQUEUE_TIMEOUT              1000
-#define CAPTURE_ENQUEUE_TIMEOUT              100
 #define CAPTURE_FEED_FRAME_TIMEOUT           100
 #define CAPTURE_GET_FRAME_TIMEOUT            500
 #define CAPTURE_MAX_RETRY                    10
+#define CAPTURE_MAX_RECOVERIES               5     /* restarts in a row without a frame before giving up */
+#define CAPTURE_EXIT_TIMEOUT                 1000
+#define CAPTURE_RECONFIG_TIMEOUT             2000  /* ms for frames in flight to come back */
+
+typedef enum {
+    CAPTURE_STATE_RUNNING = 0,
+    CAPTURE_STATE_RECOVERING,                       // restarted, no frame yet
+} CaptureState;
 
 typedef struct {
     NvMediaICPEx               *icpExCtx;
     NvQueue                    *inputQueue;
-    NvQueue                    *outputQueue;
+    PipelineLink               *output;         // to the next stage
     volatile NvMediaBool       *quit;
-    NvMediaBool                 exitedFlag;
+    volatile NvMediaBool        stop;           // leave the loop, capture keeps its state
+    NvMediaBool                 resume;         // ICP was stopped by the previous run
+    ThreadExit                  exited;
+    const ThreadSched          *sched;          // applied by the thread
     NvMediaICPSettings         *settings;
 
     /* capture params */
     uint32_t                    width;
     uint32_t                    height;
     uint32_t                    virtualGroupIndex;
-    uint32_t                    currentFrame;
+    volatile uint32_t           currentFrame;       // frames captured so far
     uint32_t                    numFramesToCapture;
     uint32_t                    numBuffers;
 
@@ -61,6 +74,22 @@ typedef struct {
     uint32_t                    fps;
     uint8_t                     multiplex;
 
+    WorkPool                   *workPool;           // shared, NULL to work inline
+
+    /* posts frame-triggered register groups, NULL if not this channel */
+    I2cWorker                  *i2cWorker;
+
+    /* recovery from capture stalls and errors */
+    CaptureState                state;
+    I2cCommands                *linkCommands;       // link bring-up under its link select, NULL if none
+    I2cCommands                *formatCommands;     // camera of the last reconfiguration, written after it
+    I2cCommands                *bringUpCommands;    // whole -wrregs script of a lone channel, NULL if none
+    uint32_t                    i2cDevice;
+    pthread_mutex_t            *recoveryMutex;      // against reconfiguration, the bus has its own lock
+    uint32_t                    recoveries;
+    uint32_t                    failedRecoveries;   // restarts since the last frame
+    uint64_t                    recoveryStart;      // us
+
 } CaptureThreadCtx;
 
 typedef struct {
@@ -81,7 +110,16 @@ typedef struct {
     uint32_t                    i2cDeviceNum;
     uint32_t                    inputQueueSize;
     I2cCommands                 parsedCommands;
+    I2cCommands                 bringUpCommands;    // parsedCommands before the warm start
     I2cCommands                 settingsCommands;
+    I2cGroups                   groups;
+    I2cWorker                  *i2cWorker;
+    I2cDumpConfig               dumpConfig;
+    I2cCommands                 linkCommands[MAX_GMSL_LINKS];
+    pthread_mutex_t             recoveryMutex;
+    CaptureConfigParams         channelParams[NVMEDIA_ICP_MAX_VIRTUAL_GROUPS];
+    I2cCommands                 formatCommands[NVMEDIA_ICP_MAX_VIRTUAL_GROUPS];
+    pthread_mutex_t             reconfigMutex;      // one reconfiguration at a time
     NvMediaICPInterfaceType     interfaceType;
     NvMediaICPCsiPhyMode        phyMode;
     NvMediaBool                 useNvRawFormat;
@@ -90,12 +128,33 @@ typedef struct {
 NvMediaStatus
 CaptureInit(NvMainContext *mainCtx);
 
+/* Stops and joins the capture threads, CaptureFini does it if needed */
+NvMediaStatus
+CaptureStop(NvMainContext *mainCtx);
+
 NvMediaStatus
 CaptureFini(NvMainContext *mainCtx);
 
 NvMediaStatus
 CaptureProc(NvMainContext *mainCtx);
 
+/* Switches one channel to the capture settings of another script while the
+ * other channels keep running. The script's input format, multiplex,
+ * resolution, pixel order and embedded lines replace the channel's, its
+ * buffer pool is reallocated and the script's camera commands are written
+ * under the channel's link select. Fails if the script changes deserializer
+ * or serializer registers while other channels run. Blocks until the
+ * channel captures again or the change failed. */
+NvMediaStatus
+CaptureReconfigure(NvMainContext *mainCtx,
+                   uint32_t virtualChannel,
+                   const char *fileName);
+
+/* Queues a register snapshot on the I2C worker, capture keeps running */
+NvMediaStatus
+CaptureDumpRegisters(NvMainContext *mainCtx,
+                     const char *fileName);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,121 @@
+/* NVIDIA CORPORATION gave permission to FLIR Systems, Inc to modify this code
+  * and distribute it as part of the ADAS GMSL Kit.
+  * http://www.flir.com/
+  * October-2019
+*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "cmdQueue.h"
+#include "log_utils.h"
+
+NvMediaStatus
+CmdQueueCreate(CmdQueue **queue)
+{
+    CmdQueue *q;
+
+    if (!queue) {
+        return NVMEDIA_STATUS_BAD_PARAMETER;
+    }
+
+    q = calloc(1, sizeof(CmdQueue));
+    if (!q) {
+        LOG_ERR("%s: Out of memory\n", __func__);
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+    pthread_mutex_init(&q->mutex, NULL);
+    pthread_cond_init(&q->cond, NULL);
+
+    *queue = q;
+    return NVMEDIA_STATUS_OK;
+}
+
+void
+CmdQueueDestroy(CmdQueue *queue)
+{
+    if (!queue) {
+        return;
+    }
+
+    pthread_cond_destroy(&queue->cond);
+    pthread_mutex_destroy(&queue->mutex);
+    free(queue);
+}
+
+NvMediaStatus
+CmdQueuePut(CmdQueue *queue,
+            const char *command)
+{
+    NvMediaStatus status = NVMEDIA_STATUS_OK;
+    char *slot;
+
+    if (!queue || !command) {
+        return NVMEDIA_STATUS_BAD_PARAMETER;
+    }
+
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->closed || queue->count == CMD_QUEUE_SIZE) {
+        status = NVMEDIA_STATUS_ERROR;
+    } else {
+        slot = queue->commands[(queue->head + queue->count) % CMD_QUEUE_SIZE];
+        strncpy(slot, command, MAX_STRING_SIZE - 1);
+        slot[MAX_STRING_SIZE - 1] = '\0';
+        queue->count++;
+        pthread_cond_signal(&queue->cond);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+
+    return status;
+}
+
+NvMediaStatus
+CmdQueueGet(CmdQueue *queue,
+            char *command,
+            uint32_t size)
+{
+    NvMediaStatus status = NVMEDIA_STATUS_ERROR;
+
+    if (!queue || !command || !size) {
+        return NVMEDIA_STATUS_BAD_PARAMETER;
+    }
+
+    pthread_mutex_lock(&queue->mutex);
+    while (!queue->count && !queue->closed) {
+        pthread_cond_wait(&queue->cond, &queue->mutex);
+    }
+    if (queue->count) {
+        strncpy(command, queue->commands[queue->head], size - 1);
+        command[size - 1] = '\0';
+        queue->head = (queue->head + 1) % CMD_QUEUE_SIZE;
+        queue->count--;
+        status = NVMEDIA_STATUS_OK;
+    }
+    pthread_mutex_unlock(&queue->mutex);
+
+    return status;
+}
+
+void
+CmdQueueClose(CmdQueue *queue)
+{
+    if (!queue) {
+        return;
+    }
+
+    pthread_mutex_lock(&queue->mutex);
+    queue->closed = NVMEDIA_TRUE;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+void
+CmdQueueOpen(CmdQueue *queue)
+{
+    if (!queue) {
+        return;
+    }
+
+    pthread_mutex_lock(&queue->mutex);
+    queue->closed = NVMEDIA_FALSE;
+    pthread_mutex_unlock(&queue->mutex);
+}
@@ -0,0 +1,64 @@
+/* NVIDIA CORPORATION gave permission to FLIR Systems, Inc to modify this code
+  * and distribute it as part of the ADAS GMSL Kit.
+  * http://www.flir.com/
+  * October-2019
+*/
+#ifndef __CMD_QUEUE_H__
+#define __CMD_QUEUE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "nvmedia_core.h"
+#include "cmdline.h"
+
+/* Terminal commands read by Run and handed to the command listener. Each
+ * command is copied whole into the queue, and a receiver sleeps until a
+ * command arrives or the queue is closed. */
+
+#define CMD_QUEUE_SIZE              16
+
+typedef struct {
+    pthread_mutex_t             mutex;
+    pthread_cond_t              cond;
+    char                        commands[CMD_QUEUE_SIZE][MAX_STRING_SIZE];
+    uint32_t                    head;
+    uint32_t                    count;
+    NvMediaBool                 closed;
+} CmdQueue;
+
+NvMediaStatus
+CmdQueueCreate(CmdQueue **queue);
+
+void
+CmdQueueDestroy(CmdQueue *queue);
+
+/* Fails without blocking when the queue is full or closed */
+NvMediaStatus
+CmdQueuePut(CmdQueue *queue,
+            const char *command);
+
+/* Blocks until a command is queued. Returns NVMEDIA_STATUS_ERROR once the
+ * queue is closed and empty. */
+NvMediaStatus
+CmdQueueGet(CmdQueue *queue,
+            char *command,
+            uint32_t size);
+
+/* Wakes every receiver; commands still queued can be received */
+void
+CmdQueueClose(CmdQueue *queue);
+
+/* Accepts commands again after CmdQueueClose */
+void
+CmdQueueOpen(CmdQueue *queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -19,6 +19,7 @@
 
 #include "log_utils.h"
 #include "cmdline.h"
+#include "workPool.h"
 
 static void
 PrintUsage(void)
@@ -46,9 +47,42 @@ PrintUsage(void)
     LOG_MSG("                  Default: %d Maximum: %d\n",MIN_BUFFER_POOL_SIZE,NVMEDIA_MAX_CAPTURE_FRAME_BUFFERS);
     LOG_MSG("-wrregs [file]    File name of register script to write to sensor\n");
     LOG_MSG("-rdregs [file]    File name of register dump from sensor\n");
+    LOG_MSG("-aggregate [n]    Capture from GMSL links 0 to n-1. Maximum: %d\n", MAX_GMSL_LINKS);
+    LOG_MSG("-cam_enable [mask]  Capture from the links set in the hex mask, a nibble per link,\n");
+    LOG_MSG("                  e.g. 0x1011 for links 0, 1 and 3. Default: 0x%04x\n", CAM_ENABLE_DEFAULT);
+    LOG_MSG("-linkregs [n] [file]  Register script written to link n after -wrregs,\n");
+    LOG_MSG("                  links on one I2C bus are written one after the other\n");
+    LOG_MSG("-linkbuffers [n] [count]  Buffer pool size of link n. Default: -b\n");
+    LOG_MSG("-i2ctrace [file]  Record all I2C transactions and write them to file on exit\n");
+    LOG_MSG("-i2csim           Send I2C traffic to an in-process Boson simulator\n");
+    LOG_MSG("-warm             Only write registers whose value differs from the script\n");
+    LOG_MSG("--pipeline [stages]  Comma separated stages with optional input queue depth\n");
+    LOG_MSG("                  and full queue policy (block, drop or latest),\n");
+    LOG_MSG("                  e.g. capture,save:3 for headless use\n");
+    LOG_MSG("                  Stages: capture, save, display. Default: capture,save,display\n");
+    LOG_MSG("--display-fps [n] Refresh the display n times per second, skipping the frames\n");
+    LOG_MSG("                  in between. Default: every new frame. Maximum: %d\n", MAX_DISPLAY_FPS);
+    LOG_MSG("--workers [n]     Share n worker threads between all channels for pixel work,\n");
+    LOG_MSG("                  large frames are split in row tiles. Maximum: %d\n", WORK_POOL_MAX_WORKERS);
+    LOG_MSG("--sched [list]    Pin stage threads and set SCHED_FIFO priorities,\n");
+    LOG_MSG("                  stage[.channel]=cpus[:priority],... e.g. capture=2:80,save=3-4\n");
     LOG_MSG("\nValid Script File Commands:\n");
     LOG_MSG("; Delay [n](ms|us)         Delay between register writes in ms/us\n");
     LOG_MSG("; I2C [channel]            Open I2C channel for writing registers\n");
+    LOG_MSG("; Link [n]|all             Address only GMSL link n with the following registers, or all links again\n");
+    LOG_MSG("; Link select [dev] [reg] [all] [link0] ...  Deserializer register and values addressing\n");
+    LOG_MSG("                           all links or one link, needed by ; Link and -linkregs\n");
+    LOG_MSG("; Barrier                  Wait for all I2C channels before continuing\n");
+    LOG_MSG("; Boson [dev] [cmd] [val]  Send a Boson command, consecutive commands share one spooling window\n");
+    LOG_MSG("; Burst on|off [dev] [reg]  Allow merging repeated writes to a device (or one register, or\n");
+    LOG_MSG("                           all devices without dev) into bursts, off by default\n");
+    LOG_MSG("; Write spacing [dev] [n](ms|us)  Minimum time between writes to a device (default 5us)\n");
+    LOG_MSG("; Poll [dev] [reg] [val] [mask] [n](ms|us)  Read a register until (reg & mask) == val, fail after n ms/us\n");
+    LOG_MSG("                           (only warn after ; I2C Err off)\n");
+    LOG_MSG("; Warm skip [dev]          Always write a device that cannot be read back on -warm,\n");
+    LOG_MSG("                           also left out of register dumps\n");
+    LOG_MSG("; Set [name] [value]      Defines a variable, ${name} is replaced by value in later lines\n");
+    LOG_MSG("; Include [file]          Inserts another script, relative to the including one\n");
     LOG_MSG("; Wait for frame [i]       Waits for frame i to be captured before writing subsequent registers\n");
     LOG_MSG("; End frame [i] registers  Marks the end of registers to write after frame i has been captured\n");
     LOG_MSG("                           Mandatory if Wait for frame has been used\n");
@@ -70,12 +104,16 @@ ParseArgs(int argc,
     NvMediaBool foundArg = NVMEDIA_FALSE;
     NvMediaStatus status;
     NvMediaBool bHelpArg = NVMEDIA_FALSE;
+    NvMediaBool aggregateUsed = NVMEDIA_FALSE;
+    uint32_t link = 0;
+    char *end = NULL;
 
     // Default parameters
     allArgs->numSensors = 1;
     allArgs->numLinks = 0;
     allArgs->numVirtualChannels = 1;
     allArgs->bufferPoolSize = MIN_BUFFER_POOL_SIZE;
+    allArgs->camEnable = CAM_ENABLE_DEFAULT;
 
     if (argc < 2) {
         PrintUsage();
@@ -143,6 +181,18 @@ ParseArgs(int argc,
                     LOG_ERR("-rdregs must be followed by registers script file name\n");
                     return NVMEDIA_STATUS_ERROR;
                 }
+            } else if (!strcasecmp(argv[i], "-i2ctrace")) {
+                if (argv[i + 1] && argv[i + 1][0] != '-') {
+                    allArgs->i2cTrace.isUsed = NVMEDIA_TRUE;
+                    strncpy(allArgs->i2cTrace.stringValue, argv[++i], MAX_STRING_SIZE);
+                } else {
+                    LOG_ERR("-i2ctrace must be followed by the trace output file name\n");
+                    return NVMEDIA_STATUS_ERROR;
+                }
+            } else if (!strcasecmp(argv[i], "-i2csim")) {
+                allArgs->i2cSim = NVMEDIA_TRUE;
+            } else if (!strcasecmp(argv[i], "-warm")) {
+                allArgs->warmStart = NVMEDIA_TRUE;
             } else if (!strcasecmp(argv[i], "-f")) {
                 allArgs->useFilePrefix = NVMEDIA_TRUE;
                 if (argv[i + 1] && argv[i + 1][0] != '-') {
@@ -169,6 +219,51 @@ ParseArgs(int argc,
                     }
                 }
                 allArgs->displayEnabled = NVMEDIA_TRUE;
+            } else if (!strcasecmp(argv[i], "-aggregate")) {
+                if (bDataAvailable) {
+                    aggregateUsed = NVMEDIA_TRUE;
+                    if (sscanf(argv[++i], "%u", &allArgs->numSensors) != 1 ||
+                        !allArgs->numSensors || allArgs->numSensors > MAX_GMSL_LINKS) {
+                        LOG_ERR("Bad number of links: %s\n", argv[i]);
+                        return NVMEDIA_STATUS_ERROR;
+                    }
+                } else {
+                    LOG_ERR("-aggregate must be followed by the number of links\n");
+                    return NVMEDIA_STATUS_ERROR;
+                }
+            } else if (!strcasecmp(argv[i], "-cam_enable")) {
+                if (bDataAvailable) {
+                    allArgs->camEnable = strtoul(argv[++i], &end, 16);
+                    if (*end || !allArgs->camEnable ||
+                        (allArgs->camEnable & ~MAP_N_TO_ENABLE(MAX_GMSL_LINKS))) {
+                        LOG_ERR("Bad camera enable mask: %s\n", argv[i]);
+                        return NVMEDIA_STATUS_ERROR;
+                    }
+                    allArgs->numLinks = MAP_COUNT_ENABLED_LINKS(allArgs->camEnable);
+                } else {
+                    LOG_ERR("-cam_enable must be followed by a link mask\n");
+                    return NVMEDIA_STATUS_ERROR;
+                }
+            } else if (!strcasecmp(argv[i], "-linkregs") ||
+                       !strcasecmp(argv[i], "-linkbuffers")) {
+                if (bDataAvailable && i + 2 < argc &&
+                    sscanf(argv[i + 1], "%u", &link) == 1 && link < MAX_GMSL_LINKS) {
+                    if (!strcasecmp(argv[i], "-linkregs")) {
+                        allArgs->linkRegs[link].isUsed = NVMEDIA_TRUE;
+                        strncpy(allArgs->linkRegs[link].stringValue, argv[i + 2],
+                                MAX_STRING_SIZE);
+                    } else if (sscanf(argv[i + 2], "%u", &allArgs->linkBuffers[link]) != 1 ||
+                               allArgs->linkBuffers[link] < MIN_BUFFER_POOL_SIZE ||
+                               allArgs->linkBuffers[link] > MAX_BUFFER_POOL_SIZE) {
+                        LOG_ERR("Bad buffer pool size for link %u: %s\n", link, argv[i + 2]);
+                        return NVMEDIA_STATUS_ERROR;
+                    }
+                    i += 2;
+                } else {
+                    LOG_ERR("%s must be followed by a link number below %d and a value\n",
+                            argv[i], MAX_GMSL_LINKS);
+                    return NVMEDIA_STATUS_ERROR;
+                }
             } else if (!strcasecmp(argv[i], "-b")) {
                 if (bDataAvailable) {
                     char *arg = argv[++i];
@@ -186,6 +281,48 @@ ParseArgs(int argc,
                     LOG_ERR("-b must be followed by buffer pool size\n");
                     return NVMEDIA_STATUS_ERROR;
                 }
+            } else if (!strcasecmp(argv[i], "--pipeline")) {
+                if (argv[i + 1] && argv[i + 1][0] != '-') {
+                    allArgs->pipeline.isUsed = NVMEDIA_TRUE;
+                    strncpy(allArgs->pipeline.stringValue, argv[++i], MAX_STRING_SIZE);
+                } else {
+                    LOG_ERR("--pipeline must be followed by a list of stages\n");
+                    return NVMEDIA_STATUS_ERROR;
+                }
+            } else if (!strcasecmp(argv[i], "--display-fps")) {
+                if (bDataAvailable) {
+                    allArgs->displayFps.isUsed = NVMEDIA_TRUE;
+                    if (sscanf(argv[++i], "%u", &allArgs->displayFps.uIntValue) != 1 ||
+                        !allArgs->displayFps.uIntValue ||
+                        allArgs->displayFps.uIntValue > MAX_DISPLAY_FPS) {
+                        LOG_ERR("Bad display rate: %s\n", argv[i]);
+                        return NVMEDIA_STATUS_ERROR;
+                    }
+                } else {
+                    LOG_ERR("--display-fps must be followed by a refresh rate\n");
+                    return NVMEDIA_STATUS_ERROR;
+                }
+            } else if (!strcasecmp(argv[i], "--workers")) {
+                if (bDataAvailable) {
+                    allArgs->workers.isUsed = NVMEDIA_TRUE;
+                    if (sscanf(argv[++i], "%u", &allArgs->workers.uIntValue) != 1 ||
+                        !allArgs->workers.uIntValue ||
+                        allArgs->workers.uIntValue > WORK_POOL_MAX_WORKERS) {
+                        LOG_ERR("Bad number of workers: %s\n", argv[i]);
+                        return NVMEDIA_STATUS_ERROR;
+                    }
+                } else {
+                    LOG_ERR("--workers must be followed by a number of threads\n");
+                    return NVMEDIA_STATUS_ERROR;
+                }
+            } else if (!strcasecmp(argv[i], "--sched")) {
+                if (argv[i + 1] && argv[i + 1][0] != '-') {
+                    allArgs->sched.isUsed = NVMEDIA_TRUE;
+                    strncpy(allArgs->sched.stringValue, argv[++i], MAX_STRING_SIZE);
+                } else {
+                    LOG_ERR("--sched must be followed by a list of stage placements\n");
+                    return NVMEDIA_STATUS_ERROR;
+                }
             } else if (!strcasecmp(argv[i], "--settings")) {
                 if (argv[i + 1] && argv[i + 1][0] != '-') {
                     allArgs->rtSettings.isUsed = NVMEDIA_TRUE;
@@ -213,11 +350,24 @@ ParseArgs(int argc,
     }
 
     if (allArgs->numLinks > 0) {
-        if (allArgs->numLinks > allArgs->numSensors) {
+        if (aggregateUsed && allArgs->numLinks > allArgs->numSensors) {
             LOG_ERR("The number of enabled links with cam_enable option can't be larger than the number with aggregate option\n");
             return NVMEDIA_STATUS_ERROR;
         }
         allArgs->numSensors = allArgs->numLinks;
+    } else {
+        allArgs->camEnable = MAP_N_TO_ENABLE(allArgs->numSensors);
+    }
+
+    // Virtual channel i captures the i-th enabled link
+    for (j = 0, link = 0; link < MAX_GMSL_LINKS; link++) {
+        if ((allArgs->camEnable >> (4 * link)) & 1) {
+            allArgs->channelLink[j++] = link;
+        } else if (allArgs->linkRegs[link].isUsed || allArgs->linkBuffers[link]) {
+            LOG_WARN("Link %u is not enabled, its script and buffers are ignored\n", link);
+            allArgs->linkRegs[link].isUsed = NVMEDIA_FALSE;
+            allArgs->linkBuffers[link] = 0;
+        }
     }
 
     // Set the same capture set for all virtual channels
@@ -25,7 +25,9 @@
 #define MIN_BUFFER_POOL_SIZE    5
 #define MAX_BUFFER_POOL_SIZE    NVMEDIA_MAX_CAPTURE_FRAME_BUFFERS
 #define MAX_STRING_SIZE         256
+#define MAX_DISPLAY_FPS         240
 
+#define MAX_GMSL_LINKS     4
 #define CAM_ENABLE_DEFAULT 0x0001  // only enable cam link 0
 #define CAM_MASK_DEFAULT   0x0000  // do not mask any link
 #define CSI_OUT_DEFAULT    0x3210  // cam link i -> csiout i
@@ -64,6 +66,13 @@ typedef struct {
     CmdlineParameter            rdregs;
     CmdlineParameter            frames;
     CmdlineParameter            rtSettings;
+    CmdlineParameter            i2cTrace;
+    CmdlineParameter            pipeline;
+    CmdlineParameter            sched;
+    CmdlineParameter            displayFps;
+    CmdlineParameter            workers;
+    NvMediaBool                 i2cSim;
+    NvMediaBool                 warmStart;
     NvMediaBool                 displayEnabled;
     NvMediaBool                 displayIdUsed;
     uint32_t                    displayId;
@@ -73,6 +82,10 @@ typedef struct {
     uint32_t                    numSensors;
     uint32_t                    numLinks;
     uint32_t                    numVirtualChannels;
+    uint32_t                    camEnable;          // a nibble per link, 0x1011 = links 0, 1 and 3
+    CmdlineParameter            linkRegs[MAX_GMSL_LINKS];
+    uint32_t                    linkBuffers[MAX_GMSL_LINKS];    // 0 for bufferPoolSize
+    uint32_t                    channelLink[NVMEDIA_ICP_MAX_VIRTUAL_CHANNELS];
     CmdlineParameter            config[NVMEDIA_ICP_MAX_VIRTUAL_CHANNELS];
 } TestArgs;
 
@@ -3,6 +3,7 @@
   * http://www.flir.com/
   * October-2019
 */
+#include <sstream>
 #include <boost/algorithm/string/predicate.hpp>
 #include "commandListener.h"
 
@@ -19,6 +20,7 @@ void CommandListener::listen() {
     std::string responseStr;
     char inputParam[32];
     uint32_t inputNums[4];
+    int numParams;
 
     while(interface->isRunning() && !userCancel) {
         std::string userInput = interface->getUserInput();
@@ -48,6 +50,14 @@ void CommandListener::listen() {
             } else if(boost::iequals(userInput, "video")) {
                 responseStr = interface->getVideoType();
                 printf("Video type: %s\n", responseStr.c_str());
+            } else if(boost::iequals(userInput, "refresh")) {
+                interface->refresh();
+                printf("Serial number: %d\n", interface->getSerialNumber());
+                printf("Part number: %s\n", interface->getPartNumber().c_str());
+                printf("Video type: %s\n", interface->getVideoType().c_str());
+                printf("FPS: %d\n", interface->getFps());
+            } else if(boost::istarts_with(userInput, "batch ")) {
+                runBatch(userInput.substr(6));
             } else if(sscanf(userInput.c_str(), "geti %x", &inputNums[0])) {
                 response = interface->getI2CInt(inputNums[0]);
                 printf("%d\n", response);
@@ -58,17 +68,61 @@ void CommandListener::listen() {
                 &inputNums[1])) 
             {
                 interface->setI2CInt(inputNums[0], inputNums[1]);
-            } else if(sscanf(userInput.c_str(), "r %s", inputParam)) {
-                interface->startRecording(inputParam);
+            } else if(sscanf(userInput.c_str(), "dump %31s", inputParam) == 1) {
+                interface->dumpRegisters(inputParam);
+            } else if(sscanf(userInput.c_str(), "reconfig %u %31s", &inputNums[0],
+                inputParam) == 2)
+            {
+                interface->reconfigure(inputNums[0], inputParam);
+            } else if((numParams = sscanf(userInput.c_str(), "r %31s %u",
+                inputParam, &inputNums[0])) >= 1)
+            {
+                // virtual channel 0 unless given after the file name
+                interface->startRecording(inputParam,
+                    numParams == 2 ? inputNums[0] : 0);
             } else if(!strcasecmp(userInput.c_str(), "r")) {
                 interface->stopRecording();
-            } else if(sscanf(userInput.c_str(), "s %s", inputParam)) {
-                interface->captureImage(inputParam);
+            } else if((numParams = sscanf(userInput.c_str(), "s %31s %u",
+                inputParam, &inputNums[0])) >= 1)
+            {
+                interface->captureImage(inputParam,
+                    numParams == 2 ? inputNums[0] : 0);
             } else {
                 printf("%s: Unsupported input: %s\n", __func__, userInput.c_str());
             }
+        }
+    }
+}
+
+void CommandListener::runBatch(const std::string &args) {
+    std::istringstream tokens(args);
+    std::string token;
+    std::vector<BosonBatchCommand> cmds;
+    uint32_t cmdId, param;
+
+    while(tokens >> token) {
+        BosonBatchCommand cmd;
+        if(sscanf(token.c_str(), "%x=%x", &cmdId, &param) == 2) {
+            InitBatchCommand(&cmd, cmdId, &param, BOSON_RESPONSE_NONE);
+        } else if(sscanf(token.c_str(), "%x", &cmdId) == 1) {
+            InitBatchCommand(&cmd, cmdId, NULL, BOSON_RESPONSE_INT);
+        } else {
+            printf("%s: Invalid batch command: %s\n", __func__, token.c_str());
+            return;
+        }
+        cmds.push_back(cmd);
+    }
+
+    interface->runI2CBatch(cmds);
 
-            interface->flushInput();
+    for(size_t i = 0; i < cmds.size(); i++) {
+        if(cmds[i].status != NVMEDIA_STATUS_OK) {
+            printf("[%zu] failed (camera status %d)\n", i,
+                cmds[i].cameraStatus);
+        } else if(cmds[i].responseType == BOSON_RESPONSE_INT) {
+            printf("[%zu] %d\n", i, cmds[i].intResponse);
+        } else {
+            printf("[%zu] ok\n", i);
         }
     }
 }
@@ -22,6 +22,9 @@ class CommandListener {
     private:
         NvidiaInterface *interface;
         bool userCancel = false;
+
+        // runs "cmd[=val] ..." hex commands in one batch and prints results
+        void runBatch(const std::string &args);
 };
 
 }
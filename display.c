@@ -5,26 +5,59 @@
 */
 #include "display.h"
 #include "capture.h"
+#include "os_common.h"
+#include "pipeline.h"
 #include "opencvConnector.h"
 #include "helpers.h"
 
 
+/* Keeps only the newest queued frame and passes the older ones on
+ * unrendered. Returns NVMEDIA_FALSE if DisplayStop asked to stop. */
+static NvMediaBool
+_TakeNewestFrame(DisplayThreadCtx *threadCtx,
+                 NvMediaImage **image)
+{
+    NvMediaImage *newer = NULL;
+
+    while (NvQueueGet(threadCtx->inputQueue, &newer, 0) == NVMEDIA_STATUS_OK) {
+        if (!newer) {
+            return NVMEDIA_FALSE;
+        }
+        if (PipelinePut(threadCtx->output, image) != NVMEDIA_STATUS_OK) {
+            LOG_ERR("%s: Failed to put image back in queue\n", __func__);
+            *threadCtx->quit = NVMEDIA_TRUE;
+        }
+        threadCtx->skippedFrames++;
+        *image = newer;
+    }
+    return NVMEDIA_TRUE;
+}
+
 static uint32_t
 _DisplayThreadFunc(void *data)
 {
     DisplayThreadCtx *threadCtx = (DisplayThreadCtx *)data;
     NvMediaImage *image = NULL;
-    uint8_t *imgData;
     NvMediaStatus status;
-    uint32_t totalCapturedFrames = 0;
-    char outputFileName[MAX_STRING_SIZE];
-    char buf[MAX_STRING_SIZE] = {0};
-    char *calSettings = NULL;
+    uint64_t now = 0, nextRender = 0;
 
     NVM_SURF_FMT_DEFINE_ATTR(attr);
 
+    ThreadSchedApply(threadCtx->sched, "display", threadCtx->virtualGroupIndex);
+
     while (!(*threadCtx->quit)) {
         image=NULL;
+
+        /* Hold off until the next refresh, frames arriving meanwhile are
+         * skipped below so the queue never backs up */
+        if (threadCtx->renderPeriod) {
+            GetTimeMicroSec(&now);
+            if (nextRender > now) {
+                nvsleep((int)(nextRender - now));
+            }
+            nextRender = (nextRender > now ? nextRender : now) + threadCtx->renderPeriod;
+        }
+
         /* Wait for captured frames */
         while (NvQueueGet(threadCtx->inputQueue, &image, DISPLAY_DEQUEUE_TIMEOUT) !=
            NVMEDIA_STATUS_OK) {
@@ -34,7 +67,11 @@ _DisplayThreadFunc(void *data)
                 goto loop_done;
         }
 
-        totalCapturedFrames++;
+        /* NULL is posted by DisplayStop to wake the thread */
+        if (!image || !_TakeNewestFrame(threadCtx, &image))
+            goto loop_done;
+
+        threadCtx->renderedFrames++;
 
         if (threadCtx->displayEnabled) {
 
@@ -48,7 +85,7 @@ _DisplayThreadFunc(void *data)
             }
 
             if (attr[NVM_SURF_ATTR_SURF_TYPE].value == NVM_SURF_ATTR_SURF_TYPE_RAW) {
-                Opencv_display();
+                Opencv_display(threadCtx->virtualGroupIndex);
             } else {
                 LOG_ERR("%s: Unsupported input image type", __func__);
             }
@@ -56,17 +93,18 @@ _DisplayThreadFunc(void *data)
 
     loop_done:
         if (image) {
-            if (NvQueuePut((NvQueue *)image->tag,
-                           (void *)&image,
-                           0) != NVMEDIA_STATUS_OK) {
+            if (PipelinePut(threadCtx->output, &image) != NVMEDIA_STATUS_OK) {
                 LOG_ERR("%s: Failed to put image back in queue\n", __func__);
                 *threadCtx->quit = NVMEDIA_TRUE;
             };
             image = NULL;
         }
     }
+    LOG_MSG("Display %u: %u frames rendered, %u skipped\n",
+            threadCtx->virtualGroupIndex, threadCtx->renderedFrames,
+            threadCtx->skippedFrames);
     LOG_INFO("%s: Display thread exited\n", __func__);
-    threadCtx->exitedFlag = NVMEDIA_TRUE;
+    ThreadExitNotify(&threadCtx->exited);
     return NVMEDIA_STATUS_OK;
 }
 
@@ -97,7 +135,12 @@ DisplayInit(NvMainContext *mainCtx)
     displayCtx->testArgs  = testArgs;
     displayCtx->numVirtualChannels = testArgs->numVirtualChannels;
     displayCtx->displayEnabled = testArgs->displayEnabled;
-    displayCtx->inputQueueSize = testArgs->bufferPoolSize;
+    displayCtx->inputQueueSize = PipelineQueueDepth(mainCtx, DISPLAY_ELEMENT);
+
+    for (i = 0; i < displayCtx->numVirtualChannels; i++) {
+        ThreadExitInit(&displayCtx->threadCtx[i].exited);
+    }
+
     /* Create NvMedia Device */
     displayCtx->device = NvMediaDeviceCreate();
     if (!displayCtx->device) {
@@ -109,8 +152,9 @@ DisplayInit(NvMainContext *mainCtx)
     /* Create display input Queues and set thread data */
     for (i = 0; i < displayCtx->numVirtualChannels; i++) {
         displayCtx->threadCtx[i].quit = displayCtx->quit;
-        displayCtx->threadCtx[i].exitedFlag = NVMEDIA_TRUE;
         displayCtx->threadCtx[i].displayEnabled = testArgs->displayEnabled;
+        displayCtx->threadCtx[i].renderPeriod = testArgs->displayFps.isUsed ?
+                                                1000000 / testArgs->displayFps.uIntValue : 0;
         displayCtx->threadCtx[i].virtualGroupIndex = captureCtx->threadCtx[i].virtualGroupIndex;
         displayCtx->threadCtx[i].surfType = captureCtx->threadCtx[i].surfType;
         displayCtx->threadCtx[i].rawBytesPerPixel = captureCtx->threadCtx[i].rawBytesPerPixel;
@@ -142,7 +186,7 @@ failed:
 }
 
 NvMediaStatus
-DisplayFini(NvMainContext *mainCtx)
+DisplayStop(NvMainContext *mainCtx)
 {
     NvDisplayContext *displayCtx = NULL;
     NvMediaImage *image = NULL;
@@ -156,35 +200,57 @@ DisplayFini(NvMainContext *mainCtx)
     if (!displayCtx)
         return NVMEDIA_STATUS_OK;
 
-    /* Wait for threads to exit */
+    *displayCtx->quit = NVMEDIA_TRUE;
+
+    /* Wake the threads waiting on an empty input queue */
     for (i = 0; i < displayCtx->numVirtualChannels; i++) {
-        if (displayCtx->displayThread[i]) {
-            while (!displayCtx->threadCtx[i].exitedFlag) {
-                LOG_DBG("%s: Waiting for dipslay thread %d to quit\n",
-                        __func__, i);
-            }
+        if (displayCtx->displayThread[i] && displayCtx->threadCtx[i].inputQueue) {
+            NvQueuePut(displayCtx->threadCtx[i].inputQueue, (void *)&image, 0);
         }
     }
 
-    *displayCtx->quit = NVMEDIA_TRUE;
-
-    /* Destroy threads */
+    /* Join threads, waiting longer than the timeout only if one is stuck */
     for (i = 0; i < displayCtx->numVirtualChannels; i++) {
-        if (displayCtx->displayThread[i]) {
-            status = NvThreadDestroy(displayCtx->displayThread[i]);
-            if (status != NVMEDIA_STATUS_OK)
-                LOG_ERR("%s: Failed to destroy dipslay thread %d\n",
-                        __func__, i);
+        if (!displayCtx->displayThread[i])
+            continue;
+        if (ThreadExitWait(&displayCtx->threadCtx[i].exited,
+                           DISPLAY_EXIT_TIMEOUT) != NVMEDIA_STATUS_OK) {
+            LOG_WARN("%s: Display thread %d did not exit within %d ms\n",
+                     __func__, i, DISPLAY_EXIT_TIMEOUT);
         }
+        status = NvThreadDestroy(displayCtx->displayThread[i]);
+        if (status != NVMEDIA_STATUS_OK)
+            LOG_ERR("%s: Failed to destroy display thread %d\n",
+                    __func__, i);
+        displayCtx->displayThread[i] = NULL;
     }
 
+    return status;
+}
+
+NvMediaStatus
+DisplayFini(NvMainContext *mainCtx)
+{
+    NvDisplayContext *displayCtx = NULL;
+    NvMediaImage *image = NULL;
+    uint32_t i;
+
+    if (!mainCtx)
+        return NVMEDIA_STATUS_OK;
+
+    displayCtx = mainCtx->ctxs[DISPLAY_ELEMENT];
+    if (!displayCtx)
+        return NVMEDIA_STATUS_OK;
+
+    DisplayStop(mainCtx);
+
     for (i = 0; i < displayCtx->numVirtualChannels; i++) {
         /*Flush and destroy the input queues*/
         if (displayCtx->threadCtx[i].inputQueue) {
             LOG_DBG("%s: Flushing the dipslay input queue %d\n", __func__, i);
             while (IsSucceed(NvQueueGet(displayCtx->threadCtx[i].inputQueue, &image, 0))) {
                 if (image) {
-                    if (NvQueuePut((NvQueue *)image->tag,
+                    if (NvQueuePut(IMAGE_POOL(image),
                                    (void *)&image,
                                    0) != NVMEDIA_STATUS_OK) {
                         LOG_ERR("%s: Failed to put image back in queue\n", __func__);
@@ -195,6 +261,7 @@ DisplayFini(NvMainContext *mainCtx)
             }
             NvQueueDestroy(displayCtx->threadCtx[i].inputQueue);
         }
+        ThreadExitDestroy(&displayCtx->threadCtx[i].exited);
     }
 
     if (displayCtx->device)
@@ -220,9 +287,16 @@ DisplayProc(NvMainContext *mainCtx)
     }
     displayCtx = mainCtx->ctxs[DISPLAY_ELEMENT];
 
+    /* Setting the queues */
+    for (i = 0; i < displayCtx->numVirtualChannels; i++) {
+        displayCtx->threadCtx[i].output = PipelineOutput(mainCtx, DISPLAY_ELEMENT, i);
+        displayCtx->threadCtx[i].sched = PipelineThreadSched(mainCtx,
+                                                             DISPLAY_ELEMENT, i);
+    }
+
     /* Create thread to display images */
     for (i = 0; i < displayCtx->numVirtualChannels; i++) {
-        displayCtx->threadCtx[i].exitedFlag = NVMEDIA_FALSE;
+        ThreadExitStart(&displayCtx->threadCtx[i].exited);
         status = NvThreadCreate(&displayCtx->displayThread[i],
                                 &_DisplayThreadFunc,
                                 (void *)&displayCtx->threadCtx[i],
@@ -230,9 +304,17 @@ DisplayProc(NvMainContext *mainCtx)
         if (status != NVMEDIA_STATUS_OK) {
             LOG_ERR("%s: Failed to create display thread\n",
                     __func__);
-            displayCtx->threadCtx[i].exitedFlag = NVMEDIA_TRUE;
+            ThreadExitNotify(&displayCtx->threadCtx[i].exited);
         }
     }
     return status;
 }
 
+NvQueue *
+DisplayGetInputQueue(NvMainContext *mainCtx,
+                     uint32_t virtualChannel)
+{
+    NvDisplayContext *displayCtx = mainCtx->ctxs[DISPLAY_ELEMENT];
+
+    return displayCtx ? displayCtx->threadCtx[virtualChannel].inputQueue : NULL;
+}
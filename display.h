@@ -7,6 +7,7 @@
 #define __DISPLAY_H__
 
 #include "thread_utils.h"
+#include "threadExit.h"
 
 #include "main.h"
 #include "cmdline.h"
@@ -14,17 +15,22 @@
 #define DISPLAY_QUEUE_SIZE                 3      /* min no. of buffers to be in circulation at any point */
 #define DISPLAY_DEQUEUE_TIMEOUT            1000
 #define DISPLAY_ENQUEUE_TIMEOUT            100
+#define DISPLAY_EXIT_TIMEOUT               1000
 
 typedef struct {
     NvQueue                    *inputQueue;
-    NvQueue                    *outputQueue;
+    PipelineLink               *output;         // to the next stage
     volatile NvMediaBool       *quit;
     NvMediaBool                 displayEnabled;
-    NvMediaBool                 exitedFlag;
+    ThreadExit                  exited;
+    const ThreadSched          *sched;          // applied by the thread
 
     /* display params */
     uint32_t                    rawBytesPerPixel;
     uint32_t                    virtualGroupIndex;
+    uint32_t                    renderPeriod;       // us, 0 to render each new frame
+    uint32_t                    renderedFrames;
+    uint32_t                    skippedFrames;      // replaced by a newer frame
 
     /* Raw2Rgb conversion params */
     NvMediaSurfaceType          surfType;
@@ -49,11 +55,19 @@ typedef struct {
 NvMediaStatus
 DisplayInit(NvMainContext *mainCtx);
 
+/* Stops and joins the display threads, DisplayFini does it if needed */
+NvMediaStatus
+DisplayStop(NvMainContext *mainCtx);
+
 NvMediaStatus
 DisplayFini(NvMainContext *mainCtx);
 
 NvMediaStatus
 DisplayProc(NvMainContext *mainCtx);
 
+NvQueue *
+DisplayGetInputQueue(NvMainContext *mainCtx,
+                     uint32_t virtualChannel);
+
 
 #endif
\ No newline at end of file
@@ -4,6 +4,7 @@
   * October-2019
 */
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "log_utils.h"
@@ -23,6 +24,7 @@ CreateImageQueue(NvMediaDevice *device,
 {
     uint32_t j = 0;
     NvMediaImage *image = NULL;
+    ImageFrame *frame = NULL;
     NvMediaStatus status = NVMEDIA_STATUS_OK;
 
     if (NvQueueCreate(queue,
@@ -45,7 +47,13 @@ CreateImageQueue(NvMediaDevice *device,
             return NVMEDIA_STATUS_ERROR;
         }
 
-        image->tag = *queue;
+        if (!(frame = calloc(1, sizeof(ImageFrame)))) {
+            LOG_ERR("%s: Out of memory\n", __func__);
+            NvMediaImageDestroy(image);
+            return NVMEDIA_STATUS_OUT_OF_MEMORY;
+        }
+        frame->pool = *queue;
+        image->tag = frame;
 
         if (IsFailed(NvQueuePut(*queue,
                                 (void *)&image,
@@ -58,16 +66,109 @@ CreateImageQueue(NvMediaDevice *device,
     return NVMEDIA_STATUS_OK;
 }
 
+void
+DestroyImageQueue(NvQueue *queue)
+{
+    NvMediaImage *image = NULL;
+    ImageFrame *frame = NULL;
+
+    while (NvQueueGet(queue, &image, 0) == NVMEDIA_STATUS_OK) {
+        if (image) {
+            frame = IMAGE_FRAME(image);
+            if (frame) {
+                free(frame->pixels);
+                free(frame->telemetry);
+                free(frame);
+            }
+            NvMediaImageDestroy(image);
+            image = NULL;
+        }
+    }
+    NvQueueDestroy(queue);
+}
+
+static NvMediaStatus
+_GrowBuffer(uint8_t **buffer,
+            size_t *allocated,
+            size_t size)
+{
+    uint8_t *grown;
+
+    if (size <= *allocated) {
+        return NVMEDIA_STATUS_OK;
+    }
+    if (!(grown = realloc(*buffer, size))) {
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+    *buffer = grown;
+    *allocated = size;
+    return NVMEDIA_STATUS_OK;
+}
+
+NvMediaStatus
+ImageFrameReserve(ImageFrame *frame,
+                  uint32_t width,
+                  uint32_t height,
+                  uint32_t bytesPerPixel)
+{
+    size_t stride = (size_t)width * bytesPerPixel;
+
+    if (_GrowBuffer(&frame->pixels, &frame->pixelsSize,
+                    stride * height) != NVMEDIA_STATUS_OK ||
+        _GrowBuffer(&frame->telemetry, &frame->telemetrySize,
+                    stride) != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: Out of memory\n", __func__);
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+
+    frame->width = width;
+    frame->height = height;
+    frame->bytesPerPixel = bytesPerPixel;
+    return NVMEDIA_STATUS_OK;
+}
+
+typedef struct {
+    uint8_t                    *src;
+    uint8_t                    *dst;
+    uint32_t                    srcPitch;
+    uint32_t                    firstRow;       // image rows, telemetry excluded
+    uint32_t                    numRows;
+    uint8_t                     multiplex;
+} ImageTile;
+
+static void
+_CopyImageTile(void *data)
+{
+    ImageTile *tile = (ImageTile *)data;
+    /* skip the first row (telemetry line) */
+    uint8_t *src = tile->src + (size_t)(tile->firstRow + 1) * tile->srcPitch;
+    size_t size = (size_t)tile->numRows * tile->srcPitch;
+
+    size_t offset = (size_t)tile->firstRow * tile->srcPitch;
+    size_t i;
+
+    if (tile->multiplex) {
+        for (i = 0; i < size; i += 2) {
+            tile->dst[(offset + i)/2] = src[i];
+        }
+    } else {
+        memcpy(tile->dst + offset, src, size);
+    }
+}
+
 NvMediaStatus
 ImageToBytes(NvMediaImage *imgSrc,
               uint8_t *dstBuffer,
               uint8_t *telemetry,
               uint32_t rawBytesPerPixel,
-              uint8_t multiplex)
+              uint8_t multiplex,
+              WorkPool *pool)
 {
     uint8_t *pSrcBuff = NULL;
     NvMediaImageSurfaceMap surfaceMap;
     NvMediaStatus status;
+    ImageTile tiles[WORK_POOL_MAX_WORKERS * 4];
+    uint32_t numTiles, rowsPerTile, row, t;
 
     uint32_t srcWidth, srcHeight, srcPitch; 
 
@@ -94,18 +195,32 @@ ImageToBytes(NvMediaImage *imgSrc,
         for (size_t i = 0; i < srcPitch; i+=2) {
             telemetry[i/2] = pSrcBuff[i];
         }
-        // get image (skip telemetry line)
-        for (size_t i = srcPitch; i < srcPitch * srcHeight; i+=2) {
-            dstBuffer[(i - srcPitch)/2] = pSrcBuff[i];
-        }
     } else {
         // get telemetry data
         memcpy(telemetry, pSrcBuff, srcPitch * sizeof(uint8_t));
+    }
 
-        // skip the first row (telemetry line)
-        memcpy(dstBuffer, &pSrcBuff[srcPitch], 
-            srcPitch * (srcHeight - 1) * sizeof(uint8_t));
+    // get image, split in row tiles for the worker pool if large enough
+    numTiles = 1;
+    if (pool) {
+        numTiles = (uint32_t)((size_t)srcPitch * (srcHeight - 1) / IMAGE_TILE_BYTES);
+        if (numTiles < 2) {
+            numTiles = 1;
+        } else if (numTiles > sizeof(tiles) / sizeof(tiles[0])) {
+            numTiles = sizeof(tiles) / sizeof(tiles[0]);
+        }
     }
+    rowsPerTile = (srcHeight - 1 + numTiles - 1) / numTiles;
+    for (t = 0, row = 0; row < srcHeight - 1; t++, row += rowsPerTile) {
+        tiles[t].src = pSrcBuff;
+        tiles[t].dst = dstBuffer;
+        tiles[t].srcPitch = srcPitch;
+        tiles[t].firstRow = row;
+        tiles[t].numRows = (srcHeight - 1 - row < rowsPerTile) ?
+                           srcHeight - 1 - row : rowsPerTile;
+        tiles[t].multiplex = multiplex;
+    }
+    WorkPoolRun(pool, _CopyImageTile, tiles, sizeof(ImageTile), t);
 
     // FILE *fp = fopen("img.out", "w");
     // fwrite(dstBuffer, srcPitch * (srcHeight - 1), sizeof(uint8_t), fp);
@@ -117,6 +232,107 @@ ImageToBytes(NvMediaImage *imgSrc,
     return NVMEDIA_STATUS_OK;
 }
 
+typedef struct {
+    uint8_t                    *pixels;
+    size_t                      firstPixel;
+    size_t                      numPixels;
+    uint32_t                    bytesPerPixel;
+    uint32_t                    min;            // of the tile, then of the frame
+    uint32_t                    max;
+    uint64_t                    scale;          // 16.16 fixed point
+} AgcTile;
+
+static void
+_AgcRangeTile(void *data)
+{
+    AgcTile *tile = (AgcTile *)data;
+    uint32_t min = UINT32_MAX, max = 0, value;
+    size_t i;
+
+    for (i = tile->firstPixel; i < tile->firstPixel + tile->numPixels; i++) {
+        value = (tile->bytesPerPixel == 2) ? ((uint16_t *)tile->pixels)[i] :
+                                             tile->pixels[i];
+        if (value < min) {
+            min = value;
+        }
+        if (value > max) {
+            max = value;
+        }
+    }
+    tile->min = min;
+    tile->max = max;
+}
+
+static void
+_AgcScaleTile(void *data)
+{
+    AgcTile *tile = (AgcTile *)data;
+    uint16_t *pixels16 = (uint16_t *)tile->pixels;
+    size_t i;
+
+    for (i = tile->firstPixel; i < tile->firstPixel + tile->numPixels; i++) {
+        if (tile->bytesPerPixel == 2) {
+            pixels16[i] = (uint16_t)(((pixels16[i] - tile->min) *
+                                      tile->scale + 0x8000) >> 16);
+        } else {
+            tile->pixels[i] = (uint8_t)(((tile->pixels[i] - tile->min) *
+                                         tile->scale + 0x8000) >> 16);
+        }
+    }
+}
+
+void
+ImageFrameAgc(ImageFrame *frame, WorkPool *pool)
+{
+    AgcTile tiles[WORK_POOL_MAX_WORKERS * 4];
+    size_t numPixels = (size_t)frame->width * frame->height;
+    size_t pixelsPerTile, pixel;
+    uint32_t outMax = (frame->bytesPerPixel == 2) ? UINT16_MAX : UINT8_MAX;
+    uint32_t numTiles = 1;
+    uint32_t min = UINT32_MAX, max = 0;
+    uint32_t t, i;
+
+    if (!numPixels) {
+        return;
+    }
+
+    // split in tiles for the worker pool if large enough
+    if (pool) {
+        numTiles = (uint32_t)(numPixels * frame->bytesPerPixel / IMAGE_TILE_BYTES);
+        if (numTiles < 2) {
+            numTiles = 1;
+        } else if (numTiles > sizeof(tiles) / sizeof(tiles[0])) {
+            numTiles = sizeof(tiles) / sizeof(tiles[0]);
+        }
+    }
+    pixelsPerTile = (numPixels + numTiles - 1) / numTiles;
+    for (t = 0, pixel = 0; pixel < numPixels; t++, pixel += pixelsPerTile) {
+        tiles[t].pixels = frame->pixels;
+        tiles[t].firstPixel = pixel;
+        tiles[t].numPixels = (numPixels - pixel < pixelsPerTile) ?
+                             numPixels - pixel : pixelsPerTile;
+        tiles[t].bytesPerPixel = frame->bytesPerPixel;
+    }
+
+    // the range of the whole frame is known only once every tile is done
+    WorkPoolRun(pool, _AgcRangeTile, tiles, sizeof(AgcTile), t);
+    for (i = 0; i < t; i++) {
+        if (tiles[i].min < min) {
+            min = tiles[i].min;
+        }
+        if (tiles[i].max > max) {
+            max = tiles[i].max;
+        }
+    }
+
+    // a flat frame goes black, like cv::normalize
+    for (i = 0; i < t; i++) {
+        tiles[i].min = min;
+        tiles[i].scale = (max > min) ? ((uint64_t)outMax << 16) / (max - min) : 0;
+    }
+    WorkPoolRun(pool, _AgcScaleTile, tiles, sizeof(AgcTile), t);
+}
+
 void
 MsbToLsb32(uint32_t *dest, uint8_t *src) {
     *dest = 0;
@@ -6,9 +6,31 @@
 #ifndef __HELPERS_H__
 #define __HELPERS_H__
 
+#include <stddef.h>
+
 #include "nvmedia_core.h"
 #include "nvmedia_image.h"
 #include "thread_utils.h"
+#include "workPool.h"
+
+#define IMAGE_TILE_BYTES    65536   // frames above twice this are split in row tiles
+
+/* Kept in image->tag of every pool image: the pool it goes back to and the
+ * frame the capture stage converted from it, so later stages work on the
+ * frame they dequeued rather than the newest one */
+typedef struct {
+    NvQueue                    *pool;
+    uint8_t                    *pixels;         // telemetry line excluded
+    uint8_t                    *telemetry;
+    uint32_t                    width;
+    uint32_t                    height;
+    uint32_t                    bytesPerPixel;
+    size_t                      pixelsSize;     // allocated
+    size_t                      telemetrySize;
+} ImageFrame;
+
+#define IMAGE_FRAME(image)  ((ImageFrame *)(image)->tag)
+#define IMAGE_POOL(image)   (IMAGE_FRAME(image)->pool)
 
 NvMediaStatus 
 CreateImageQueue(NvMediaDevice *device,
@@ -20,12 +42,31 @@ CreateImageQueue(NvMediaDevice *device,
                 NvMediaSurfAllocAttr *surfAllocAttrs,
                 uint32_t numSurfAllocAttrs);
 
+/* Destroys the images left in the queue with their frames, then the queue */
+void
+DestroyImageQueue(NvQueue *queue);
+
+/* Grows the frame buffers to hold width x height pixels and one telemetry
+ * line, then sets the frame format */
+NvMediaStatus
+ImageFrameReserve(ImageFrame *frame,
+                  uint32_t width,
+                  uint32_t height,
+                  uint32_t bytesPerPixel);
+
 NvMediaStatus
 ImageToBytes(NvMediaImage *imgSrc,
             uint8_t *dstBuffer,
             uint8_t *telemetry,
             uint32_t rawBytesPerPixel,
-            uint8_t multiplex);
+            uint8_t multiplex,
+            WorkPool *pool);
+
+/* Stretches the frame pixels in place to the full range of their size, as
+ * cv::NORM_MINMAX does, for display and recording */
+void
+ImageFrameAgc(ImageFrame *frame,
+              WorkPool *pool);
 
 void
 MsbToLsb32(uint32_t *dest, uint8_t *src);
@@ -0,0 +1,122 @@
+/* NVIDIA CORPORATION gave permission to FLIR Systems, Inc to modify this code
+  * and distribute it as part of the ADAS GMSL Kit.
+  * http://www.flir.com/
+  * October-2019
+*/
+#include <pthread.h>
+#include <stdint.h>
+
+#include "i2cTrace.h"
+#include "i2cBus.h"
+
+static const I2cBusBackend _hardwareBackend = {
+    .name = "testutil_i2c",
+    .open = testutil_i2c_open,
+    .close = testutil_i2c_close,
+    .write = testutil_i2c_write_subaddr,
+    .read = testutil_i2c_read_subaddr,
+};
+
+static const I2cBusBackend *_backend = &_hardwareBackend;
+
+static pthread_mutex_t _busLocks[I2C_BUS_MAX_LOCKS];
+static pthread_once_t _busLocksOnce = PTHREAD_ONCE_INIT;
+
+static void
+_InitBusLocks(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < I2C_BUS_MAX_LOCKS; i++) {
+        pthread_mutex_init(&_busLocks[i], NULL);
+    }
+}
+
+static pthread_mutex_t *
+_BusLock(int i2cDevice)
+{
+    pthread_once(&_busLocksOnce, _InitBusLocks);
+    return &_busLocks[(unsigned int)i2cDevice % I2C_BUS_MAX_LOCKS];
+}
+
+/* Packs up to the first two bytes of a sub-address for the trace tag */
+static uint32_t
+_TraceTag(void *bytes, unsigned int length)
+{
+    uint8_t *data = (uint8_t *)bytes;
+
+    if (!data || !length) {
+        return 0;
+    }
+    return (length > 1) ? ((data[0] << 8) | data[1]) : data[0];
+}
+
+void
+I2cBusSetBackend(const I2cBusBackend *backend)
+{
+    _backend = backend ? backend : &_hardwareBackend;
+}
+
+const I2cBusBackend *
+I2cBusGetBackend(void)
+{
+    return _backend;
+}
+
+int
+I2cBusOpen(int i2cDevice, I2cHandle *handle)
+{
+    uint64_t start = I2cTraceTimeNs();
+    int result = _backend->open(i2cDevice, handle);
+
+    I2cTraceRecordOp(I2C_TRACE_OPEN, i2cDevice, 0, 0, result, start);
+    return result;
+}
+
+void
+I2cBusClose(I2cHandle handle)
+{
+    uint64_t start = I2cTraceTimeNs();
+
+    _backend->close(handle);
+    I2cTraceRecordOp(I2C_TRACE_CLOSE, 0, 0, 0, 0, start);
+}
+
+int
+I2cBusWrite(I2cHandle handle, unsigned int deviceAddress, void *data,
+            unsigned int length)
+{
+    uint64_t start = I2cTraceTimeNs();
+    int result = _backend->write(handle, deviceAddress, data, length);
+
+    I2cTraceRecordOp(I2C_TRACE_WRITE, deviceAddress,
+                     _TraceTag(data, (length > 2) ? 2 : 1), length,
+                     result, start);
+    return result;
+}
+
+int
+I2cBusRead(I2cHandle handle, unsigned int deviceAddress, void *subAddress,
+           unsigned int subAddressLength, void *data, unsigned int length)
+{
+    uint64_t start = I2cTraceTimeNs();
+    int result = _backend->read(handle, deviceAddress, subAddress,
+                                subAddressLength, data, length);
+
+    I2cTraceRecordOp(I2C_TRACE_READ, deviceAddress,
+                     _TraceTag(subAddress, subAddressLength), length,
+                     result, start);
+    return result;
+}
+
+void
+I2cBusLock(int i2cDevice)
+{
+    pthread_mutex_lock(_BusLock(i2cDevice));
+}
+
+void
+I2cBusUnlock(int i2cDevice)
+{
+    pthread_mutex_unlock(_BusLock(i2cDevice));
+}
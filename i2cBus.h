@@ -0,0 +1,63 @@
+/* NVIDIA CORPORATION gave permission to FLIR Systems, Inc to modify this code
+  * and distribute it as part of the ADAS GMSL Kit.
+  * http://www.flir.com/
+  * October-2019
+*/
+#ifndef __I2C_BUS_H__
+#define __I2C_BUS_H__
+
+#include "testutil_i2c.h"
+
+#define I2C_BUS_MAX_LOCKS   32      // buses numbered above share a lock
+
+typedef struct {
+    const char                 *name;
+    int                       (*open)(int i2cDevice, I2cHandle *handle);
+    void                      (*close)(I2cHandle handle);
+    int                       (*write)(I2cHandle handle,
+                                       unsigned int deviceAddress,
+                                       void *data, unsigned int length);
+    int                       (*read)(I2cHandle handle,
+                                      unsigned int deviceAddress,
+                                      void *subAddress,
+                                      unsigned int subAddressLength,
+                                      void *data, unsigned int length);
+} I2cBusBackend;
+
+/* Selects where I2C traffic goes. NULL restores the testutil_i2c hardware
+ * backend. Must be called before any handle is opened. */
+void
+I2cBusSetBackend(const I2cBusBackend *backend);
+
+const I2cBusBackend *
+I2cBusGetBackend(void);
+
+/* Wrappers with the testutil_i2c_* semantics. All I2C traffic goes
+ * through these so it can be traced or redirected to a simulator. */
+
+int
+I2cBusOpen(int i2cDevice, I2cHandle *handle);
+
+void
+I2cBusClose(I2cHandle handle);
+
+int
+I2cBusWrite(I2cHandle handle, unsigned int deviceAddress, void *data,
+            unsigned int length);
+
+int
+I2cBusRead(I2cHandle handle, unsigned int deviceAddress, void *subAddress,
+           unsigned int subAddressLength, void *data, unsigned int length);
+
+/* Held by every thread for a whole transaction on the bus: the commands
+ * between two barriers with their link selection, released only during
+ * their delays with every link addressed, a Boson command and its
+ * response, a frame group or a register read back. Not recursive, taken by
+ * the outermost caller only. */
+void
+I2cBusLock(int i2cDevice);
+
+void
+I2cBusUnlock(int i2cDevice);
+
+#endif
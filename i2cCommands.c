@@ -12,8 +12,767 @@
  * license agreement from NVIDIA CORPORATION is strictly prohibited.
  */
 
+#include <stdint.h>
+#include <time.h>
+
 #include "i2cCommands.h"
+#include "bosonInterface.h"
+#include "i2cBus.h"
 #include "os_common.h"
+#include "thread_utils.h"
+
+static NvMediaStatus
+_ProcessBosonBatch(I2cHandle handle, I2cCommands *allCommands,
+                   uint32_t *index, uint32_t stopCmd, ProcessType type)
+{
+    BosonBatchCommand batch[BOSON_MAX_BATCH_COMMANDS];
+    Command *first = &allCommands->commands[*index];
+    Command *cmd = NULL;
+    NvMediaStatus status;
+    uint32_t numCmds = 0;
+    uint32_t i, j;
+
+    /* Gather the run of Boson commands to the same camera */
+    for (i = *index; i < stopCmd && numCmds < BOSON_MAX_BATCH_COMMANDS; i++) {
+        cmd = &allCommands->commands[i];
+        if (cmd->commandType != BOSON_CMD ||
+            cmd->processType != type ||
+            cmd->deviceAddress != first->deviceAddress) {
+            break;
+        }
+
+        memset(&batch[numCmds], 0, sizeof(BosonBatchCommand));
+        for (j = 0; j < 4; j++) {
+            batch[numCmds].cmdBody[j] = cmd->buffer[j];
+        }
+        if (cmd->dataLength == 8) {
+            batch[numCmds].hasParam = NVMEDIA_TRUE;
+            batch[numCmds].param = (cmd->buffer[4] << 24) | (cmd->buffer[5] << 16) |
+                                   (cmd->buffer[6] << 8) | cmd->buffer[7];
+        }
+        batch[numCmds].responseType = BOSON_RESPONSE_NONE;
+        numCmds++;
+    }
+    /* Resume after the last command of the batch */
+    *index = i - 1;
+
+    status = SendCommandBatch(handle, first->deviceAddress, batch, numCmds);
+    for (i = 0; i < numCmds; i++) {
+        if (batch[i].status != NVMEDIA_STATUS_OK) {
+            LOG_ERR("%s: Boson command %02x%02x%02x%02x failed (status %d)\n",
+                    __func__, batch[i].cmdBody[0], batch[i].cmdBody[1],
+                    batch[i].cmdBody[2], batch[i].cmdBody[3],
+                    batch[i].cameraStatus);
+        }
+    }
+
+    return status;
+}
+
+typedef struct {
+    uint32_t                    deviceAddress;
+    uint8_t                     subAddress[2];
+    uint8_t                     subAddressLength;   // 0 for the whole device
+} BurstOptIn;
+
+static uint32_t
+_SubAddressLength(Command *cmd)
+{
+    switch (cmd->commandType) {
+        case(WRITE_REG_1):
+            return 1;
+        case(WRITE_REG_2):
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+static NvMediaBool
+_IsBurstOptedIn(BurstOptIn *optIns, uint32_t numOptIns, Command *cmd)
+{
+    uint32_t length = _SubAddressLength(cmd);
+    uint32_t i;
+
+    for (i = 0; i < numOptIns; i++) {
+        if (optIns[i].deviceAddress == BURST_ALL_DEVICES) {
+            return NVMEDIA_TRUE;
+        }
+        if (optIns[i].deviceAddress != cmd->deviceAddress) {
+            continue;
+        }
+        if (!optIns[i].subAddressLength ||
+            (optIns[i].subAddressLength == length &&
+             !memcmp(optIns[i].subAddress, cmd->buffer, length))) {
+            return NVMEDIA_TRUE;
+        }
+    }
+    return NVMEDIA_FALSE;
+}
+
+static NvMediaStatus
+_UpdateBurstOptIns(BurstOptIn *optIns, uint32_t *numOptIns, Command *cmd)
+{
+    uint32_t i;
+
+    /* Bare "; Burst off" disables merging everywhere again */
+    if (cmd->deviceAddress == BURST_ALL_DEVICES && !cmd->buffer[0]) {
+        *numOptIns = 0;
+        return NVMEDIA_STATUS_OK;
+    }
+
+    for (i = 0; i < *numOptIns; i++) {
+        if (optIns[i].deviceAddress == cmd->deviceAddress &&
+            optIns[i].subAddressLength == cmd->dataLength &&
+            !memcmp(optIns[i].subAddress, &cmd->buffer[1], cmd->dataLength)) {
+            break;
+        }
+    }
+
+    if (!cmd->buffer[0]) {
+        /* Burst off: drop a matching opt-in */
+        if (i < *numOptIns) {
+            optIns[i] = optIns[--(*numOptIns)];
+        }
+        return NVMEDIA_STATUS_OK;
+    }
+
+    if (i < *numOptIns) {
+        return NVMEDIA_STATUS_OK;
+    }
+    if (*numOptIns == MAX_BURST_OPT_INS) {
+        LOG_ERR("%s: Too many burst opt-ins\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+    optIns[*numOptIns].deviceAddress = cmd->deviceAddress;
+    optIns[*numOptIns].subAddressLength = cmd->dataLength;
+    memcpy(optIns[*numOptIns].subAddress, &cmd->buffer[1], cmd->dataLength);
+    (*numOptIns)++;
+
+    return NVMEDIA_STATUS_OK;
+}
+
+NvMediaStatus
+I2cCoalesceWrites(I2cCommands *allCommands)
+{
+    BurstOptIn optIns[MAX_BURST_OPT_INS];
+    uint32_t numOptIns = 0;
+    Command *burst = NULL;
+    Command *cmd;
+    uint32_t length;
+    uint32_t in, out = 0;
+    uint32_t numMerged = 0;
+
+    for (in = 0; in < allCommands->numCommands; in++) {
+        cmd = &allCommands->commands[in];
+        length = _SubAddressLength(cmd);
+
+        if (cmd->commandType == BURST_CFG &&
+            _UpdateBurstOptIns(optIns, &numOptIns, cmd) !=
+            NVMEDIA_STATUS_OK) {
+            return NVMEDIA_STATUS_ERROR;
+        }
+
+        /* Append to the open burst if this writes the same register and
+         * the script declared it may take bursts */
+        if (burst && length &&
+            cmd->commandType == burst->commandType &&
+            cmd->processType == burst->processType &&
+            cmd->deviceAddress == burst->deviceAddress &&
+            !memcmp(cmd->buffer, burst->buffer, length) &&
+            burst->dataLength + cmd->dataLength <= MAX_BURST_LENGTH &&
+            _IsBurstOptedIn(optIns, numOptIns, cmd)) {
+            memcpy(&burst->buffer[length + burst->dataLength],
+                   &cmd->buffer[length], cmd->dataLength);
+            burst->dataLength += cmd->dataLength;
+            numMerged++;
+            continue;
+        }
+
+        if (out != in) {
+            allCommands->commands[out] = *cmd;
+        }
+        /* Anything other than a write closes the burst */
+        burst = length ? &allCommands->commands[out] : NULL;
+        out++;
+    }
+
+    if (numMerged) {
+        LOG_INFO("%s: Merged %u writes, %u commands left\n", __func__,
+                 numMerged, out);
+    }
+    allCommands->numCommands = out;
+    I2cTrimCommands(allCommands);
+
+    return NVMEDIA_STATUS_OK;
+}
+
+typedef struct {
+    int                         i2cDevice;
+    I2cHandle                   handle;
+} WarmBus;
+
+static int
+_CompareRegisters(const void *a, const void *b)
+{
+    const I2cRegister *regA = (const I2cRegister *)a;
+    const I2cRegister *regB = (const I2cRegister *)b;
+
+    if (regA->i2cDevice != regB->i2cDevice)
+        return regA->i2cDevice < regB->i2cDevice ? -1 : 1;
+    if (regA->deviceAddress != regB->deviceAddress)
+        return regA->deviceAddress < regB->deviceAddress ? -1 : 1;
+    if (regA->subAddressLength != regB->subAddressLength)
+        return regA->subAddressLength < regB->subAddressLength ? -1 : 1;
+    if (regA->subAddress != regB->subAddress)
+        return regA->subAddress < regB->subAddress ? -1 : 1;
+    return 0;
+}
+
+static NvMediaBool
+_SameRegister(I2cRegister *regA, I2cRegister *regB)
+{
+    return !_CompareRegisters(regA, regB);
+}
+
+static I2cHandle
+_GetWarmBus(WarmBus *buses, uint32_t *numBuses, int i2cDevice)
+{
+    uint32_t i;
+
+    for (i = 0; i < *numBuses; i++) {
+        if (buses[i].i2cDevice == i2cDevice) {
+            return buses[i].handle;
+        }
+    }
+    if (*numBuses == MAX_I2C_PARTITIONS) {
+        return NULL;
+    }
+
+    I2cBusOpen(i2cDevice, &buses[*numBuses].handle);
+    if (!buses[*numBuses].handle) {
+        return NULL;
+    }
+    buses[*numBuses].i2cDevice = i2cDevice;
+    return buses[(*numBuses)++].handle;
+}
+
+uint32_t
+I2cListRegisters(I2cCommands *allCommands,
+                 int i2cDevice,
+                 I2cRegister *regs,
+                 NvMediaBool excludeRepeated)
+{
+    uint32_t skipped[MAX_WARM_SKIPS];
+    uint32_t numSkipped = 0;
+    uint32_t numRegs = 0;
+    uint32_t i, j, length;
+    NvMediaBool linkSection = NVMEDIA_FALSE;
+    Command *cmd;
+
+    for (i = 0; i < allCommands->numCommands; i++) {
+        cmd = &allCommands->commands[i];
+        if (cmd->processType == GROUP_REG) {
+            continue;
+        }
+        if (cmd->commandType == I2C_DEVICE) {
+            i2cDevice = cmd->i2cDevice;
+            continue;
+        }
+        /* Reads outside a write pass reach every link, so registers of a
+         * single link cannot be read back */
+        if (cmd->commandType == LINK_SEL || cmd->commandType == BARRIER) {
+            linkSection = cmd->commandType == LINK_SEL &&
+                          cmd->link != I2C_LINK_ALL;
+            continue;
+        }
+        if (linkSection) {
+            continue;
+        }
+        if (cmd->commandType == WARM_SKIP) {
+            if (numSkipped < MAX_WARM_SKIPS) {
+                skipped[numSkipped++] = cmd->deviceAddress;
+            } else {
+                LOG_WARN("%s: Too many Warm skip devices\n", __func__);
+            }
+            continue;
+        }
+
+        length = _SubAddressLength(cmd);
+        if (!length || cmd->dataLength != 1) {
+            continue;
+        }
+        for (j = 0; j < numSkipped && skipped[j] != cmd->deviceAddress; j++);
+        if (j < numSkipped) {
+            continue;
+        }
+
+        regs[numRegs].i2cDevice = i2cDevice;
+        regs[numRegs].deviceAddress = cmd->deviceAddress;
+        regs[numRegs].subAddressLength = length;
+        regs[numRegs].subAddress = (length == 2) ?
+            (cmd->buffer[0] << 8) | cmd->buffer[1] : cmd->buffer[0];
+        regs[numRegs].index = i;
+        numRegs++;
+    }
+
+    qsort(regs, numRegs, sizeof(I2cRegister), _CompareRegisters);
+    for (i = 0, j = 0; i < numRegs; ) {
+        length = 1;
+        while (i + length < numRegs &&
+               _SameRegister(&regs[i], &regs[i + length])) {
+            // The last write sets the value the register is left with
+            if (regs[i + length].index > regs[i].index) {
+                regs[i].index = regs[i + length].index;
+            }
+            length++;
+        }
+        if (length == 1 || !excludeRepeated) {
+            regs[j++] = regs[i];
+        }
+        i += length;
+    }
+
+    return j;
+}
+
+/* Reads back runs of consecutive registers and marks the writes whose value
+ * is already in place */
+static NvMediaStatus
+_ReadWarmRegisters(I2cCommands *allCommands, I2cRegister *regs,
+                   uint32_t numRegs, NvMediaBool *unchanged)
+{
+    WarmBus buses[MAX_I2C_PARTITIONS];
+    uint8_t subAddress[2];
+    uint8_t data[MAX_BURST_LENGTH];
+    NvMediaStatus status = NVMEDIA_STATUS_OK;
+    uint32_t numBuses = 0;
+    uint32_t i, j, length;
+    I2cHandle handle;
+    Command *cmd;
+    int result;
+
+    for (i = 0; i < numRegs; i += length) {
+        length = 1;
+        while (i + length < numRegs && length < MAX_BURST_LENGTH &&
+               regs[i + length].i2cDevice == regs[i].i2cDevice &&
+               regs[i + length].deviceAddress == regs[i].deviceAddress &&
+               regs[i + length].subAddressLength == regs[i].subAddressLength &&
+               regs[i + length].subAddress == regs[i].subAddress + length) {
+            length++;
+        }
+
+        handle = _GetWarmBus(buses, &numBuses, regs[i].i2cDevice);
+        if (!handle) {
+            LOG_WARN("%s: Cannot open I2C %d\n", __func__, regs[i].i2cDevice);
+            status = NVMEDIA_STATUS_ERROR;
+            break;
+        }
+
+        memcpy(subAddress, allCommands->commands[regs[i].index].buffer,
+               regs[i].subAddressLength);
+        I2cBusLock(regs[i].i2cDevice);
+        result = I2cBusRead(handle, regs[i].deviceAddress, subAddress,
+                            regs[i].subAddressLength, data, length);
+        I2cBusUnlock(regs[i].i2cDevice);
+        if (result) {
+            LOG_WARN("%s: Failed to read %u registers from %02x at %x\n",
+                     __func__, length, regs[i].deviceAddress << 1,
+                     regs[i].subAddress);
+            status = NVMEDIA_STATUS_ERROR;
+            break;
+        }
+
+        for (j = 0; j < length; j++) {
+            cmd = &allCommands->commands[regs[i + j].index];
+            if (cmd->buffer[regs[i + j].subAddressLength] == data[j]) {
+                unchanged[regs[i + j].index] = NVMEDIA_TRUE;
+            }
+        }
+    }
+
+    for (i = 0; i < numBuses; i++) {
+        I2cBusClose(buses[i].handle);
+    }
+    return status;
+}
+
+NvMediaStatus
+I2cWarmStart(I2cCommands *allCommands,
+             int i2cDevice)
+{
+    NvMediaBool wroteSinceDelay[PRESET_REG + 1];
+    NvMediaBool *drop = NULL;
+    I2cRegister *regs = NULL;
+    NvMediaStatus status = NVMEDIA_STATUS_OK;
+    uint32_t numRegs, numUnchanged = 0, numDelays = 0;
+    uint32_t in, out = 0;
+    Command *cmd;
+
+    if (!allCommands->numCommands) {
+        return NVMEDIA_STATUS_OK;
+    }
+
+    regs = malloc(allCommands->numCommands * sizeof(I2cRegister));
+    drop = calloc(allCommands->numCommands, sizeof(NvMediaBool));
+    if (!regs || !drop) {
+        LOG_ERR("%s: Out of memory\n", __func__);
+        status = NVMEDIA_STATUS_OUT_OF_MEMORY;
+        goto done;
+    }
+
+    // Repeated writes are a sequence the hardware must see every time
+    numRegs = I2cListRegisters(allCommands, i2cDevice, regs, NVMEDIA_TRUE);
+    if (_ReadWarmRegisters(allCommands, regs, numRegs, drop) !=
+        NVMEDIA_STATUS_OK) {
+        LOG_WARN("%s: Read back failed, writing all registers\n", __func__);
+        goto done;
+    }
+
+    /* A delay only lets preceding writes settle, so drop those that
+     * follow no write. This includes the power-up waits. */
+    memset(wroteSinceDelay, 0, sizeof(wroteSinceDelay));
+    for (in = 0; in < allCommands->numCommands; in++) {
+        cmd = &allCommands->commands[in];
+        if (cmd->processType == GROUP_REG) {
+            continue;
+        }
+        if (drop[in]) {
+            numUnchanged++;
+        } else if (cmd->commandType == DELAY) {
+            drop[in] = !wroteSinceDelay[cmd->processType];
+            numDelays += drop[in];
+            wroteSinceDelay[cmd->processType] = NVMEDIA_FALSE;
+        } else if (_SubAddressLength(cmd) ||
+                   cmd->commandType == READ_WRITE_REG_1 ||
+                   cmd->commandType == READ_WRITE_REG_2 ||
+                   cmd->commandType == BOSON_CMD) {
+            wroteSinceDelay[cmd->processType] = NVMEDIA_TRUE;
+        }
+    }
+
+    for (in = 0; in < allCommands->numCommands; in++) {
+        if (drop[in]) {
+            continue;
+        }
+        if (out != in) {
+            allCommands->commands[out] = allCommands->commands[in];
+        }
+        out++;
+    }
+    allCommands->numCommands = out;
+
+    LOG_MSG("Warm start: %u of %u compared registers unchanged, %u delays skipped\n",
+            numUnchanged, numRegs, numDelays);
+
+done:
+    free(regs);
+    free(drop);
+    return status;
+}
+
+NvMediaStatus
+I2cChangedRegisters(I2cCommands *allCommands,
+                    int i2cDevice,
+                    uint32_t skipDevice,
+                    I2cCommands *changed)
+{
+    NvMediaBool *unchanged = NULL;
+    I2cRegister *regs = NULL;
+    NvMediaStatus status = NVMEDIA_STATUS_OK;
+    uint32_t numRegs, i, j;
+    int bus = i2cDevice;
+    Command *cmd;
+
+    if (!allCommands->numCommands) {
+        return NVMEDIA_STATUS_OK;
+    }
+
+    regs = malloc(allCommands->numCommands * sizeof(I2cRegister));
+    unchanged = calloc(allCommands->numCommands, sizeof(NvMediaBool));
+    if (!regs || !unchanged) {
+        LOG_ERR("%s: Out of memory\n", __func__);
+        status = NVMEDIA_STATUS_OUT_OF_MEMORY;
+        goto done;
+    }
+
+    numRegs = I2cListRegisters(allCommands, i2cDevice, regs, NVMEDIA_FALSE);
+    for (i = 0, j = 0; i < numRegs; i++) {
+        if (regs[i].deviceAddress != skipDevice) {
+            regs[j++] = regs[i];
+        }
+    }
+    numRegs = j;
+
+    status = _ReadWarmRegisters(allCommands, regs, numRegs, unchanged);
+    if (status != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: Failed to read back the registers\n", __func__);
+        goto done;
+    }
+
+    // Room for a bus change before every register
+    status = I2cReserveCommands(changed, changed->numCommands + 2 * numRegs);
+    if (status != NVMEDIA_STATUS_OK) {
+        goto done;
+    }
+    for (i = 0; i < numRegs; i++) {
+        if (unchanged[regs[i].index]) {
+            continue;
+        }
+        if (regs[i].i2cDevice != bus) {
+            bus = regs[i].i2cDevice;
+            cmd = &changed->commands[changed->numCommands++];
+            memset(cmd, 0, sizeof(Command));
+            cmd->commandType = I2C_DEVICE;
+            cmd->i2cDevice = bus;
+        }
+        cmd = &changed->commands[changed->numCommands++];
+        *cmd = allCommands->commands[regs[i].index];
+        cmd->processType = DEFAULT;
+    }
+
+done:
+    free(regs);
+    free(unchanged);
+    return status;
+}
+
+NvMediaStatus
+I2cReserveCommands(I2cCommands *allCommands,
+                   uint32_t numCommands)
+{
+    Command *commands;
+    uint32_t maxCommands;
+
+    if (numCommands <= allCommands->maxCommands) {
+        return NVMEDIA_STATUS_OK;
+    }
+
+    maxCommands = allCommands->maxCommands ? allCommands->maxCommands :
+                                             INITIAL_NUM_COMMANDS;
+    while (maxCommands < numCommands) {
+        if (maxCommands > UINT32_MAX / 2) {
+            maxCommands = numCommands;
+            break;
+        }
+        maxCommands *= 2;
+    }
+    if ((size_t)maxCommands > SIZE_MAX / sizeof(Command)) {
+        LOG_ERR("%s: Too many commands (%u)\n", __func__, numCommands);
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+
+    commands = realloc(allCommands->commands, maxCommands * sizeof(Command));
+    if (!commands) {
+        LOG_ERR("%s: Failed to allocate %u commands\n", __func__, maxCommands);
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+    memset(&commands[allCommands->maxCommands], 0,
+           (maxCommands - allCommands->maxCommands) * sizeof(Command));
+
+    allCommands->commands = commands;
+    allCommands->maxCommands = maxCommands;
+    return NVMEDIA_STATUS_OK;
+}
+
+void
+I2cTrimCommands(I2cCommands *allCommands)
+{
+    Command *commands;
+
+    if (allCommands->numCommands == allCommands->maxCommands) {
+        return;
+    }
+    if (!allCommands->numCommands) {
+        I2cFreeCommands(allCommands);
+        return;
+    }
+
+    // Keep the larger block if it cannot be shrunk
+    commands = realloc(allCommands->commands,
+                       allCommands->numCommands * sizeof(Command));
+    if (commands) {
+        allCommands->commands = commands;
+        allCommands->maxCommands = allCommands->numCommands;
+    }
+}
+
+void
+I2cFreeCommands(I2cCommands *allCommands)
+{
+    free(allCommands->commands);
+    allCommands->commands = NULL;
+    allCommands->numCommands = 0;
+    allCommands->maxCommands = 0;
+}
+
+static NvMediaBool
+_IsSetting(Command *cmd)
+{
+    if (cmd->processType == GROUP_REG) {
+        return NVMEDIA_FALSE;
+    }
+    switch (cmd->commandType) {
+        case(I2C_DEVICE):
+        case(I2C_ERR):
+        case(BURST_CFG):
+        case(WRITE_SPACING):
+        case(LINK_SEL_CFG):
+            return NVMEDIA_TRUE;
+        default:
+            return NVMEDIA_FALSE;
+    }
+}
+
+NvMediaStatus
+I2cCopySettings(I2cCommands *dst,
+                I2cCommands *src)
+{
+    uint32_t i, numSettings = 0;
+    Command *cmd;
+
+    for (i = 0; i < src->numCommands; i++) {
+        numSettings += _IsSetting(&src->commands[i]);
+    }
+    if (I2cReserveCommands(dst, dst->numCommands + numSettings) !=
+        NVMEDIA_STATUS_OK) {
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+
+    for (i = 0; i < src->numCommands; i++) {
+        cmd = &src->commands[i];
+        if (_IsSetting(cmd)) {
+            dst->commands[dst->numCommands++] = *cmd;
+        }
+    }
+    return NVMEDIA_STATUS_OK;
+}
+
+Command *
+I2cFindLinkSelect(I2cCommands *allCommands)
+{
+    Command *linkSelect = NULL;
+    uint32_t i;
+
+    for (i = 0; i < allCommands->numCommands; i++) {
+        if (allCommands->commands[i].commandType == LINK_SEL_CFG) {
+            linkSelect = &allCommands->commands[i];
+        }
+    }
+    return linkSelect;
+}
+
+NvMediaStatus
+I2cAppendDevice(I2cCommands *dst,
+                I2cCommands *src,
+                uint32_t deviceAddress)
+{
+    NvMediaBool copied = NVMEDIA_FALSE;
+    uint32_t i;
+    Command *cmd;
+
+    if (I2cReserveCommands(dst, dst->numCommands + src->numCommands) !=
+        NVMEDIA_STATUS_OK) {
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+
+    for (i = 0; i < src->numCommands; i++) {
+        cmd = &src->commands[i];
+        if (cmd->processType != DEFAULT) {
+            continue;
+        }
+        switch (cmd->commandType) {
+            case(WRITE_REG_1):
+            case(WRITE_REG_2):
+            case(READ_WRITE_REG_1):
+            case(READ_WRITE_REG_2):
+            case(BOSON_CMD):
+            case(POLL_REG):
+                copied = cmd->deviceAddress == deviceAddress;
+                break;
+            case(DELAY):
+                // Settling time of the device, kept after its own writes
+                break;
+            default:
+                continue;
+        }
+        if (copied) {
+            dst->commands[dst->numCommands++] = *cmd;
+        }
+    }
+    return NVMEDIA_STATUS_OK;
+}
+
+NvMediaStatus
+I2cAppendLinkScripts(I2cCommands *allCommands,
+                     I2cCommands *linkCommands,
+                     uint32_t *links,
+                     uint32_t numLinks)
+{
+    uint32_t i, j, numCommands = allCommands->numCommands + 3;
+    Command *linkSelect = I2cFindLinkSelect(allCommands);
+    Command *cmd;
+
+    if (!linkSelect) {
+        LOG_ERR("%s: Link scripts need a '; Link select' line in the main script\n",
+                __func__);
+        return NVMEDIA_STATUS_BAD_PARAMETER;
+    }
+
+    for (i = 0; i < numLinks; i++) {
+        if (links[i] >= linkSelect->dataLength) {
+            LOG_ERR("%s: '; Link select' has no value for link %u\n",
+                    __func__, links[i]);
+            return NVMEDIA_STATUS_BAD_PARAMETER;
+        }
+        for (j = 0; j < linkCommands[i].numCommands; j++) {
+            cmd = &linkCommands[i].commands[j];
+            switch (cmd->commandType) {
+                case(SECTION_START):
+                case(LINK_SEL):
+                case(LINK_SEL_CFG):
+                case(BARRIER):
+                    LOG_ERR("%s: Script of link %u may not wait for frames, "
+                            "select links or hold barriers\n", __func__, links[i]);
+                    return NVMEDIA_STATUS_BAD_PARAMETER;
+                case(WRITE_REG_1):
+                case(WRITE_REG_2):
+                case(READ_WRITE_REG_1):
+                case(READ_WRITE_REG_2):
+                    if (cmd->deviceAddress == linkSelect->deviceAddress) {
+                        LOG_ERR("%s: Script of link %u writes the deserializer "
+                                "%02x shared by all links\n", __func__, links[i],
+                                cmd->deviceAddress << 1);
+                        return NVMEDIA_STATUS_BAD_PARAMETER;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        numCommands += linkCommands[i].numCommands + 1;
+    }
+
+    if (I2cReserveCommands(allCommands, numCommands) != NVMEDIA_STATUS_OK) {
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+
+    cmd = &allCommands->commands[allCommands->numCommands];
+    cmd++->commandType = BARRIER;
+    for (i = 0; i < numLinks; i++) {
+        cmd->commandType = LINK_SEL;
+        cmd++->link = links[i];
+        memcpy(cmd, linkCommands[i].commands,
+               linkCommands[i].numCommands * sizeof(Command));
+        cmd += linkCommands[i].numCommands;
+    }
+    cmd->commandType = LINK_SEL;
+    cmd++->link = I2C_LINK_ALL;
+    cmd->commandType = BARRIER;
+
+    allCommands->numCommands = numCommands;
+    return NVMEDIA_STATUS_OK;
+}
 
 NvMediaStatus
 I2cSetupGroups(I2cCommands *allCommands,
@@ -55,18 +814,249 @@ I2cSetupGroups(I2cCommands *allCommands,
     return NVMEDIA_STATUS_OK;
 }
 
+typedef struct {
+    uint32_t                    deviceAddress;
+    uint32_t                    spacing;      // us
+    uint64_t                    lastWrite;    // ns, 0 until the first write
+} DeviceSpacing;
+
+/* Settings carried from one command to the next while processing */
+typedef struct {
+    NvMediaBool                 checkI2cErr;
+    DeviceSpacing               devices[MAX_SPACED_DEVICES];
+    uint32_t                    numDevices;
+    Command                    *linkSelect;   // last "; Link select"
+    uint32_t                    selectedLink;
+    int                         lockedBus;    // released across delays, -1 if none
+    I2cTimingStats             *stats;
+} ProcessState;
+
+static uint64_t
+_NowNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static DeviceSpacing *
+_GetDeviceSpacing(ProcessState *state, uint32_t deviceAddress)
+{
+    DeviceSpacing *device;
+    uint32_t i;
+
+    for (i = 0; i < state->numDevices; i++) {
+        if (state->devices[i].deviceAddress == deviceAddress) {
+            return &state->devices[i];
+        }
+    }
+    if (state->numDevices == MAX_SPACED_DEVICES) {
+        return NULL;
+    }
+
+    device = &state->devices[state->numDevices++];
+    device->deviceAddress = deviceAddress;
+    device->spacing = DEFAULT_WRITE_SPACING;
+    device->lastWrite = 0;
+    return device;
+}
+
+static void
+_SetWriteSpacing(ProcessState *state, Command *cmd)
+{
+    DeviceSpacing *device = _GetDeviceSpacing(state, cmd->deviceAddress);
+
+    if (!device) {
+        LOG_WARN("%s: Too many devices, using default spacing for %02x\n",
+                 __func__, cmd->deviceAddress << 1);
+        return;
+    }
+    memcpy(&device->spacing, cmd->buffer, sizeof(uint32_t));
+}
+
+/* Writes once the device's minimum spacing has elapsed since its last write */
+static int
+_SpacedWrite(I2cHandle handle, ProcessState *state, uint32_t deviceAddress,
+             uint8_t *data, uint32_t length)
+{
+    DeviceSpacing *device = _GetDeviceSpacing(state, deviceAddress);
+    uint64_t start = _NowNs();
+    uint64_t end, elapsed;
+    uint32_t wait;
+    int err;
+
+    if (!device) {
+        wait = DEFAULT_WRITE_SPACING;
+    } else if (device->lastWrite) {
+        elapsed = (start - device->lastWrite) / 1000;
+        wait = (elapsed < device->spacing) ? device->spacing - elapsed : 0;
+    } else {
+        wait = 0;
+    }
+
+    if (wait) {
+        nvsleep(wait);
+        end = _NowNs();
+        state->stats->spacingNs += end - start;
+        start = end;
+    }
+
+    err = I2cBusWrite(handle, deviceAddress, data, length);
+    end = _NowNs();
+    state->stats->transferNs += end - start;
+    state->stats->numWrites++;
+    if (device) {
+        device->lastWrite = end;
+    }
+
+    return err;
+}
+
+static int
+_TimedRead(I2cHandle handle, ProcessState *state, uint32_t deviceAddress,
+           uint8_t *subAddress, uint32_t subAddressLength, uint8_t *data)
+{
+    uint64_t start = _NowNs();
+    int err;
+
+    err = I2cBusRead(handle, deviceAddress, subAddress, subAddressLength,
+                     data, sizeof(char));
+    state->stats->transferNs += _NowNs() - start;
+    state->stats->numReads++;
+
+    return err;
+}
+
+/* Reads a register until its masked value matches or the timeout expires */
+static NvMediaBool
+_PollRegister(I2cHandle handle, Command *cmd)
+{
+    uint64_t start = _NowNs();
+    uint8_t value = cmd->buffer[2];
+    uint8_t mask = cmd->buffer[3];
+    uint32_t timeout;
+    uint32_t elapsed;
+    uint8_t data = 0;
+    int err;
+
+    memcpy(&timeout, &cmd->buffer[4], sizeof(uint32_t));
+
+    for (;;) {
+        // Read failures are expected while the device is still coming up
+        err = I2cBusRead(handle, cmd->deviceAddress, cmd->buffer,
+                         cmd->dataLength, &data, sizeof(char));
+        elapsed = (uint32_t)((_NowNs() - start) / 1000);
+        if (!err && (data & mask) == (value & mask)) {
+            LOG_DBG("%s: %02x ready after %u us\n", __func__,
+                    cmd->deviceAddress << 1, elapsed);
+            return NVMEDIA_TRUE;
+        }
+        if (elapsed >= timeout) {
+            break;
+        }
+        nvsleep(POLL_INTERVAL);
+    }
+
+    if (err) {
+        LOG_WARN("%s: %02x did not respond within %u us\n", __func__,
+                 cmd->deviceAddress << 1, timeout);
+    } else {
+        LOG_WARN("%s: %02x register reads %02x, expected %02x/%02x after %u us\n",
+                 __func__, cmd->deviceAddress << 1, data, value, mask, timeout);
+    }
+    return NVMEDIA_FALSE;
+}
+
+/* Addresses one GMSL link, or every link with I2C_LINK_ALL, by writing the
+ * "; Link select" register */
+static NvMediaStatus
+_SelectLink(I2cHandle handle, ProcessState *state, uint32_t link)
+{
+    Command *cfg = state->linkSelect;
+    uint32_t length;
+    uint8_t data[3];
+
+    if (!cfg) {
+        LOG_ERR("%s: '; Link %u' needs a '; Link select' line\n", __func__, link);
+        return NVMEDIA_STATUS_ERROR;
+    }
+    if (link != I2C_LINK_ALL && link >= cfg->dataLength) {
+        LOG_ERR("%s: '; Link select' has no value for link %u\n", __func__, link);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    length = cfg->buffer[LINK_SEL_SUB_LENGTH];
+    memcpy(data, &cfg->buffer[LINK_SEL_SUB_ADDRESS + 2 - length], length);
+    data[length] = (link == I2C_LINK_ALL) ? cfg->buffer[LINK_SEL_ALL] :
+                                            cfg->buffer[LINK_SEL_VALUES + link];
+    if (_SpacedWrite(handle, state, cfg->deviceAddress, data, length + 1)) {
+        LOG_ERR("%s: Failed to select link %u through %02x\n", __func__, link,
+                cfg->deviceAddress << 1);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    state->selectedLink = link;
+    return NVMEDIA_STATUS_OK;
+}
+
+/* Sleeps without holding the bus, so that the other links behind the
+ * deserializer and other threads can use it meanwhile. Every link is
+ * addressed while the bus is released. */
+static NvMediaStatus
+_DelayUnlocked(I2cHandle handle, ProcessState *state, uint32_t delay)
+{
+    uint32_t link = state->selectedLink;
+
+    if (state->lockedBus < 0) {
+        nvsleep(delay);
+        return NVMEDIA_STATUS_OK;
+    }
+
+    if (link != I2C_LINK_ALL &&
+        _SelectLink(handle, state, I2C_LINK_ALL) != NVMEDIA_STATUS_OK) {
+        return NVMEDIA_STATUS_ERROR;
+    }
+    I2cBusUnlock(state->lockedBus);
+    nvsleep(delay);
+    I2cBusLock(state->lockedBus);
+    if (link != I2C_LINK_ALL) {
+        return _SelectLink(handle, state, link);
+    }
+
+    return NVMEDIA_STATUS_OK;
+}
+
 static NvMediaStatus
 ProcessCommands(I2cHandle handle, unsigned int startCmd, unsigned int stopCmd,
-                I2cCommands *allCommands, I2cOperation operation, ProcessType type)
+                I2cCommands *allCommands, I2cOperation operation, ProcessType type,
+                ProcessState *state, const uint8_t *partitionOf, uint8_t partition)
 {
     Command *cmd = NULL;
     uint32_t  i = 0;
-    NvMediaBool checkI2cErr = NVMEDIA_TRUE;
     uint8_t readWriteData = 0;
+    uint64_t start;
+    NvMediaBool pollReady;
+    NvMediaStatus status;
 
     for (i = startCmd; i < stopCmd; i++) {
         cmd = &allCommands->commands[i];
 
+        if (partitionOf && partitionOf[i] != partition &&
+            partitionOf[i] != I2C_PARTITION_ALL) {
+            continue;
+        }
+
+        // Spacing and link selection apply to every section that follows
+        if (cmd->commandType == WRITE_SPACING) {
+            _SetWriteSpacing(state, cmd);
+            continue;
+        }
+        if (cmd->commandType == LINK_SEL_CFG) {
+            state->linkSelect = cmd;
+            continue;
+        }
+
         if(cmd->processType != type && operation == I2C_WRITE) {
             continue;
         }
@@ -75,8 +1065,8 @@ ProcessCommands(I2cHandle handle, unsigned int startCmd, unsigned int stopCmd,
             case(I2C_DEVICE):
                 if (operation == I2C_WRITE) {
                     if (handle)
-                        testutil_i2c_close(handle);
-                    testutil_i2c_open(cmd->i2cDevice, &handle);
+                        I2cBusClose(handle);
+                    I2cBusOpen(cmd->i2cDevice, &handle);
                     if (!handle) {
                         LOG_ERR("%s: Failed to open handle with id %u\n",
                                 __func__, cmd->i2cDevice);
@@ -88,20 +1078,24 @@ ProcessCommands(I2cHandle handle, unsigned int startCmd, unsigned int stopCmd,
                 break;
             case(I2C_ERR):
                 if (operation == I2C_WRITE)
-                    checkI2cErr = cmd->i2cErr;
+                    state->checkI2cErr = cmd->i2cErr;
                 break;
             case(DELAY):
                 if (operation == I2C_WRITE) {
-                    nvsleep(cmd->delay);
+                    start = _NowNs();
+                    status = _DelayUnlocked(handle, state, cmd->delay);
+                    state->stats->delayNs += _NowNs() - start;
+                    if (status != NVMEDIA_STATUS_OK) {
+                        return NVMEDIA_STATUS_ERROR;
+                    }
                 }
                 break;
             case(WRITE_REG_1):
                 if (operation == I2C_WRITE) {
-                    nvsleep(5);
-                    if (testutil_i2c_write_subaddr(handle,
+                    if (_SpacedWrite(handle, state,
                        cmd->deviceAddress,
                        cmd->buffer,
-                       cmd->dataLength + 1) && checkI2cErr)
+                       cmd->dataLength + 1) && state->checkI2cErr)
                     {
                         LOG_ERR("%s: Failed to write to I2C %02x %02x %02x",
                                 __func__, cmd->deviceAddress,
@@ -117,12 +1111,11 @@ ProcessCommands(I2cHandle handle, unsigned int startCmd, unsigned int stopCmd,
                 // or to read after a write (only in DEBUG mode)
             case(READ_REG_1):
                 // Reads one byte data ONLY
-                if (testutil_i2c_read_subaddr(handle,
+                if (_TimedRead(handle, state,
                             cmd->deviceAddress,
                             cmd->buffer,
                             sizeof(char),
-                            &cmd->buffer[1],
-                            sizeof(char)) && checkI2cErr)
+                            &cmd->buffer[1]) && state->checkI2cErr)
                 {
                     LOG_ERR("%s: Failed to read I2C %02x %02x",
                             __func__, cmd->deviceAddress,
@@ -138,11 +1131,10 @@ ProcessCommands(I2cHandle handle, unsigned int startCmd, unsigned int stopCmd,
                 break;
             case(WRITE_REG_2):
                 if (operation == I2C_WRITE) {
-                    nvsleep(5);
-                    if (testutil_i2c_write_subaddr(handle,
+                    if (_SpacedWrite(handle, state,
                                 cmd->deviceAddress,
                                 cmd->buffer,
-                                cmd->dataLength + 2) && checkI2cErr)
+                                cmd->dataLength + 2) && state->checkI2cErr)
                     {
                         LOG_ERR("%s: Failed to write to I2C %02x %02x%02x %02x",
                                 __func__, cmd->deviceAddress,
@@ -159,12 +1151,11 @@ ProcessCommands(I2cHandle handle, unsigned int startCmd, unsigned int stopCmd,
                 // or to read after a write (only in DEBUG mode)
             case(READ_REG_2):
                 // Reads one byte data ONLY
-                if (testutil_i2c_read_subaddr(handle,
+                if (_TimedRead(handle, state,
                             cmd->deviceAddress,
                             cmd->buffer,
                             sizeof(char)*2,
-                            &cmd->buffer[2],
-                            sizeof(char)) && checkI2cErr)
+                            &cmd->buffer[2]) && state->checkI2cErr)
                 {
                     LOG_ERR("%s: Failed to read I2C %02x %02x%02x",
                             __func__, cmd->deviceAddress,
@@ -181,12 +1172,11 @@ ProcessCommands(I2cHandle handle, unsigned int startCmd, unsigned int stopCmd,
                 break;
             case(READ_WRITE_REG_1):
                 // Read-writes one byte data ONLY
-                if (testutil_i2c_read_subaddr(handle,
+                if (_TimedRead(handle, state,
                             cmd->deviceAddress,
                             cmd->buffer,
                             sizeof(char),
-                            &readWriteData,
-                            sizeof(char)) && checkI2cErr)
+                            &readWriteData) && state->checkI2cErr)
                 {
                     LOG_ERR("%s: Failed to read I2C %02x %02x",
                             __func__, cmd->deviceAddress,
@@ -200,11 +1190,10 @@ ProcessCommands(I2cHandle handle, unsigned int startCmd, unsigned int stopCmd,
                         readWriteData);
 #endif
                 cmd->buffer[2] = readWriteData;
-                nvsleep(5);
-                if (testutil_i2c_write_subaddr(handle,
+                if (_SpacedWrite(handle, state,
                    cmd->deviceAddress,
                    &cmd->buffer[1],
-                   cmd->dataLength + 1) && checkI2cErr)
+                   cmd->dataLength + 1) && state->checkI2cErr)
                 {
                     LOG_ERR("%s: Failed to write to I2C %02x %02x %02x",
                             __func__, cmd->deviceAddress,
@@ -215,12 +1204,11 @@ ProcessCommands(I2cHandle handle, unsigned int startCmd, unsigned int stopCmd,
                 break;
             case(READ_WRITE_REG_2):
                 // Read-writes one byte data ONLY
-                if (testutil_i2c_read_subaddr(handle,
+                if (_TimedRead(handle, state,
                             cmd->deviceAddress,
                             cmd->buffer,
                             sizeof(char)*2,
-                            &readWriteData,
-                            sizeof(char)) && checkI2cErr)
+                            &readWriteData) && state->checkI2cErr)
                 {
                     LOG_ERR("%s: Failed to read I2C %02x %02x%02x",
                             __func__, cmd->deviceAddress,
@@ -236,11 +1224,10 @@ ProcessCommands(I2cHandle handle, unsigned int startCmd, unsigned int stopCmd,
                         readWriteData);
 #endif
                 cmd->buffer[4] = readWriteData;
-                nvsleep(5);
-                if (testutil_i2c_write_subaddr(handle,
+                if (_SpacedWrite(handle, state,
                             cmd->deviceAddress,
                             &cmd->buffer[2],
-                            cmd->dataLength + 2) && checkI2cErr)
+                            cmd->dataLength + 2) && state->checkI2cErr)
                 {
                     LOG_ERR("%s: Failed to write to I2C %02x %02x%02x %02x",
                             __func__, cmd->deviceAddress,
@@ -250,8 +1237,41 @@ ProcessCommands(I2cHandle handle, unsigned int startCmd, unsigned int stopCmd,
                     return NVMEDIA_STATUS_ERROR;
                 }
                 break;
+            case(BOSON_CMD):
+                if (operation == I2C_WRITE) {
+                    start = _NowNs();
+                    status = _ProcessBosonBatch(handle, allCommands, &i,
+                                                stopCmd, type);
+                    state->stats->bosonNs += _NowNs() - start;
+                    if (status != NVMEDIA_STATUS_OK && state->checkI2cErr) {
+                        return NVMEDIA_STATUS_ERROR;
+                    }
+                }
+                break;
+            case(POLL_REG):
+                if (operation == I2C_WRITE) {
+                    // A timeout fails bring-up unless I2C errors are ignored
+                    start = _NowNs();
+                    pollReady = _PollRegister(handle, cmd);
+                    state->stats->pollNs += _NowNs() - start;
+                    if (!pollReady && state->checkI2cErr) {
+                        LOG_ERR("%s: Poll of %02x timed out\n", __func__,
+                                cmd->deviceAddress << 1);
+                        return NVMEDIA_STATUS_ERROR;
+                    }
+                }
+                break;
+            case(LINK_SEL):
+                if (operation == I2C_WRITE &&
+                    _SelectLink(handle, state, cmd->link) != NVMEDIA_STATUS_OK) {
+                    return NVMEDIA_STATUS_ERROR;
+                }
+                break;
             case(SECTION_START):
             case(SECTION_STOP):
+            case(BURST_CFG):
+            case(BARRIER):
+            case(WARM_SKIP):
                 // Do nothing
                 break;
             default:
@@ -260,43 +1280,370 @@ ProcessCommands(I2cHandle handle, unsigned int startCmd, unsigned int stopCmd,
         }
     }
 
+    // Commands that follow, and other writers, address every link again
+    if (state->selectedLink != I2C_LINK_ALL) {
+        return _SelectLink(handle, state, I2C_LINK_ALL);
+    }
+
     return NVMEDIA_STATUS_OK;
 }
 
-NvMediaStatus
-I2cProcessInitialRegisters(I2cCommands *allCommands, int i2cDevice)
+static void
+_InitProcessState(ProcessState *state, I2cTimingStats *stats)
+{
+    memset(state, 0, sizeof(ProcessState));
+    state->checkI2cErr = NVMEDIA_TRUE;
+    state->selectedLink = I2C_LINK_ALL;
+    state->lockedBus = -1;
+    state->stats = stats;
+}
+
+static void
+_AddTimingStats(I2cTimingStats *total, I2cTimingStats *stats)
 {
+    total->numWrites += stats->numWrites;
+    total->numReads += stats->numReads;
+    total->transferNs += stats->transferNs;
+    total->spacingNs += stats->spacingNs;
+    total->delayNs += stats->delayNs;
+    total->bosonNs += stats->bosonNs;
+    total->pollNs += stats->pollNs;
+}
+
+/* Takes over the settings of a partition once it has finished. Broadcast
+ * commands left them identical in all partitions, except for the time of
+ * the last write to each device. */
+static void
+_MergeProcessState(ProcessState *state, ProcessState *partState)
+{
+    DeviceSpacing *device;
+    uint32_t i;
+
+    state->checkI2cErr = partState->checkI2cErr;
+    state->linkSelect = partState->linkSelect;
+    for (i = 0; i < partState->numDevices; i++) {
+        device = _GetDeviceSpacing(state, partState->devices[i].deviceAddress);
+        if (!device) {
+            continue;
+        }
+        device->spacing = partState->devices[i].spacing;
+        if (partState->devices[i].lastWrite > device->lastWrite) {
+            device->lastWrite = partState->devices[i].lastWrite;
+        }
+    }
+}
+
+typedef struct {
+    I2cCommands                *allCommands;
+    ProcessType                 type;
+    uint32_t                    startCmd;
+    uint32_t                    stopCmd;
+    const uint8_t              *partitionOf;
+    uint8_t                     partition;
+    int                         i2cDevice;
+    uint32_t                    link;         // I2C_LINK_ALL for the whole bus
+    ProcessState                state;
+    I2cTimingStats              stats;
+    NvThread                   *thread;
+    NvMediaStatus               status;
+} I2cPartition;
+
+static uint32_t
+_PartitionThreadFunc(void *data)
+{
+    I2cPartition *part = (I2cPartition *)data;
     I2cHandle handle = NULL;
-    NvMediaStatus status;
 
-    testutil_i2c_open(i2cDevice, &handle);
+    I2cBusOpen(part->i2cDevice, &handle);
     if (!handle) {
         LOG_ERR("%s: Failed to open handle with id %u\n", __func__,
-                i2cDevice);
-        return NVMEDIA_STATUS_ERROR;
+                part->i2cDevice);
+        part->status = NVMEDIA_STATUS_ERROR;
+        return 0;
+    }
+
+    // Keep the bus until the barrier, except while waiting on a delay
+    part->state.lockedBus = part->i2cDevice;
+    I2cBusLock(part->i2cDevice);
+    part->status = ProcessCommands(handle, part->startCmd, part->stopCmd,
+                                   part->allCommands, I2C_WRITE, part->type,
+                                   &part->state, part->partitionOf,
+                                   part->partition);
+    I2cBusUnlock(part->i2cDevice);
+    I2cBusClose(handle);
+
+    return 0;
+}
+
+/* Returns whether a bus has commands for every link between startCmd and
+ * the next barrier, other than selecting them. Those must keep their order
+ * with the commands of single links, so such a bus is not split by link. */
+static NvMediaBool
+_HasAllLinksCommands(I2cCommands *allCommands, ProcessType type,
+                     uint32_t startCmd, int i2cDevice, int bus)
+{
+    uint32_t link = I2C_LINK_ALL;
+    Command *cmd;
+    uint32_t i;
+
+    for (i = startCmd; i < allCommands->numCommands; i++) {
+        cmd = &allCommands->commands[i];
+        if (cmd->processType != type) {
+            continue;
+        }
+
+        switch (cmd->commandType) {
+            case(BARRIER):
+                return NVMEDIA_FALSE;
+            case(I2C_DEVICE):
+                i2cDevice = cmd->i2cDevice;
+                break;
+            case(LINK_SEL):
+                link = cmd->link;
+                break;
+            case(WRITE_SPACING):
+            case(LINK_SEL_CFG):
+            case(I2C_ERR):
+            case(BURST_CFG):
+            case(SECTION_START):
+            case(SECTION_STOP):
+            case(WARM_SKIP):
+                break;
+            default:
+                if (i2cDevice == bus && link == I2C_LINK_ALL) {
+                    return NVMEDIA_TRUE;
+                }
+                break;
+        }
+    }
+
+    return NVMEDIA_FALSE;
+}
+
+/* Assigns the commands up to the next barrier to one partition per bus, or
+ * per link on a bus where only single links are addressed. Links behind
+ * one deserializer then take turns on its bus, each selecting its link
+ * again, so that the delays of one link overlap the writes of the others.
+ * stopCmd is set to the barrier, or past the last command. */
+static NvMediaStatus
+_AssignPartitions(I2cCommands *allCommands, ProcessType type,
+                  uint32_t startCmd, uint32_t *stopCmd, uint8_t *partitionOf,
+                  I2cPartition *partitions, uint32_t *numPartitions,
+                  int *i2cDevice)
+{
+    NvMediaBool splitBus[MAX_I2C_PARTITIONS];
+    NvMediaBool split;
+    uint32_t link = I2C_LINK_ALL;
+    uint32_t partLink;
+    Command *cmd;
+    uint32_t i, j;
+
+    *numPartitions = 0;
+    for (i = startCmd; i < allCommands->numCommands; i++) {
+        cmd = &allCommands->commands[i];
+        partitionOf[i] = I2C_PARTITION_NONE;
+
+        if (cmd->commandType == WRITE_SPACING ||
+            cmd->commandType == LINK_SEL_CFG) {
+            partitionOf[i] = I2C_PARTITION_ALL;
+            continue;
+        }
+        if (cmd->processType != type) {
+            continue;
+        }
+
+        switch (cmd->commandType) {
+            case(BARRIER):
+                *stopCmd = i;
+                return NVMEDIA_STATUS_OK;
+            case(I2C_DEVICE):
+                *i2cDevice = cmd->i2cDevice;
+                break;
+            case(I2C_ERR):
+            case(BURST_CFG):
+                partitionOf[i] = I2C_PARTITION_ALL;
+                break;
+            case(SECTION_START):
+            case(SECTION_STOP):
+            case(WARM_SKIP):
+                break;
+            default:
+                if (cmd->commandType == LINK_SEL) {
+                    link = cmd->link;
+                }
+
+                // Whether the bus is split is decided when it is first seen
+                for (j = 0; j < *numPartitions; j++) {
+                    if (partitions[j].i2cDevice == *i2cDevice) {
+                        break;
+                    }
+                }
+                split = (j < *numPartitions) ? splitBus[j] :
+                        !_HasAllLinksCommands(allCommands, type, startCmd,
+                                              *i2cDevice, *i2cDevice);
+                partLink = split ? link : I2C_LINK_ALL;
+
+                // Each partition addresses every link again when it ends
+                if (split && cmd->commandType == LINK_SEL &&
+                    cmd->link == I2C_LINK_ALL) {
+                    break;
+                }
+
+                for (; j < *numPartitions; j++) {
+                    if (partitions[j].i2cDevice == *i2cDevice &&
+                        partitions[j].link == partLink) {
+                        break;
+                    }
+                }
+                if (j == *numPartitions) {
+                    if (j == MAX_I2C_PARTITIONS) {
+                        LOG_ERR("%s: More than %u buses and links between "
+                                "barriers\n", __func__, MAX_I2C_PARTITIONS);
+                        return NVMEDIA_STATUS_ERROR;
+                    }
+                    partitions[j].i2cDevice = *i2cDevice;
+                    partitions[j].link = partLink;
+                    splitBus[j] = split;
+                    (*numPartitions)++;
+                }
+                partitionOf[i] = (uint8_t)j;
+                break;
+        }
+    }
+
+    *stopCmd = i;
+    return NVMEDIA_STATUS_OK;
+}
+
+static NvMediaStatus
+_RunPartitions(I2cCommands *allCommands, ProcessType type, uint32_t startCmd,
+               uint32_t stopCmd, const uint8_t *partitionOf,
+               I2cPartition *partitions, uint32_t numPartitions,
+               ProcessState *state)
+{
+    NvMediaStatus status = NVMEDIA_STATUS_OK;
+    I2cPartition *part;
+    uint32_t numStarted = 0;
+    uint32_t i;
+
+    if (numPartitions > 1) {
+        LOG_DBG("%s: Running commands %u-%u in %u partitions\n", __func__,
+                startCmd, stopCmd, numPartitions);
+    }
+
+    for (i = 0; i < numPartitions; i++) {
+        part = &partitions[i];
+        part->allCommands = allCommands;
+        part->type = type;
+        part->startCmd = startCmd;
+        part->stopCmd = stopCmd;
+        part->partitionOf = partitionOf;
+        part->partition = (uint8_t)i;
+        part->status = NVMEDIA_STATUS_OK;
+        memset(&part->stats, 0, sizeof(I2cTimingStats));
+        part->state = *state;
+        part->state.stats = &part->stats;
+
+        // The last partition runs in the calling thread
+        if (i == numPartitions - 1) {
+            _PartitionThreadFunc(part);
+            continue;
+        }
+
+        status = NvThreadCreate(&part->thread, &_PartitionThreadFunc,
+                                (void *)part, NV_THREAD_PRIORITY_NORMAL);
+        if (status != NVMEDIA_STATUS_OK) {
+            LOG_ERR("%s: Failed to create partition thread %u\n", __func__, i);
+            break;
+        }
+        numStarted++;
     }
 
-    status = ProcessCommands(handle, 0, allCommands->numCommands, allCommands,
-                             I2C_WRITE, PRESET_REG);
+    for (i = 0; i < numStarted; i++) {
+        NvThreadDestroy(partitions[i].thread);
+    }
     if (status != NVMEDIA_STATUS_OK) {
-        goto done;
+        return status;
     }
 
-    status = NVMEDIA_STATUS_OK;
-done:
-    if (handle)
-        testutil_i2c_close(handle);
+    for (i = 0; i < numPartitions; i++) {
+        _AddTimingStats(state->stats, &partitions[i].stats);
+        _MergeProcessState(state, &partitions[i].state);
+        if (partitions[i].status != NVMEDIA_STATUS_OK) {
+            status = partitions[i].status;
+        }
+    }
+
+    return status;
+}
+
+/* Writes the commands of one process type, running the buses and links
+ * between two barriers concurrently */
+static NvMediaStatus
+_ProcessPartitioned(I2cCommands *allCommands, int i2cDevice, ProcessType type)
+{
+    I2cPartition partitions[MAX_I2C_PARTITIONS];
+    NvMediaStatus status = NVMEDIA_STATUS_OK;
+    uint8_t *partitionOf = NULL;
+    uint32_t numPartitions;
+    uint32_t startCmd, stopCmd;
+    ProcessState state;
+
+    if (!allCommands->numCommands) {
+        return NVMEDIA_STATUS_OK;
+    }
+
+    partitionOf = malloc(allCommands->numCommands);
+    if (!partitionOf) {
+        LOG_ERR("%s: Out of memory\n", __func__);
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+    _InitProcessState(&state, &allCommands->timing);
+
+    for (startCmd = 0; startCmd < allCommands->numCommands;
+         startCmd = stopCmd + 1) {
+        status = _AssignPartitions(allCommands, type, startCmd, &stopCmd,
+                                   partitionOf, partitions, &numPartitions,
+                                   &i2cDevice);
+        if (status != NVMEDIA_STATUS_OK) {
+            break;
+        }
+
+        if (numPartitions) {
+            status = _RunPartitions(allCommands, type, startCmd, stopCmd,
+                                    partitionOf, partitions, numPartitions,
+                                    &state);
+        } else {
+            // Only settings before this barrier
+            status = ProcessCommands(NULL, startCmd, stopCmd, allCommands,
+                                     I2C_WRITE, type, &state, partitionOf, 0);
+        }
+        if (status != NVMEDIA_STATUS_OK) {
+            break;
+        }
+    }
+
+    free(partitionOf);
     return status;
 }
 
+NvMediaStatus
+I2cProcessInitialRegisters(I2cCommands *allCommands, int i2cDevice)
+{
+    return _ProcessPartitioned(allCommands, i2cDevice, PRESET_REG);
+}
+
 NvMediaStatus
 I2cProcessGroup(I2cHandle handle, I2cCommands *allCommands, GroupData *grpData)
 {
+    ProcessState state;
     NvMediaStatus status;
 
+    _InitProcessState(&state, &allCommands->timing);
     status = ProcessCommands(handle, grpData->firstCommand,
                              (grpData->firstCommand + grpData->numCommands),
-                             allCommands, I2C_WRITE, GROUP_REG);
+                             allCommands, I2C_WRITE, GROUP_REG, &state,
+                             NULL, 0);
     if(status != NVMEDIA_STATUS_OK) {
         LOG_ERR("%s: Failed to write group registers\n", __func__);
     }
@@ -309,23 +1656,45 @@ I2cProcessCommands(I2cCommands *allCommands, I2cOperation operation,
                    int i2cDevice)
 {
     I2cHandle handle = NULL;
+    ProcessState state;
     NvMediaStatus status;
 
-    testutil_i2c_open(i2cDevice, &handle);
+    if (operation == I2C_WRITE) {
+        return _ProcessPartitioned(allCommands, i2cDevice, DEFAULT);
+    }
+
+    I2cBusOpen(i2cDevice, &handle);
     if(!handle) {
         LOG_ERR("%s: Failed to open handle with id %u\n", __func__,
                 i2cDevice);
         return NVMEDIA_STATUS_ERROR;
     }
 
+    _InitProcessState(&state, &allCommands->timing);
+    I2cBusLock(i2cDevice);
     status = ProcessCommands(handle, 0, allCommands->numCommands,
-                             allCommands, operation, DEFAULT);
+                             allCommands, operation, DEFAULT, &state, NULL, 0);
+    I2cBusUnlock(i2cDevice);
 
-    testutil_i2c_close(handle);
+    I2cBusClose(handle);
 
     return status;
 }
 
+void
+I2cPrintTimingStats(I2cCommands *allCommands)
+{
+    I2cTimingStats *stats = &allCommands->timing;
+
+    LOG_MSG("I2C timing: %u writes, %u reads\n", stats->numWrites,
+            stats->numReads);
+    LOG_MSG("  Bus transfers  %10.3f ms\n", stats->transferNs / 1e6);
+    LOG_MSG("  Write spacing  %10.3f ms\n", stats->spacingNs / 1e6);
+    LOG_MSG("  Script delays  %10.3f ms\n", stats->delayNs / 1e6);
+    LOG_MSG("  Boson commands %10.3f ms\n", stats->bosonNs / 1e6);
+    LOG_MSG("  Register polls %10.3f ms\n", stats->pollNs / 1e6);
+}
+
 uint8_t *
 I2cSetupRegister(I2cCommands *allCommands,
                  CommandType type,
@@ -337,8 +1706,8 @@ I2cSetupRegister(I2cCommands *allCommands,
     Command *cmd = NULL;
     uint8_t *data = NULL;
 
-    if (allCommands->numCommands >= MAX_NUM_COMMANDS) {
-        LOG_ERR("%s: Maximum number of commands reached\n");
+    if (I2cReserveCommands(allCommands, allCommands->numCommands + 1) !=
+        NVMEDIA_STATUS_OK) {
         return NULL;
     }
     cmd = &(allCommands->commands[allCommands->numCommands]);
@@ -402,8 +1771,9 @@ void
 I2cSetNumCommands(I2cCommands *allCommands,
     uint32_t setNumCommands)
 {
-    if (setNumCommands >= MAX_NUM_COMMANDS) {
-        LOG_ERR("%s: Maximum number of commands reached\n");
+    if (setNumCommands > allCommands->maxCommands) {
+        LOG_ERR("%s: Only %u commands allocated\n", __func__,
+                allCommands->maxCommands);
         return;
     }
 
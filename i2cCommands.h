@@ -27,8 +27,26 @@
 #include "log_utils.h"
 
 #define MAX_BUF_LENGTH          34   // to handle 32 byte data + 2 bytes sub address
-#define MAX_NUM_COMMANDS        10000
+#define INITIAL_NUM_COMMANDS    256  // first allocation, doubled when full
 #define MAX_NUM_GROUPS          10
+#define MAX_BURST_LENGTH        32   // data bytes in one coalesced write
+#define MAX_BURST_OPT_INS       16
+#define BURST_ALL_DEVICES       0xFF // BURST_CFG device of a bare "; Burst on|off"
+#define MAX_SPACED_DEVICES      16
+#define DEFAULT_WRITE_SPACING   5    // us between two writes to the same device
+#define POLL_INTERVAL           1000 // us between two reads of a polled register
+#define MAX_WARM_SKIPS          16
+#define MAX_I2C_PARTITIONS      8    // buses and links written concurrently
+#define I2C_PARTITION_ALL       0xFF // settings applied by every partition
+#define I2C_PARTITION_NONE      0xFE // markers not executed by any partition
+#define I2C_LINK_ALL            0xFF // link of a LINK_SEL addressing every link
+
+/* LINK_SEL_CFG buffer: sub-address length, sub-address (2 bytes, right
+ * aligned), value addressing all links, then dataLength per-link values */
+#define LINK_SEL_SUB_LENGTH     0
+#define LINK_SEL_SUB_ADDRESS    1
+#define LINK_SEL_ALL            3
+#define LINK_SEL_VALUES         4
 
 typedef enum {
     WRITE_REG_1 = 0,            // 1 byte register address to write
@@ -42,6 +60,14 @@ typedef enum {
     SECTION_STOP,               // Indicate the end of a group/preset registers section
     READ_WRITE_REG_1,           // 1 byte registers to read and write
     READ_WRITE_REG_2,           // 2 byte registers to read and write
+    BOSON_CMD,                  // Boson command sent through its command port
+    BURST_CFG,                  // Enable/disable write coalescing for a device
+    WRITE_SPACING,              // Minimum time between writes to a device
+    POLL_REG,                   // Read a register until it matches a value
+    LINK_SEL,                   // Following commands target this GMSL link
+    BARRIER,                    // Wait for all buses before continuing
+    WARM_SKIP,                  // Never read back a device on warm start
+    LINK_SEL_CFG,               // Deserializer register LINK_SEL writes to address a link
 } CommandType;
 
 typedef enum {
@@ -65,6 +91,7 @@ typedef struct {
         int                     i2cDevice;
         int                     triggerFrame;
         NvMediaBool             i2cErr;
+        uint32_t                link;
     };
     uint8_t                     dataLength;   // support multiple bytes data for i2c write
 } Command;
@@ -75,8 +102,22 @@ typedef struct {
 } GroupData;
 
 typedef struct {
-    Command                     commands[MAX_NUM_COMMANDS];
+    uint32_t                    numWrites;
+    uint32_t                    numReads;
+    uint64_t                    transferNs;   // time spent in register transfers
+    uint64_t                    spacingNs;    // time spent enforcing write spacing
+    uint64_t                    delayNs;      // time spent in script delays
+    uint64_t                    bosonNs;      // time spent in Boson command batches
+    uint64_t                    pollNs;       // time spent polling registers
+} I2cTimingStats;
+
+/* A zeroed I2cCommands is an empty list. Commands live in one allocation
+ * that grows as they are added; release it with I2cFreeCommands. */
+typedef struct {
+    Command                    *commands;
     uint32_t                    numCommands;
+    uint32_t                    maxCommands;
+    I2cTimingStats              timing;
 } I2cCommands;
 
 typedef struct {
@@ -84,6 +125,57 @@ typedef struct {
     uint32_t                    numGroups;
 } I2cGroups;
 
+typedef struct {
+    int                         i2cDevice;
+    uint32_t                    deviceAddress;
+    uint32_t                    subAddressLength;
+    uint32_t                    subAddress;
+    uint32_t                    index;        // command writing the register
+} I2cRegister;
+
+/* Makes room for at least numCommands commands, new ones are zeroed */
+NvMediaStatus
+I2cReserveCommands(I2cCommands *allCommands,
+                   uint32_t numCommands);
+
+/* Releases the room reserved beyond the current commands */
+void
+I2cTrimCommands(I2cCommands *allCommands);
+
+void
+I2cFreeCommands(I2cCommands *allCommands);
+
+/* Appends the commands of src that only set how later commands are written:
+ * bus, I2C error checks, bursts, write spacing and the link select register.
+ * Lets a part of a script be written again on its own. */
+NvMediaStatus
+I2cCopySettings(I2cCommands *dst,
+                I2cCommands *src);
+
+/* Returns the last "; Link select" of allCommands, NULL if there is none */
+Command *
+I2cFindLinkSelect(I2cCommands *allCommands);
+
+/* Appends the writes, polls and Boson commands of src addressed to one
+ * device, with the delays that follow them, e.g. to configure the camera
+ * of one channel again */
+NvMediaStatus
+I2cAppendDevice(I2cCommands *dst,
+                I2cCommands *src,
+                uint32_t deviceAddress);
+
+/* Appends the scripts of several GMSL links between two barriers, each
+ * under "; Link n", after the commands already in allCommands. Links on one
+ * bus take turns on it, each addressed through the "; Link select" register
+ * of allCommands before its writes, so the delays of one link overlap the
+ * writes of the others; every link is addressed again afterwards. Link scripts may not hold frame groups, select links or write
+ * the deserializer the links share. */
+NvMediaStatus
+I2cAppendLinkScripts(I2cCommands *allCommands,
+                     I2cCommands *linkCommands,
+                     uint32_t *links,
+                     uint32_t numLinks);
+
 NvMediaStatus
 I2cSetupGroups(I2cCommands *allCommands,
                I2cGroups   *allGroups);
@@ -110,6 +202,41 @@ NvMediaStatus
 I2cProcessInitialRegisters(I2cCommands *allCommands,
                            int i2cDevice);
 
+/* Merges runs of writes to the same device and sub-address into single
+ * burst writes, only where a "; Burst on" allows it. Must run before
+ * I2cSetupGroups as it renumbers commands. */
+NvMediaStatus
+I2cCoalesceWrites(I2cCommands *allCommands);
+
+void
+I2cPrintTimingStats(I2cCommands *allCommands);
+
+/* Lists the registers set by single byte writes outside groups, except on
+ * Warm skip devices, sorted by bus, device and address. regs must hold
+ * numCommands entries. Registers written more than once are listed once
+ * with their last write, or not at all with excludeRepeated. */
+uint32_t
+I2cListRegisters(I2cCommands *allCommands,
+                 int i2cDevice,
+                 I2cRegister *regs,
+                 NvMediaBool excludeRepeated);
+
+/* Reads back the registers the script writes and drops the writes whose
+ * value is already in place, along with delays that no longer follow a
+ * write. Leaves the commands untouched if the hardware cannot be read. */
+NvMediaStatus
+I2cWarmStart(I2cCommands *allCommands,
+             int i2cDevice);
+
+/* Reads back the registers the script writes outside device skipDevice and
+ * appends the last write of each one whose value differs to changed, as
+ * default commands without the sequences and delays leading to it */
+NvMediaStatus
+I2cChangedRegisters(I2cCommands *allCommands,
+                    int i2cDevice,
+                    uint32_t skipDevice,
+                    I2cCommands *changed);
+
 uint32_t
 I2cGetNumCommands(I2cCommands *allCommands);
 
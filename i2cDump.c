@@ -0,0 +1,183 @@
+/* NVIDIA CORPORATION gave permission to FLIR Systems, Inc to modify this code
+  * and distribute it as part of the ADAS GMSL Kit.
+  * http://www.flir.com/
+  * October-2019
+*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "i2cDump.h"
+#include "i2cBus.h"
+#include "log_utils.h"
+
+typedef struct {
+    int                         i2cDevice;
+    I2cHandle                   handle;
+} DumpBus;
+
+static I2cHandle
+_GetDumpBus(DumpBus *buses, uint32_t *numBuses, int i2cDevice)
+{
+    uint32_t i;
+
+    for (i = 0; i < *numBuses; i++) {
+        if (buses[i].i2cDevice == i2cDevice) {
+            return buses[i].handle;
+        }
+    }
+    if (*numBuses == MAX_DUMP_RANGES) {
+        return NULL;
+    }
+
+    I2cBusOpen(i2cDevice, &buses[*numBuses].handle);
+    if (!buses[*numBuses].handle) {
+        return NULL;
+    }
+    buses[*numBuses].i2cDevice = i2cDevice;
+    return buses[(*numBuses)++].handle;
+}
+
+static NvMediaBool
+_ReadBlock(I2cHandle handle, I2cDumpRange *range, uint32_t address,
+           uint8_t *data, uint32_t length)
+{
+    uint8_t subAddress[2];
+
+    if (!handle) {
+        return NVMEDIA_FALSE;
+    }
+
+    if (range->subAddressLength == 2) {
+        subAddress[0] = (uint8_t)(address >> 8);
+        subAddress[1] = (uint8_t)address;
+    } else {
+        subAddress[0] = (uint8_t)address;
+    }
+
+    return !I2cBusRead(handle, range->deviceAddress, subAddress,
+                       range->subAddressLength, data, length);
+}
+
+NvMediaStatus
+I2cDumpAddRange(I2cDumpConfig *config,
+                int i2cDevice,
+                uint32_t deviceAddress,
+                uint32_t subAddressLength,
+                uint32_t start,
+                uint32_t count)
+{
+    I2cDumpRange *range;
+
+    if (config->numRanges == MAX_DUMP_RANGES) {
+        LOG_ERR("%s: Too many dump ranges\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    range = &config->ranges[config->numRanges++];
+    range->i2cDevice = i2cDevice;
+    range->deviceAddress = deviceAddress;
+    range->subAddressLength = subAddressLength;
+    range->start = start;
+    range->count = count;
+    return NVMEDIA_STATUS_OK;
+}
+
+NvMediaStatus
+I2cDumpAddScript(I2cDumpConfig *config,
+                 I2cCommands *allCommands,
+                 int i2cDevice)
+{
+    NvMediaStatus status = NVMEDIA_STATUS_OK;
+    I2cRegister *regs;
+    uint32_t numRegs;
+    uint32_t i, count;
+
+    if (!allCommands->numCommands) {
+        return NVMEDIA_STATUS_OK;
+    }
+
+    regs = malloc(allCommands->numCommands * sizeof(I2cRegister));
+    if (!regs) {
+        LOG_ERR("%s: Out of memory\n", __func__);
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+
+    numRegs = I2cListRegisters(allCommands, i2cDevice, regs, NVMEDIA_FALSE);
+    for (i = 0; i < numRegs && status == NVMEDIA_STATUS_OK; i += count) {
+        count = 1;
+        while (i + count < numRegs &&
+               regs[i + count].i2cDevice == regs[i].i2cDevice &&
+               regs[i + count].deviceAddress == regs[i].deviceAddress &&
+               regs[i + count].subAddressLength == regs[i].subAddressLength &&
+               regs[i + count].subAddress == regs[i].subAddress + count) {
+            count++;
+        }
+        status = I2cDumpAddRange(config, regs[i].i2cDevice,
+                                 regs[i].deviceAddress,
+                                 regs[i].subAddressLength,
+                                 regs[i].subAddress, count);
+    }
+
+    free(regs);
+    return status;
+}
+
+NvMediaStatus
+I2cDumpWrite(I2cDumpConfig *config,
+             FILE *fp)
+{
+    DumpBus buses[MAX_DUMP_RANGES];
+    uint8_t data[I2C_DUMP_BLOCK_SIZE];
+    uint32_t numBuses = 0;
+    uint32_t numFailed = 0;
+    uint32_t i, offset, length, j;
+    NvMediaBool readOk;
+    I2cDumpRange *range;
+    I2cHandle handle;
+
+    fprintf(fp, "# bus dev reg: values\n");
+
+    for (i = 0; i < config->numRanges; i++) {
+        range = &config->ranges[i];
+        handle = _GetDumpBus(buses, &numBuses, range->i2cDevice);
+
+        for (offset = 0; offset < range->count; offset += length) {
+            length = range->count - offset;
+            if (length > I2C_DUMP_BLOCK_SIZE) {
+                length = I2C_DUMP_BLOCK_SIZE;
+            }
+            I2cBusLock(range->i2cDevice);
+            readOk = _ReadBlock(handle, range, range->start + offset, data,
+                                length);
+            I2cBusUnlock(range->i2cDevice);
+            if (!readOk) {
+                numFailed += length;
+            }
+
+            for (j = 0; j < length; j++) {
+                if (j % I2C_DUMP_LINE_SIZE == 0) {
+                    fprintf(fp, "%s%d %02x %0*x:", j ? "\n" : "",
+                            range->i2cDevice, range->deviceAddress << 1,
+                            range->subAddressLength * 2,
+                            range->start + offset + j);
+                }
+                if (readOk) {
+                    fprintf(fp, " %02x", data[j]);
+                } else {
+                    fprintf(fp, " --");
+                }
+            }
+            fprintf(fp, "\n");
+        }
+    }
+
+    for (i = 0; i < numBuses; i++) {
+        I2cBusClose(buses[i].handle);
+    }
+
+    if (numFailed) {
+        LOG_WARN("%s: %u registers could not be read\n", __func__, numFailed);
+        return NVMEDIA_STATUS_ERROR;
+    }
+    return NVMEDIA_STATUS_OK;
+}
@@ -0,0 +1,56 @@
+/* NVIDIA CORPORATION gave permission to FLIR Systems, Inc to modify this code
+  * and distribute it as part of the ADAS GMSL Kit.
+  * http://www.flir.com/
+  * October-2019
+*/
+#ifndef __I2C_DUMP_H__
+#define __I2C_DUMP_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "nvmedia_core.h"
+#include "i2cCommands.h"
+
+/* Register snapshots read with block reads. Each line of a snapshot holds
+ * up to I2C_DUMP_LINE_SIZE registers as "bus dev reg: values", so two
+ * snapshots compare with diff. Unreadable registers show as "--". */
+
+#define MAX_DUMP_RANGES             256
+#define I2C_DUMP_LINE_SIZE          16
+#define I2C_DUMP_BLOCK_SIZE         32      // registers per read
+
+typedef struct {
+    int                         i2cDevice;
+    uint32_t                    deviceAddress;      // 7-bit
+    uint32_t                    subAddressLength;   // 1 or 2 bytes
+    uint32_t                    start;
+    uint32_t                    count;
+} I2cDumpRange;
+
+typedef struct {
+    I2cDumpRange                ranges[MAX_DUMP_RANGES];
+    uint32_t                    numRanges;
+} I2cDumpConfig;
+
+NvMediaStatus
+I2cDumpAddRange(I2cDumpConfig *config,
+                int i2cDevice,
+                uint32_t deviceAddress,
+                uint32_t subAddressLength,
+                uint32_t start,
+                uint32_t count);
+
+/* Adds every register written by the script, one range per run of
+ * consecutive addresses */
+NvMediaStatus
+I2cDumpAddScript(I2cDumpConfig *config,
+                 I2cCommands *allCommands,
+                 int i2cDevice);
+
+/* Returns an error if any register could not be read */
+NvMediaStatus
+I2cDumpWrite(I2cDumpConfig *config,
+             FILE *fp);
+
+#endif
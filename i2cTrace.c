@@ -0,0 +1,162 @@
+/* NVIDIA CORPORATION gave permission to FLIR Systems, Inc to modify this code
+  * and distribute it as part of the ADAS GMSL Kit.
+  * http://www.flir.com/
+  * October-2019
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "log_utils.h"
+
+#include "i2cTrace.h"
+
+/* Ring of trace records. Writers reserve a slot with an atomic increment
+ * of the head and publish it by storing the slot sequence last, so a dump
+ * taken while I2C traffic is running only skips records still in flight. */
+static I2cTraceRecord *_records = NULL;
+static uint32_t _maxRecords = 0;
+static uint32_t _head = 0;
+
+NvMediaStatus
+I2cTraceEnable(uint32_t maxRecords)
+{
+    if (_records) {
+        return NVMEDIA_STATUS_OK;
+    }
+    if (!maxRecords) {
+        maxRecords = I2C_TRACE_DEFAULT_RECORDS;
+    }
+
+    _records = calloc(maxRecords, sizeof(I2cTraceRecord));
+    if (!_records) {
+        LOG_ERR("%s: Out of memory\n", __func__);
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+    _maxRecords = maxRecords;
+    __atomic_store_n(&_head, 0, __ATOMIC_RELEASE);
+
+    return NVMEDIA_STATUS_OK;
+}
+
+void
+I2cTraceDisable(void)
+{
+    I2cTraceRecord *records = _records;
+
+    _records = NULL;
+    _maxRecords = 0;
+    free(records);
+}
+
+NvMediaBool
+I2cTraceIsEnabled(void)
+{
+    return _records != NULL;
+}
+
+uint64_t
+I2cTraceTimeNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void
+I2cTraceRecordOp(I2cTraceOp op, uint32_t device, uint32_t tag,
+                 uint32_t length, int32_t result, uint64_t startNs)
+{
+    I2cTraceRecord *record;
+    uint32_t sequence;
+
+    if (!_records) {
+        return;
+    }
+
+    sequence = __atomic_fetch_add(&_head, 1, __ATOMIC_ACQ_REL);
+    record = &_records[sequence % _maxRecords];
+
+    /* Invalidate the slot while it is being rewritten */
+    __atomic_store_n(&record->sequence, 0, __ATOMIC_RELEASE);
+    record->startNs = startNs;
+    record->endNs = I2cTraceTimeNs();
+    record->tag = tag;
+    record->result = result;
+    record->length = (uint16_t)length;
+    record->device = (uint8_t)device;
+    record->op = (uint8_t)op;
+    __atomic_store_n(&record->sequence, sequence + 1, __ATOMIC_RELEASE);
+}
+
+void
+I2cTraceMark(I2cTraceOp op, uint32_t device, uint32_t tag, uint32_t length)
+{
+    if (!_records) {
+        return;
+    }
+
+    I2cTraceRecordOp(op, device, tag, length, 0, I2cTraceTimeNs());
+}
+
+NvMediaStatus
+I2cTraceDump(const char *filename)
+{
+    I2cTraceFileHeader header;
+    I2cTraceRecord record;
+    uint32_t head, first, i;
+    FILE *fp = NULL;
+
+    if (!_records) {
+        LOG_ERR("%s: I2C tracing is not enabled\n", __func__);
+        return NVMEDIA_STATUS_NOT_INITIALIZED;
+    }
+
+    fp = fopen(filename, "wb");
+    if (!fp) {
+        LOG_ERR("%s: Failed to open file \"%s\"\n", __func__, filename);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    head = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+    first = (head > _maxRecords) ? head - _maxRecords : 0;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = I2C_TRACE_MAGIC;
+    header.version = I2C_TRACE_VERSION;
+    header.recordSize = sizeof(I2cTraceRecord);
+    header.overwrittenRecords = first;
+    if (fwrite(&header, sizeof(header), 1, fp) != 1) {
+        goto failed;
+    }
+
+    for (i = first; i != head; i++) {
+        memcpy(&record, &_records[i % _maxRecords], sizeof(record));
+        if (__atomic_load_n(&_records[i % _maxRecords].sequence,
+                            __ATOMIC_ACQUIRE) != i + 1 ||
+            record.sequence != i + 1) {
+            continue;
+        }
+        if (fwrite(&record, sizeof(record), 1, fp) != 1) {
+            goto failed;
+        }
+        header.numRecords++;
+    }
+
+    /* Patch in the number of records actually written */
+    if (fseek(fp, 0, SEEK_SET) ||
+        fwrite(&header, sizeof(header), 1, fp) != 1) {
+        goto failed;
+    }
+
+    fclose(fp);
+    LOG_MSG("%s: Wrote %u I2C trace records to %s\n", __func__,
+            header.numRecords, filename);
+    return NVMEDIA_STATUS_OK;
+failed:
+    LOG_ERR("%s: Failed to write \"%s\"\n", __func__, filename);
+    fclose(fp);
+    return NVMEDIA_STATUS_ERROR;
+}
@@ -0,0 +1,69 @@
+/* NVIDIA CORPORATION gave permission to FLIR Systems, Inc to modify this code
+  * and distribute it as part of the ADAS GMSL Kit.
+  * http://www.flir.com/
+  * October-2019
+*/
+#ifndef __I2C_TRACE_H__
+#define __I2C_TRACE_H__
+
+#include <stdint.h>
+
+#include "nvmedia_core.h"
+
+#define I2C_TRACE_MAGIC             0x45435254  // "TRCE"
+#define I2C_TRACE_VERSION           1
+#define I2C_TRACE_DEFAULT_RECORDS   (1 << 16)
+
+typedef enum {
+    I2C_TRACE_OPEN = 0,         // device holds the bus number
+    I2C_TRACE_CLOSE,
+    I2C_TRACE_WRITE,            // tag holds the first (sub-address) bytes written
+    I2C_TRACE_READ,             // tag holds the sub-address read from
+    I2C_TRACE_CMD_BEGIN,        // tag holds the Boson command id
+    I2C_TRACE_CMD_END,
+    I2C_TRACE_BATCH_BEGIN,      // length holds the number of batched commands
+    I2C_TRACE_BATCH_END,
+} I2cTraceOp;
+
+typedef struct {
+    uint64_t                    startNs;
+    uint64_t                    endNs;
+    uint32_t                    tag;
+    uint32_t                    sequence;   // slot owner, used to skip torn records
+    int32_t                     result;
+    uint16_t                    length;
+    uint8_t                     device;
+    uint8_t                     op;
+} I2cTraceRecord;
+
+typedef struct {
+    uint32_t                    magic;
+    uint32_t                    version;
+    uint32_t                    recordSize;
+    uint32_t                    numRecords;
+    uint64_t                    overwrittenRecords;
+} I2cTraceFileHeader;
+
+NvMediaStatus
+I2cTraceEnable(uint32_t maxRecords);
+
+void
+I2cTraceDisable(void);
+
+NvMediaBool
+I2cTraceIsEnabled(void);
+
+uint64_t
+I2cTraceTimeNs(void);
+
+void
+I2cTraceRecordOp(I2cTraceOp op, uint32_t device, uint32_t tag,
+                 uint32_t length, int32_t result, uint64_t startNs);
+
+void
+I2cTraceMark(I2cTraceOp op, uint32_t device, uint32_t tag, uint32_t length);
+
+NvMediaStatus
+I2cTraceDump(const char *filename);
+
+#endif
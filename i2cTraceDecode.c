@@ -0,0 +1,224 @@
+/* NVIDIA CORPORATION gave permission to FLIR Systems, Inc to modify this code
+  * and distribute it as part of the ADAS GMSL Kit.
+  * http://www.flir.com/
+  * October-2019
+*/
+/* Offline decoder for traces written with -i2ctrace. Prints bus
+ * utilization, per-device traffic and per-command latency. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "i2cTrace.h"
+
+#define MAX_DEVICES             128
+#define MAX_COMMAND_IDS         256
+#define MAX_PENDING_COMMANDS    64
+
+typedef struct {
+    uint32_t                    writes;
+    uint32_t                    reads;
+    uint32_t                    errors;
+    uint64_t                    bytes;
+    uint64_t                    busyNs;
+} DeviceStats;
+
+typedef struct {
+    uint32_t                    cmdId;
+    uint32_t                    count;
+    uint64_t                    totalNs;
+    uint64_t                    minNs;
+    uint64_t                    maxNs;
+} CommandStats;
+
+typedef struct {
+    uint32_t                    cmdId;
+    uint8_t                     device;
+    uint64_t                    startNs;
+} PendingCommand;
+
+static DeviceStats _devices[MAX_DEVICES];
+static CommandStats _commands[MAX_COMMAND_IDS];
+static uint32_t _numCommands = 0;
+static PendingCommand _pending[MAX_PENDING_COMMANDS];
+static uint32_t _numPending = 0;
+
+static void
+_BeginCommand(I2cTraceRecord *record)
+{
+    if (_numPending == MAX_PENDING_COMMANDS) {
+        fprintf(stderr, "Too many nested commands, dropping %08x\n",
+                record->tag);
+        return;
+    }
+    _pending[_numPending].cmdId = record->tag;
+    _pending[_numPending].device = record->device;
+    _pending[_numPending].startNs = record->startNs;
+    _numPending++;
+}
+
+static void
+_EndCommand(I2cTraceRecord *record)
+{
+    CommandStats *stats = NULL;
+    uint64_t latency;
+    uint32_t i;
+
+    /* Batched commands end in the order they began, so match the oldest */
+    for (i = 0; i < _numPending; i++) {
+        if (_pending[i].cmdId == record->tag &&
+            _pending[i].device == record->device) {
+            break;
+        }
+    }
+    if (i == _numPending) {
+        return;
+    }
+    latency = record->endNs - _pending[i].startNs;
+    memmove(&_pending[i], &_pending[i + 1],
+            (_numPending - i - 1) * sizeof(PendingCommand));
+    _numPending--;
+
+    for (i = 0; i < _numCommands; i++) {
+        if (_commands[i].cmdId == record->tag) {
+            stats = &_commands[i];
+            break;
+        }
+    }
+    if (!stats) {
+        if (_numCommands == MAX_COMMAND_IDS) {
+            return;
+        }
+        stats = &_commands[_numCommands++];
+        stats->cmdId = record->tag;
+        stats->minNs = latency;
+    }
+
+    stats->count++;
+    stats->totalNs += latency;
+    if (latency < stats->minNs) {
+        stats->minNs = latency;
+    }
+    if (latency > stats->maxNs) {
+        stats->maxNs = latency;
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    I2cTraceFileHeader header;
+    I2cTraceRecord record;
+    uint64_t firstNs = UINT64_MAX, lastNs = 0, busyNs = 0;
+    uint32_t transfers = 0, batches = 0, i;
+    FILE *fp;
+
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <trace file>\n", argv[0]);
+        return 1;
+    }
+
+    fp = fopen(argv[1], "rb");
+    if (!fp) {
+        fprintf(stderr, "Failed to open %s\n", argv[1]);
+        return 1;
+    }
+
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        header.magic != I2C_TRACE_MAGIC ||
+        header.version != I2C_TRACE_VERSION ||
+        header.recordSize != sizeof(I2cTraceRecord)) {
+        fprintf(stderr, "%s is not a version %d I2C trace\n", argv[1],
+                I2C_TRACE_VERSION);
+        fclose(fp);
+        return 1;
+    }
+
+    for (i = 0; i < header.numRecords; i++) {
+        if (fread(&record, sizeof(record), 1, fp) != 1) {
+            fprintf(stderr, "Trace truncated after %u records\n", i);
+            break;
+        }
+
+        if (record.startNs < firstNs) {
+            firstNs = record.startNs;
+        }
+        if (record.endNs > lastNs) {
+            lastNs = record.endNs;
+        }
+
+        switch (record.op) {
+            case I2C_TRACE_WRITE:
+            case I2C_TRACE_READ:
+                {
+                    DeviceStats *dev = &_devices[record.device % MAX_DEVICES];
+
+                    if (record.op == I2C_TRACE_WRITE) {
+                        dev->writes++;
+                    } else {
+                        dev->reads++;
+                    }
+                    if (record.result) {
+                        dev->errors++;
+                    }
+                    dev->bytes += record.length;
+                    dev->busyNs += record.endNs - record.startNs;
+                    busyNs += record.endNs - record.startNs;
+                    transfers++;
+                }
+                break;
+            case I2C_TRACE_CMD_BEGIN:
+                _BeginCommand(&record);
+                break;
+            case I2C_TRACE_CMD_END:
+                _EndCommand(&record);
+                break;
+            case I2C_TRACE_BATCH_BEGIN:
+                batches++;
+                break;
+            default:
+                break;
+        }
+    }
+    fclose(fp);
+
+    printf("Records:        %u (%llu overwritten)\n", header.numRecords,
+           (unsigned long long)header.overwrittenRecords);
+    if (!transfers) {
+        printf("No I2C transfers recorded\n");
+        return 0;
+    }
+    printf("Span:           %.3f ms\n", (lastNs - firstNs) / 1e6);
+    printf("Transfers:      %u\n", transfers);
+    printf("Bus busy:       %.3f ms (%.1f%%)\n", busyNs / 1e6,
+           (lastNs > firstNs) ? 100.0 * busyNs / (lastNs - firstNs) : 0.0);
+    printf("Boson batches:  %u\n", batches);
+
+    printf("\nDevice  Writes  Reads   Errors  Bytes     Busy(ms)\n");
+    for (i = 0; i < MAX_DEVICES; i++) {
+        DeviceStats *dev = &_devices[i];
+
+        if (!dev->writes && !dev->reads) {
+            continue;
+        }
+        printf("0x%02x    %-7u %-7u %-7u %-9llu %.3f\n", i, dev->writes,
+               dev->reads, dev->errors, (unsigned long long)dev->bytes,
+               dev->busyNs / 1e6);
+    }
+
+    if (_numCommands) {
+        printf("\nCommand   Count   Avg(ms)   Min(ms)   Max(ms)\n");
+        for (i = 0; i < _numCommands; i++) {
+            printf("%08x  %-7u %-9.3f %-9.3f %.3f\n", _commands[i].cmdId,
+                   _commands[i].count,
+                   _commands[i].totalNs / 1e6 / _commands[i].count,
+                   _commands[i].minNs / 1e6, _commands[i].maxNs / 1e6);
+        }
+    }
+    if (_numPending) {
+        printf("\n%u commands never completed\n", _numPending);
+    }
+
+    return 0;
+}
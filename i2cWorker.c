@@ -0,0 +1,235 @@
+/* NVIDIA CORPORATION gave permission to FLIR Systems, Inc to modify this code
+  * and distribute it as part of the ADAS GMSL Kit.
+  * http://www.flir.com/
+  * October-2019
+*/
+#include <stdlib.h>
+#include <string.h>
+
+#include "i2cWorker.h"
+#include "i2cBus.h"
+#include "log_utils.h"
+#include "misc_utils.h"
+
+static uint32_t
+_GroupTriggerFrame(I2cWorker *worker, uint32_t group)
+{
+    GroupData *grpData = &worker->allGroups->groups[group];
+
+    return worker->allCommands->commands[grpData->firstCommand].triggerFrame;
+}
+
+static void
+_DumpRegisters(I2cWorker *worker, I2cWorkerRequest *request)
+{
+    uint64_t tbegin = 0, tend = 0;
+    NvMediaStatus status;
+    FILE *fp;
+
+    fp = fopen(request->fileName, "w");
+    if (!fp) {
+        LOG_ERR("%s: Failed to open file \"%s\"\n", __func__,
+                request->fileName);
+        return;
+    }
+
+    GetTimeMicroSec(&tbegin);
+    fprintf(fp, "# frame %u\n", *worker->frameCounter);
+    status = I2cDumpWrite(worker->dumpConfig, fp);
+    GetTimeMicroSec(&tend);
+    fclose(fp);
+
+    LOG_MSG("Registers %s to %s (%llu us)\n",
+            (status == NVMEDIA_STATUS_OK) ? "dumped" : "partially dumped",
+            request->fileName, (unsigned long long)(tend - tbegin));
+}
+
+static uint32_t
+_I2cWorkerFunc(void *data)
+{
+    I2cWorker *worker = (I2cWorker *)data;
+    I2cWorkerRequest request;
+    uint64_t tbegin = 0, tend = 0;
+    uint32_t appliedFrame;
+    NvMediaStatus status;
+
+    while (!worker->quit) {
+        if (NvQueueGet(worker->requestQueue, &request,
+                       I2C_WORKER_DEQUEUE_TIMEOUT) != NVMEDIA_STATUS_OK) {
+            continue;
+        }
+
+        if (request.type == I2C_WORKER_DUMP) {
+            _DumpRegisters(worker, &request);
+            continue;
+        }
+
+        GetTimeMicroSec(&tbegin);
+        I2cBusLock(worker->i2cDevice);
+        status = I2cProcessGroup(worker->handle, worker->allCommands,
+                                 &worker->allGroups->groups[request.group]);
+        I2cBusUnlock(worker->i2cDevice);
+        GetTimeMicroSec(&tend);
+
+        appliedFrame = *worker->frameCounter;
+        worker->appliedFrame[request.group] = appliedFrame;
+        if (status != NVMEDIA_STATUS_OK) {
+            LOG_ERR("%s: Failed to write group %u\n", __func__, request.group);
+            continue;
+        }
+        LOG_INFO("%s: Group %u for frame %u posted at frame %u, applied at "
+                 "frame %u (%llu us)\n", __func__, request.group,
+                 _GroupTriggerFrame(worker, request.group),
+                 request.postedFrame, appliedFrame,
+                 (unsigned long long)(tend - tbegin));
+    }
+
+    return 0;
+}
+
+NvMediaStatus
+I2cWorkerCreate(I2cWorker **worker,
+                I2cCommands *allCommands,
+                I2cGroups *allGroups,
+                I2cDumpConfig *dumpConfig,
+                int i2cDevice,
+                volatile uint32_t *frameCounter)
+{
+    I2cWorker *ctx;
+    NvMediaStatus status;
+    uint32_t i;
+
+    if (!worker || !allCommands || !allGroups || !dumpConfig || !frameCounter) {
+        LOG_ERR("%s: Bad parameter\n", __func__);
+        return NVMEDIA_STATUS_BAD_PARAMETER;
+    }
+
+    ctx = calloc(1, sizeof(I2cWorker));
+    if (!ctx) {
+        LOG_ERR("%s: Out of memory\n", __func__);
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+    ctx->allCommands = allCommands;
+    ctx->allGroups = allGroups;
+    ctx->dumpConfig = dumpConfig;
+    ctx->frameCounter = frameCounter;
+    ctx->i2cDevice = i2cDevice;
+    for (i = 0; i < MAX_NUM_GROUPS; i++) {
+        ctx->appliedFrame[i] = I2C_WORKER_NOT_APPLIED;
+    }
+
+    /* Keep the bus open so a group costs only its own transfers */
+    I2cBusOpen(i2cDevice, &ctx->handle);
+    if (!ctx->handle) {
+        LOG_ERR("%s: Failed to open handle with id %u\n", __func__, i2cDevice);
+        status = NVMEDIA_STATUS_ERROR;
+        goto failed;
+    }
+
+    status = NvQueueCreate(&ctx->requestQueue, I2C_WORKER_QUEUE_SIZE,
+                           sizeof(I2cWorkerRequest));
+    if (status != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: Failed to create request queue\n", __func__);
+        goto failed;
+    }
+
+    status = NvThreadCreate(&ctx->thread, &_I2cWorkerFunc, (void *)ctx,
+                            NV_THREAD_PRIORITY_NORMAL);
+    if (status != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: Failed to create worker thread\n", __func__);
+        goto failed;
+    }
+
+    *worker = ctx;
+    return NVMEDIA_STATUS_OK;
+
+failed:
+    I2cWorkerDestroy(ctx);
+    return status;
+}
+
+void
+I2cWorkerDestroy(I2cWorker *worker)
+{
+    uint32_t i;
+
+    if (!worker)
+        return;
+
+    worker->quit = NVMEDIA_TRUE;
+    if (worker->thread) {
+        NvThreadDestroy(worker->thread);
+
+        for (i = 0; i < worker->allGroups->numGroups; i++) {
+            if (worker->appliedFrame[i] == I2C_WORKER_NOT_APPLIED) {
+                LOG_WARN("%s: Group for frame %u was never applied\n",
+                         __func__, _GroupTriggerFrame(worker, i));
+            }
+        }
+    }
+
+    if (worker->requestQueue)
+        NvQueueDestroy(worker->requestQueue);
+    if (worker->handle)
+        I2cBusClose(worker->handle);
+    free(worker);
+}
+
+void
+I2cWorkerTrigger(I2cWorker *worker,
+                 uint32_t capturedFrames)
+{
+    I2cWorkerRequest request;
+    uint32_t i;
+
+    for (i = 0; i < worker->allGroups->numGroups; i++) {
+        if ((worker->groupsPosted & (1u << i)) ||
+            _GroupTriggerFrame(worker, i) > capturedFrames) {
+            continue;
+        }
+
+        memset(&request, 0, sizeof(request));
+        request.type = I2C_WORKER_GROUP;
+        request.group = i;
+        request.postedFrame = capturedFrames;
+        if (NvQueuePut(worker->requestQueue, &request, 0) !=
+            NVMEDIA_STATUS_OK) {
+            LOG_WARN("%s: I2C worker busy, retrying group %u next frame\n",
+                     __func__, i);
+            return;
+        }
+        worker->groupsPosted |= 1u << i;
+    }
+}
+
+NvMediaStatus
+I2cWorkerDump(I2cWorker *worker,
+              const char *fileName)
+{
+    I2cWorkerRequest request;
+
+    if (!worker || !fileName) {
+        return NVMEDIA_STATUS_BAD_PARAMETER;
+    }
+
+    memset(&request, 0, sizeof(request));
+    request.type = I2C_WORKER_DUMP;
+    request.postedFrame = *worker->frameCounter;
+    strncpy(request.fileName, fileName, MAX_STRING_SIZE - 1);
+
+    if (NvQueuePut(worker->requestQueue, &request, 0) != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: I2C worker busy\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+    return NVMEDIA_STATUS_OK;
+}
+
+uint32_t
+I2cWorkerGetAppliedFrame(I2cWorker *worker,
+                         uint32_t group)
+{
+    if (group >= MAX_NUM_GROUPS)
+        return I2C_WORKER_NOT_APPLIED;
+
+    return worker->appliedFrame[group];
+}
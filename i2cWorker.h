@@ -0,0 +1,78 @@
+/* NVIDIA CORPORATION gave permission to FLIR Systems, Inc to modify this code
+  * and distribute it as part of the ADAS GMSL Kit.
+  * http://www.flir.com/
+  * October-2019
+*/
+#ifndef __I2C_WORKER_H__
+#define __I2C_WORKER_H__
+
+#include <stdint.h>
+
+#include "nvmedia_core.h"
+#include "thread_utils.h"
+#include "i2cCommands.h"
+#include "i2cDump.h"
+#include "cmdline.h"
+
+/* Runs I2C work off the capture threads: writes the register groups of a
+ * script ("; Wait for frame N" sections) once the capture loop posts that
+ * frame N has been captured, and takes register dumps on demand. */
+
+#define I2C_WORKER_QUEUE_SIZE       MAX_NUM_GROUPS
+#define I2C_WORKER_DEQUEUE_TIMEOUT  100     // ms
+#define I2C_WORKER_NOT_APPLIED      0xFFFFFFFF
+
+typedef enum {
+    I2C_WORKER_GROUP = 0,
+    I2C_WORKER_DUMP
+} I2cWorkerRequestType;
+
+typedef struct {
+    I2cWorkerRequestType        type;
+    uint32_t                    group;
+    uint32_t                    postedFrame;    // frames captured when posted
+    char                        fileName[MAX_STRING_SIZE];
+} I2cWorkerRequest;
+
+typedef struct {
+    NvThread                   *thread;
+    NvQueue                    *requestQueue;
+    I2cHandle                   handle;
+    int                         i2cDevice;
+    I2cCommands                *allCommands;
+    I2cGroups                  *allGroups;
+    I2cDumpConfig              *dumpConfig;
+    volatile uint32_t          *frameCounter;   // frames captured so far
+    volatile NvMediaBool        quit;
+    uint32_t                    groupsPosted;   // bit per group
+    volatile uint32_t           appliedFrame[MAX_NUM_GROUPS];
+} I2cWorker;
+
+NvMediaStatus
+I2cWorkerCreate(I2cWorker **worker,
+                I2cCommands *allCommands,
+                I2cGroups *allGroups,
+                I2cDumpConfig *dumpConfig,
+                int i2cDevice,
+                volatile uint32_t *frameCounter);
+
+void
+I2cWorkerDestroy(I2cWorker *worker);
+
+/* Posts every group whose trigger frame has been reached. Called by the
+ * capture thread after each frame; never blocks. */
+void
+I2cWorkerTrigger(I2cWorker *worker,
+                 uint32_t capturedFrames);
+
+/* Queues a snapshot of the registers in dumpConfig to fileName */
+NvMediaStatus
+I2cWorkerDump(I2cWorker *worker,
+              const char *fileName);
+
+/* Frame count at which a group finished writing, or I2C_WORKER_NOT_APPLIED */
+uint32_t
+I2cWorkerGetAppliedFrame(I2cWorker *worker,
+                         uint32_t group);
+
+#endif
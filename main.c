@@ -14,16 +14,21 @@
 
 #include <stdio.h>
 #include <signal.h>
+#include <poll.h>
 
 #include "main.h"
 #include "check_version.h"
-#include "capture.h"
-#include "save.h"
-#include "display.h"
+#include "pipeline.h"
+#include "i2cBus.h"
+#include "log_utils.h"
+#include "i2cTrace.h"
+#include "bosonSim.h"
+#include "os_common.h"
+
+#define RUN_QUIT_POLL_INTERVAL  100     // ms
 
 /* Quit flag. Out of context structure for sig handling */
 static volatile NvMediaBool *quit_flag;
-static char *cmd_listener;
 
 static void
 SigHandler(int signum)
@@ -60,25 +65,39 @@ SigSetup(void)
     sigaction(SIGSTOP, &action, NULL);
     sigaction(SIGHUP, &action, NULL);
 }
+
+/* Returns whether a line can be read within timeout ms */
+static NvMediaBool
+WaitForInput(int timeout) {
+    struct pollfd fds = { .fd = fileno(stdin), .events = POLLIN };
+
+    return poll(&fds, 1, timeout) > 0;
+}
+
+/* Returns -1 once stdin is closed */
 static int
 ExecuteNextCommand(NvMainContext *ctx) {
-    char input[256] = { 0 };
+    char input[MAX_STRING_SIZE] = { 0 };
 
-    if (!fgets(input, 256, stdin)) {
+    if (!fgets(input, MAX_STRING_SIZE, stdin)) {
         if(*quit_flag != NVMEDIA_TRUE) {
             LOG_ERR("%s: Failed to read command\n", __func__);
         }
+        return -1;
     }
 
     /* Remove new line character */
-    if (input[strlen(input) - 1] == '\n')
-        input[strlen(input) - 1] = '\0';
+    input[strcspn(input, "\n")] = '\0';
 
     if (!strcasecmp(input, "q") || !strcasecmp(input, "quit")) {
         *quit_flag = NVMEDIA_TRUE;
         return 0;
     } else if(input[0] != '\0') {
-        sprintf(cmd_listener, input);
+        if (!ctx->cmdQueue ||
+            CmdQueuePut(ctx->cmdQueue, input) != NVMEDIA_STATUS_OK) {
+            LOG_ERR("%s: Command \"%s\" dropped, listener busy\n",
+                    __func__, input);
+        }
     }
 
     return 0;
@@ -86,6 +105,7 @@ ExecuteNextCommand(NvMainContext *ctx) {
 
 static NvMediaStatus 
 InitSignals(NvMainContext *mainCtx) {
+    CmdQueue *cmdQueue;
     sigset_t set;
     int status;
 
@@ -113,16 +133,16 @@ InitSignals(NvMainContext *mainCtx) {
         return NVMEDIA_STATUS_ERROR;
     }
 
+    cmdQueue = mainCtx->cmdQueue;
     memset(mainCtx, 0, sizeof(NvMainContext));
-    mainCtx->cmd = malloc(256);
-    strcpy(mainCtx->cmd, "");
+    mainCtx->cmdQueue = cmdQueue;
+    CmdQueueOpen(cmdQueue);
 
     if (CheckModulesVersion() != NVMEDIA_STATUS_OK) {
         return NVMEDIA_STATUS_ERROR;
     }
 
     quit_flag = &mainCtx->quit;
-    cmd_listener = mainCtx->cmd;
     SigSetup();
 
     return NVMEDIA_STATUS_OK;
@@ -133,35 +153,44 @@ InitPipeline(NvMainContext *mainCtx, TestArgs *allArgs) {
     /* Initialize context */
     mainCtx->testArgs = allArgs;
 
-    /* Initialize all the components */
-    if (CaptureInit(mainCtx) != NVMEDIA_STATUS_OK) {
-        LOG_ERR("%s: Failed to Initialize Capture\n", __func__);
+    if (allArgs->i2cSim) {
+        if (BosonSimInit(NULL) != NVMEDIA_STATUS_OK) {
+            LOG_ERR("%s: Failed to initialize the Boson simulator\n", __func__);
+            return NVMEDIA_STATUS_ERROR;
+        }
+        I2cBusSetBackend(BosonSimGetBackend());
+    }
+
+    if (allArgs->i2cTrace.isUsed &&
+        I2cTraceEnable(I2C_TRACE_DEFAULT_RECORDS) != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: Failed to enable I2C tracing\n", __func__);
         return NVMEDIA_STATUS_ERROR;
     }
 
-    if (SaveInit(mainCtx) != NVMEDIA_STATUS_OK) {
-        LOG_ERR("%s: Failed to Initialize Save\n", __func__);
+    if (allArgs->workers.isUsed &&
+        WorkPoolCreate(&mainCtx->workPool, allArgs->workers.uIntValue) != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: Failed to create the worker pool\n", __func__);
         return NVMEDIA_STATUS_ERROR;
     }
 
-    if (DisplayInit(mainCtx) != NVMEDIA_STATUS_OK) {
-        LOG_ERR("%s: Failed to Initialize Display\n", __func__);
+    /* Initialize all the stages, then start them */
+    if (PipelineConfigure(mainCtx, allArgs->pipeline.isUsed ?
+                          allArgs->pipeline.stringValue : NULL) != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: Bad pipeline\n", __func__);
         return NVMEDIA_STATUS_ERROR;
     }
 
-    /* Call Proc for each component */
-    if (CaptureProc(mainCtx) != NVMEDIA_STATUS_OK) {
-        LOG_ERR("%s: CaptureProc Failed\n", __func__);
+    if (allArgs->sched.isUsed &&
+        PipelineSchedule(mainCtx, allArgs->sched.stringValue) != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: Bad thread placement\n", __func__);
         return NVMEDIA_STATUS_ERROR;
     }
 
-    if (SaveProc(mainCtx) != NVMEDIA_STATUS_OK) {
-        LOG_ERR("%s: SaveProc Failed\n", __func__);
+    if (PipelineInit(mainCtx) != NVMEDIA_STATUS_OK) {
         return NVMEDIA_STATUS_ERROR;
     }
 
-    if (DisplayProc(mainCtx) != NVMEDIA_STATUS_OK) {
-        LOG_ERR("%s: DisplayProc Failed\n", __func__);
+    if (PipelineProc(mainCtx) != NVMEDIA_STATUS_OK) {
         return NVMEDIA_STATUS_ERROR;
     }
 
@@ -179,19 +208,51 @@ InitRunner(NvMainContext *mainCtx, TestArgs *allArgs) {
 
 int Run(TestArgs *allArgs, NvMainContext *mainCtx)
 {
+    NvMediaBool stdinOpen = NVMEDIA_TRUE;
+
     if(InitRunner(mainCtx, allArgs) != NVMEDIA_STATUS_OK) {
         goto done;
     }
 
+    /* Unbuffered so that poll sees every line not yet read */
+    setvbuf(stdin, NULL, _IONBF, 0);
+
+    /* quit is set by signals and pipeline threads, so wait for input with a
+     * timeout rather than spinning or blocking until the next line */
     while (!mainCtx->quit) {
-        if (!allArgs->frames.isUsed) {
-            ExecuteNextCommand(mainCtx);
+        if (allArgs->frames.isUsed || !stdinOpen) {
+            nvsleep(RUN_QUIT_POLL_INTERVAL * 1000);
+        } else if (WaitForInput(RUN_QUIT_POLL_INTERVAL) &&
+                   ExecuteNextCommand(mainCtx) < 0) {
+            stdinOpen = NVMEDIA_FALSE;
         }
     }
 
 done:
-    DisplayFini(mainCtx);
-    SaveFini(mainCtx);
-    CaptureFini(mainCtx);
+    mainCtx->quit = NVMEDIA_TRUE;
+
+    /* Wake the command listener */
+    CmdQueueClose(mainCtx->cmdQueue);
+
+    PipelineFini(mainCtx);
+
+    WorkPoolDestroy(mainCtx->workPool);
+    mainCtx->workPool = NULL;
     return 0;
 }
+
+void RunFini(TestArgs *allArgs)
+{
+    /* The command listener records into the trace and talks to the
+     * simulator until it is joined */
+    if (allArgs->i2cTrace.isUsed && I2cTraceIsEnabled()) {
+        I2cTraceDump(allArgs->i2cTrace.stringValue);
+        I2cTraceDisable();
+    }
+
+    if (allArgs->i2cSim) {
+        BosonSimPrintStats();
+        I2cBusSetBackend(NULL);
+        BosonSimFini();
+    }
+}
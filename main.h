@@ -16,6 +16,10 @@
 #define __MAIN_H__
 
 #include "cmdline.h"
+#include "cmdQueue.h"
+#include "thread_utils.h"
+#include "threadSched.h"
+#include "workPool.h"
 
 enum {
     CAPTURE_ELEMENT = 0,
@@ -25,15 +29,52 @@ enum {
     MAX_NUM_ELEMENTS,
 };
 
+#define PIPELINE_MAX_CHANNELS   4       // NVMEDIA_ICP_MAX_VIRTUAL_GROUPS
+
+/* What a stage does with a frame when the next stage's queue is full */
+typedef enum {
+    QUEUE_POLICY_BLOCK = 0,                     // wait for room, lossless
+    QUEUE_POLICY_DROP_NEWEST,                   // drop the frame being put
+    QUEUE_POLICY_LATEST,                        // drop the oldest queued frame
+} QueuePolicy;
+
+/* One stage thread's connection to the next stage, only that thread
+ * updates the counters */
+typedef struct {
+    NvQueue                    *queue;          // NULL returns frames to the pool
+    QueuePolicy                 policy;
+    volatile NvMediaBool       *quit;
+    uint64_t                    frames;         // handed to the next stage
+    uint64_t                    droppedNewest;
+    uint64_t                    droppedOldest;
+    uint64_t                    waits;          // put timeouts while blocking
+} PipelineLink;
+
+typedef struct {
+    uint32_t                    element;
+    uint32_t                    queueDepth;     // 0 for the buffer pool size
+    QueuePolicy                 policy;         // for the input queue
+    ThreadSched                 sched[PIPELINE_MAX_CHANNELS];
+    PipelineLink                output[PIPELINE_MAX_CHANNELS];
+} PipelineNode;
+
 typedef struct {
     void                        *ctxs[MAX_NUM_ELEMENTS];
+    PipelineNode                 pipeline[MAX_NUM_ELEMENTS];
+    uint32_t                     numStages;
     TestArgs                    *testArgs;
     volatile NvMediaBool         quit;
-    volatile NvMediaBool         videoEnabled;
-    char                        *cmd;
+    volatile uint32_t            videoEnabled;   // bit per recording channel
+    CmdQueue                    *cmdQueue;      // owned by the caller of Run
+    WorkPool                    *workPool;      // NULL without --workers
 } NvMainContext;
 
 int Run(TestArgs *allArgs, NvMainContext *mainCtx);
 
+/* Releases what other threads calling into the I2C layer, such as the
+ * command listener, may still use when Run returns. Call once they are
+ * joined. */
+void RunFini(TestArgs *allArgs);
+
 #endif
 
@@ -4,8 +4,6 @@
   * October-2019
 */
 #include <string>
-#include <fstream>
-#include <regex>
 #include <thread>
 #include "commandListener.h"
 #include "nvidiaInterface.h"
@@ -17,6 +15,8 @@ extern "C" {
     #include "opencvConnector.h"
     #include "helpers.h"
     #include "log_utils.h"
+    #include "scriptCache.h"
+    #include "capture.h"
 }
 
 #define BAUD_RATE 921600
@@ -33,11 +33,15 @@ CommandFromInt(uint16_t *dst, uint32_t src) {
 }
 
 NvidiaInterface::NvidiaInterface() {
-    mainCtx.quit = 0;
+    memset(&mainCtx, 0, sizeof(mainCtx));
+    if(CmdQueueCreate(&mainCtx.cmdQueue) != NVMEDIA_STATUS_OK) {
+        LOG_ERR("Failed to create command queue");
+    }
 }
 
 NvidiaInterface::~NvidiaInterface() {
     Close();
+    CmdQueueDestroy(mainCtx.cmdQueue);
 }
 
 void NvidiaInterface::run(CmdArgs args) {
@@ -63,6 +67,9 @@ void NvidiaInterface::run(CmdArgs args) {
 }
 
 void NvidiaInterface::run(TestArgs *args) {
+    // bring-up resets the camera so anything cached before is stale
+    invalidateCache();
+
     if(args->wrregs.isUsed) {
         getI2CInfo(args->wrregs.stringValue, &i2cDevice, &sensorAddress);
     }
@@ -72,76 +79,59 @@ void NvidiaInterface::run(TestArgs *args) {
     Run(args, &mainCtx);
 }
 
+void NvidiaInterface::finish(TestArgs *args) {
+    RunFini(args);
+}
+
 bool NvidiaInterface::isRunning() {
     return !mainCtx.quit;
 }
 
 std::string NvidiaInterface::getUserInput() {
-    if(!mainCtx.cmd) {
+    char input[MAX_STRING_SIZE];
+
+    if(CmdQueueGet(mainCtx.cmdQueue, input, sizeof(input)) != NVMEDIA_STATUS_OK) {
         return "";
     }
-    std::string input(mainCtx.cmd);
-    return input;
-}
-
-void NvidiaInterface::flushInput() {
-    memset(mainCtx.cmd, 0, sizeof(mainCtx.cmd));
+    return std::string(input);
 }
 
 bool NvidiaInterface::getI2CInfo(char *filename, int *deviceHandle, 
     int *sensorHandle)
 {
-    std::ifstream f;
-    f.open(filename);
-    if(!f.is_open()) {
+    CaptureConfigParams params;
+
+    memset(&params, 0, sizeof(params));
+    if(LoadRegistersParams(filename, &params) != NVMEDIA_STATUS_OK) {
         return false;
     }
 
-    while(!f.eof()) {
-        std::string line;
-        std::getline(f, line);
-
-        std::cmatch matches;
-        std::regex re(";\\s*I2C Device:\\s*(\\d+).*$", 
-            std::regex_constants::icase);
-        if(std::regex_match(line.c_str(), matches, re)) {
-            *deviceHandle = atoi(matches[1].str().c_str());
-        }
-
-        re.assign(";\\s*Sensor Address:\\s*0[xX]([0-9A-Fa-f]+).*$", 
-            std::regex_constants::icase);
-        if(std::regex_match(line.c_str(), matches, re)) {
-            char *p;
-            long res = strtol(matches[1].str().c_str(), &p, 16);
-            if(*p == 0) {
-                *sensorHandle = (int)(res / 2);
-            }
-        }
-        
-        if(*deviceHandle > -1 && *sensorHandle > -1) {
-            break;
-        }
+    if(params.i2cDevice.isUsed) {
+        *deviceHandle = params.i2cDevice.intValue;
+    }
+    if(params.sensorAddress.isUsed) {
+        *sensorHandle = (int)params.sensorAddress.uIntValue;
     }
 
     return true;
 }
 
-void NvidiaInterface::getFrame(uint8_t *frame) {
+void NvidiaInterface::getFrame(uint8_t *frame, uint32_t virtualChannel) {
     if(i2cDevice == -1 || sensorAddress == -1) {
         LOG_ERR("Application must be running to use command");
         return;
     }
 
-    Opencv_getFrame(frame);
+    Opencv_getFrame(virtualChannel, frame);
 }
 
-void NvidiaInterface::getTelemetry(uint8_t *telemetry) {
+void NvidiaInterface::getTelemetry(uint8_t *telemetry, uint32_t virtualChannel) {
     if(i2cDevice == -1 || sensorAddress == -1) {
         LOG_ERR("Application must be running to use command");
         return;
     }
 
-    Opencv_getTelemetry(telemetry);
+    Opencv_getTelemetry(virtualChannel, telemetry);
 }
 
 void NvidiaInterface::ffc() {
@@ -168,6 +158,11 @@ uint32_t NvidiaInterface::getSerialNumber() {
         return 0;
     }
 
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if(cache.serialNumberValid) {
+        return cache.serialNumber;
+    }
+
     uint32_t sn = 0;
     FLR_RESULT result = bosonGetCameraSN(&sn);
     if(result != R_SUCCESS) {
@@ -175,6 +170,8 @@ uint32_t NvidiaInterface::getSerialNumber() {
         return 0;
     }
 
+    cache.serialNumber = sn;
+    cache.serialNumberValid = true;
     return sn;
 }
 
@@ -184,6 +181,9 @@ void NvidiaInterface::setColors(const FLIR_COLOR color) {
         return;
     }
 
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    cache.sceneColorValid = false;
+
     FLR_RESULT result = colorLutSetId((FLR_COLORLUT_ID_E)color);
     if(result != R_SUCCESS) {
         LOG_ERR("Error setting value");
@@ -196,14 +196,21 @@ std::string NvidiaInterface::getSceneColor() {
         return "";
     }
 
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if(cache.sceneColorValid) {
+        return cache.sceneColor;
+    }
+
     FLR_COLORLUT_ID_E color;
     FLR_RESULT result = colorLutGetId(&color);
     if(result != R_SUCCESS) {
         LOG_ERR("Error getting value");
-        return 0;
+        return "";
     }
-    
-    return ColorToString((FLIR_COLOR)color);
+
+    cache.sceneColor = ColorToString((FLIR_COLOR)color);
+    cache.sceneColorValid = true;
+    return cache.sceneColor;
 }
 
 void NvidiaInterface::setFfcMode(FLIR_FFCMODE ffcMode) {
@@ -212,6 +219,9 @@ void NvidiaInterface::setFfcMode(FLIR_FFCMODE ffcMode) {
         return;
     }
 
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    cache.ffcModeValid = false;
+
     FLR_RESULT result = bosonSetFFCMode((FLR_BOSON_FFCMODE_E)ffcMode);
     if(result != R_SUCCESS) {
         LOG_ERR("Error setting value");
@@ -224,13 +234,21 @@ std::string NvidiaInterface::getFfcMode() {
         return "";
     }
 
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if(cache.ffcModeValid) {
+        return cache.ffcMode;
+    }
+
     FLR_BOSON_FFCMODE_E mode;
     FLR_RESULT result = bosonGetFFCMode(&mode);
     if(result != R_SUCCESS) {
         LOG_ERR("Error getting value");
+        return "";
     }
-    
-    return FFCModeToString((FLIR_FFCMODE)mode);
+
+    cache.ffcMode = FFCModeToString((FLIR_FFCMODE)mode);
+    cache.ffcModeValid = true;
+    return cache.ffcMode;
 }
 
 std::string NvidiaInterface::getPartNumber() {
@@ -239,17 +257,24 @@ std::string NvidiaInterface::getPartNumber() {
         return "";
     }
 
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if(cache.partNumberValid) {
+        return cache.partNumber;
+    }
+
     FLR_BOSON_PARTNUMBER_T pnRes;
     FLR_RESULT result = bosonGetCameraPN(&pnRes);
     if(result != R_SUCCESS) {
         LOG_ERR("Error getting value");
+        return "";
     }
     
     char pn[64];
     sprintf(pn, "%s", pnRes.value);
-    std::string pnStr(pn);
 
-    return pnStr;
+    cache.partNumber = std::string(pn);
+    cache.partNumberValid = true;
+    return cache.partNumber;
 }
 
 std::string NvidiaInterface::getVideoType() {
@@ -258,13 +283,21 @@ std::string NvidiaInterface::getVideoType() {
         return "";
     }
 
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if(cache.videoTypeValid) {
+        return cache.videoType;
+    }
+
     FLR_DVO_TYPE_E video;
     FLR_RESULT result = dvoGetType(&video);
     if(result != R_SUCCESS) {
-        LOG_ERR("Error getting value");        
+        LOG_ERR("Error getting value");
+        return "";
     }
-    
-    return VideoTypeToString((FLIR_VIDEO)video);
+
+    cache.videoType = VideoTypeToString((FLIR_VIDEO)video);
+    cache.videoTypeValid = true;
+    return cache.videoType;
 }
 
 void NvidiaInterface::runI2CCommand(uint32_t cmd) {
@@ -275,7 +308,10 @@ void NvidiaInterface::runI2CCommand(uint32_t cmd) {
     uint16_t cmdBody[4];
     CommandFromInt(cmdBody, cmd);
 
+    // raw commands can change or reset anything we have cached, a getter
+    // running meanwhile may have cached the old value
     RunVoidCommand(i2cDevice, sensorAddress, cmdBody, NULL);
+    invalidateCache();
 }
 
 uint32_t NvidiaInterface::getI2CInt(uint32_t cmd) {
@@ -313,7 +349,27 @@ void NvidiaInterface::setI2CInt(uint32_t cmd, uint32_t val) {
     uint16_t cmdBody[4];
     CommandFromInt(cmdBody, cmd);
 
+    // raw commands can change or reset anything we have cached, a getter
+    // running meanwhile may have cached the old value
     RunVoidCommand(i2cDevice, sensorAddress, cmdBody, &val);
+    invalidateCache();
+}
+
+bool NvidiaInterface::runI2CBatch(std::vector<BosonBatchCommand> &cmds) {
+    if(i2cDevice == -1 || sensorAddress == -1) {
+        LOG_ERR("Application must be running to use command");
+        return false;
+    }
+    if(cmds.empty()) {
+        return true;
+    }
+
+    // raw commands can change or reset anything we have cached, a getter
+    // running meanwhile may have cached the old value
+    NvMediaStatus status = RunCommandBatch(i2cDevice, sensorAddress,
+        cmds.data(), cmds.size());
+    invalidateCache();
+    return status == NVMEDIA_STATUS_OK;
 }
 
 uint32_t NvidiaInterface::getFps() {
@@ -321,27 +377,40 @@ uint32_t NvidiaInterface::getFps() {
         LOG_ERR("Application must be running to use command");
         return 0;
     }
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if(cache.fpsValid) {
+        return cache.fps;
+    }
+
     uint32_t fps;
+    if(GetFPS(i2cDevice, sensorAddress, &fps) != NVMEDIA_STATUS_OK) {
+        LOG_ERR("Error getting value");
+        return 0;
+    }
 
-    GetFPS(i2cDevice, sensorAddress, &fps);
-    
+    cache.fps = fps;
+    cache.fpsValid = true;
     return fps;
 }
 
-void NvidiaInterface::startRecording(std::string filename) {
+void NvidiaInterface::startRecording(std::string filename, uint32_t virtualChannel) {
     if(i2cDevice == -1 || sensorAddress == -1) {
         LOG_ERR("Application must be running to use command");
         return;
     }
-    if(mainCtx.videoEnabled) {
-        LOG_WARN("Video already recording");
+    if(virtualChannel >= OPENCV_MAX_CHANNELS) {
+        LOG_ERR("Invalid virtual channel %u", virtualChannel);
+        return;
+    }
+    if(mainCtx.videoEnabled & (1 << virtualChannel)) {
+        LOG_WARN("Video already recording on channel %u", virtualChannel);
         return;
     }
 
-    mainCtx.videoEnabled = 1;
+    mainCtx.videoEnabled |= 1 << virtualChannel;
 
     uint32_t fps = getFps();
-    Opencv_startRecording(fps, (char *)filename.c_str());
+    Opencv_startRecording(virtualChannel, fps, (char *)filename.c_str());
 }
 
 void NvidiaInterface::stopRecording() {
@@ -353,18 +422,65 @@ void NvidiaInterface::stopRecording() {
         LOG_WARN("Video not running");
     }
 
-    mainCtx.videoEnabled = 0;
+    for(uint32_t i = 0; i < OPENCV_MAX_CHANNELS; i++) {
+        if(mainCtx.videoEnabled & (1 << i)) {
+            mainCtx.videoEnabled &= ~(1 << i);
+            Opencv_stopRecording(i);
+        }
+    }
+}
+
+void NvidiaInterface::captureImage(std::string filename, uint32_t virtualChannel) {
+    if(i2cDevice == -1 || sensorAddress == -1) {
+        LOG_ERR("Application must be running to use command");
+        return;
+    }
+
+    Opencv_captureImage(virtualChannel, (char *)filename.c_str());
+}
+
+void NvidiaInterface::dumpRegisters(std::string filename) {
+    if(i2cDevice == -1 || sensorAddress == -1) {
+        LOG_ERR("Application must be running to use command");
+        return;
+    }
+
+    if(CaptureDumpRegisters(&mainCtx, filename.c_str()) != NVMEDIA_STATUS_OK) {
+        LOG_ERR("Failed to queue register dump");
+    }
+}
+
+void NvidiaInterface::reconfigure(uint32_t virtualChannel, std::string filename) {
+    if(i2cDevice == -1 || sensorAddress == -1) {
+        LOG_ERR("Application must be running to use command");
+        return;
+    }
+
+    if(CaptureReconfigure(&mainCtx, virtualChannel, filename.c_str()) != NVMEDIA_STATUS_OK) {
+        LOG_ERR("Failed to reconfigure channel %u", virtualChannel);
+    }
+    // the video type and related attributes may have changed
+    invalidateCache();
+}
 
-    Opencv_stopRecording();
+void NvidiaInterface::invalidateCache() {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    cache = AttributeCache();
 }
 
-void NvidiaInterface::captureImage(std::string filename) {
+void NvidiaInterface::refresh() {
     if(i2cDevice == -1 || sensorAddress == -1) {
         LOG_ERR("Application must be running to use command");
         return;
     }
 
-    Opencv_captureImage((char *)filename.c_str());
+    invalidateCache();
+    getSerialNumber();
+    getPartNumber();
+    getVideoType();
+    getFps();
+    getSceneColor();
+    getFfcMode();
 }
 
 std::string NvidiaInterface::FFCModeToString(FLIR_FFCMODE val) {
@@ -417,6 +533,7 @@ int main(int argc, char **argv) {
     mainThread.join();
     listener.stop();
     listenerThread.join();
+    interface->finish(&allArgs);
 
     delete interface;
     // for running with no command line arguments
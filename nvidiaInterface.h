@@ -8,6 +8,8 @@
 
 #include <iostream>
 #include <cstdint>
+#include <mutex>
+#include <vector>
 
 extern "C" {
     #include "main.h"
@@ -64,19 +66,21 @@ class NvidiaInterface {
         void run(CmdArgs args);
         // starts streaming frames to OpenCV window
         void run(TestArgs *args);
+        // releases the I2C tracer and simulator once no thread sends
+        // commands anymore
+        void finish(TestArgs *args);
         // checks whether application is running
         bool isRunning();
-        // gets user input from the terminal
+        // waits for the next command typed in the terminal, returns an
+        // empty string once the application stops
         std::string getUserInput();
-        // clears input from the terminal
-        void flushInput();
-        // gets the current streaming frame pixel data
-        void getFrame(uint8_t *frame);
-        // gets the telemetry line
-        void getTelemetry(uint8_t *telemetry);
-        // starts recording video and saves stream to filename
-        void startRecording(std::string filename);
-        // stops recording video
+        // gets the current streaming frame pixel data of a virtual channel
+        void getFrame(uint8_t *frame, uint32_t virtualChannel = 0);
+        // gets the telemetry line of a virtual channel
+        void getTelemetry(uint8_t *telemetry, uint32_t virtualChannel = 0);
+        // starts recording a virtual channel and saves stream to filename
+        void startRecording(std::string filename, uint32_t virtualChannel = 0);
+        // stops recording video on every channel
         void stopRecording();
         // triggers FFC shutter
         void ffc();
@@ -106,13 +110,44 @@ class NvidiaInterface {
         std::string getI2CString(uint32_t cmd);
         // sets command for I2C 
         void setI2CInt(uint32_t cmd, uint32_t val);
-        // captures still image
-        void captureImage(std::string filename);
+        // runs several I2C commands in one spooling window, filling in
+        // the status and response of each
+        bool runI2CBatch(std::vector<BosonBatchCommand> &cmds);
+        // captures still image of a virtual channel
+        void captureImage(std::string filename, uint32_t virtualChannel = 0);
+        // writes a snapshot of the script and deserializer registers to
+        // filename without stopping capture
+        void dumpRegisters(std::string filename);
+        // switches a channel to the capture format of another script while
+        // the other channels keep running
+        void reconfigure(uint32_t virtualChannel, std::string filename);
+        // discards cached camera attributes so they are read again on next use
+        void invalidateCache();
+        // re-reads all cached camera attributes from the camera
+        void refresh();
     private:
         int i2cDevice = -1;
         int sensorAddress = -1;
 
+        // attributes that only change when we set them or reset the camera
+        struct AttributeCache {
+            bool serialNumberValid = false;
+            uint32_t serialNumber = 0;
+            bool partNumberValid = false;
+            std::string partNumber;
+            bool videoTypeValid = false;
+            std::string videoType;
+            bool fpsValid = false;
+            uint32_t fps = 0;
+            bool sceneColorValid = false;
+            std::string sceneColor;
+            bool ffcModeValid = false;
+            std::string ffcMode;
+        };
+
         NvMainContext mainCtx;
+        AttributeCache cache;
+        std::mutex cacheMutex;
         bool getI2CInfo(char *filename, int *deviceHandle, int *sensorHandle);
         std::string ColorToString(FLIR_COLOR val);
         std::string FFCModeToString(FLIR_FFCMODE val);
@@ -4,6 +4,8 @@
   * October-2019
 */
 #include <cstdlib>
+#include <mutex>
+#include <string>
 
 #include "opencvConnector.h"
 #include "opencvWrapper.h"
@@ -16,97 +18,126 @@ extern "C" {
 
 // Inside this "extern C" block, I can define C functions that are able to call C++ code
 
-static OpencvWrapper *opencv = NULL;
+// created by the first frame of each virtual channel
+static OpencvWrapper *opencv[OPENCV_MAX_CHANNELS] = {};
+static std::mutex opencvMutex;
 
-void initWrapper(int width, int height, int bytesPerPixel) {
-    if (opencv == NULL) {
-        opencv = new OpencvWrapper(width, height, bytesPerPixel);
+void initWrapper(uint32_t channel, int width, int height, int bytesPerPixel) {
+    std::lock_guard<std::mutex> lock(opencvMutex);
+    if (opencv[channel] == NULL) {
+        opencv[channel] = new OpencvWrapper(width, height, bytesPerPixel,
+            "Boson VC" + std::to_string(channel));
     }
 }
 
+static OpencvWrapper *getWrapper(uint32_t channel) {
+    if(channel >= OPENCV_MAX_CHANNELS) {
+        LOG_ERR("Invalid virtual channel %u", channel);
+        return NULL;
+    }
+    std::lock_guard<std::mutex> lock(opencvMutex);
+    if(!opencv[channel]) {
+        LOG_ERR("OpenCV object of channel %u must be initialized", channel);
+    }
+    return opencv[channel];
+}
+
 void Opencv_hello() {
-    initWrapper(512, 512, 1);
-    opencv->hello();
+    initWrapper(0, 512, 512, 1);
+    opencv[0]->hello();
 }
 
-void Opencv_sendFrame(uint8_t *data, int width, int height, int bytesPerPixel) {
-    initWrapper(width, height, bytesPerPixel);
-    opencv->sendFrame(data);
+void Opencv_sendFrame(uint32_t channel, uint8_t *data, int width, int height,
+    int bytesPerPixel)
+{
+    if(channel >= OPENCV_MAX_CHANNELS) {
+        LOG_ERR("Invalid virtual channel %u", channel);
+        return;
+    }
+    initWrapper(channel, width, height, bytesPerPixel);
+    OpencvWrapper *wrapper = getWrapper(channel);
+    if(wrapper->setFormat(width, height, bytesPerPixel)) {
+        LOG_WARN("VC %u frame format changed to %dx%d, %d bytes per pixel",
+            channel, width, height, bytesPerPixel);
+    }
+    wrapper->sendFrame(data);
 }
 
-void Opencv_sendTelemetry(uint8_t *data, int stride) {
-    if(!opencv) {
-        LOG_ERR("OpenCV object must be initialized");
+void Opencv_sendTelemetry(uint32_t channel, uint8_t *data, int stride) {
+    OpencvWrapper *wrapper = getWrapper(channel);
+    if(!wrapper) {
         return;
     }
-    opencv->sendTelemetry(data, stride);
+    wrapper->sendTelemetry(data, stride);
 }
 
-void Opencv_display() {
-    if(!opencv) {
-        LOG_ERR("OpenCV object must be initialized");
+void Opencv_display(uint32_t channel) {
+    OpencvWrapper *wrapper = getWrapper(channel);
+    if(!wrapper) {
         return;
     }
-    opencv->display();
+    wrapper->display();
 }
 
-void Opencv_startRecording(int fps, char *filename) {
-    if(!opencv) {
-        LOG_ERR("OpenCV object must be initialized");
+void Opencv_startRecording(uint32_t channel, int fps, char *filename) {
+    OpencvWrapper *wrapper = getWrapper(channel);
+    if(!wrapper) {
         return;
     }
-    opencv->startRecording(fps, filename);
+    wrapper->startRecording(fps, filename);
 }
 
-void Opencv_stopRecording() {
-    if(!opencv) {
-        LOG_ERR("OpenCV object must be initialized");
+void Opencv_stopRecording(uint32_t channel) {
+    OpencvWrapper *wrapper = getWrapper(channel);
+    if(!wrapper) {
         return;
     }
-    opencv->stopRecording();
+    wrapper->stopRecording();
 }
 
-void Opencv_recordFrame() {
-    if(!opencv) {
-        LOG_ERR("OpenCV object must be initialized");
+void Opencv_recordFrame(uint32_t channel, uint8_t *data, int width, int height,
+    int bytesPerPixel)
+{
+    OpencvWrapper *wrapper = getWrapper(channel);
+    if(!wrapper) {
         return;
     }
-    opencv->recordFrame();
+    wrapper->recordFrame(data, width, height, bytesPerPixel);
 }
 
-uint32_t Opencv_getSerialNumber() {
-    if(!opencv) {
-        LOG_ERR("OpenCV object must be initialized");
+uint32_t Opencv_getSerialNumber(uint32_t channel) {
+    OpencvWrapper *wrapper = getWrapper(channel);
+    if(!wrapper) {
         return 0;
     }
-    return opencv->getSerialNumber();
+    return wrapper->getSerialNumber();
 }
 
-void Opencv_getFrame(uint8_t *data) {
-    if(!opencv) {
-        LOG_ERR("OpenCV object must be initialized");
+void Opencv_getFrame(uint32_t channel, uint8_t *data) {
+    OpencvWrapper *wrapper = getWrapper(channel);
+    if(!wrapper) {
         return;
     }
 
-    return opencv->getFrame(data);
+    return wrapper->getFrame(data);
 }
 
-void Opencv_getTelemetry(uint8_t *telemetry) {
-    if(!opencv) {
-        LOG_ERR("OpenCV object must be initialized");
+void Opencv_getTelemetry(uint32_t channel, uint8_t *telemetry) {
+    OpencvWrapper *wrapper = getWrapper(channel);
+    if(!wrapper) {
         return;
     }
 
-    return opencv->getTelemetry(telemetry);
+    return wrapper->getTelemetry(telemetry);
 }
 
-void Opencv_captureImage(char *filename) {
-    if(!opencv) {
-        LOG_ERR("OpenCV object must be initialized");
+void Opencv_captureImage(uint32_t channel, char *filename) {
+    OpencvWrapper *wrapper = getWrapper(channel);
+    if(!wrapper) {
         return;
     }
 
-    return opencv->saveImage(filename);
+    return wrapper->saveImage(filename);
 }
 
 #ifdef __cplusplus
@@ -8,21 +8,26 @@
 
 #include <stdint.h>
 
+// one frame buffer, window and recorder per virtual channel
+#define OPENCV_MAX_CHANNELS 4
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 void Opencv_hello();
-void Opencv_sendFrame(uint8_t *data, int width, int height, int bytesPerPixel);
-void Opencv_sendTelemetry(uint8_t *data, int stride);
-void Opencv_display();
-void Opencv_startRecording(int fps, char *filename);
-void Opencv_stopRecording();
-void Opencv_recordFrame();
-uint32_t Opencv_getSerialNumber();
-void Opencv_getFrame(uint8_t *data);
-void Opencv_getTelemetry(uint8_t *telemetry);
-void Opencv_captureImage(char *filename);
+void Opencv_sendFrame(uint32_t channel, uint8_t *data, int width, int height,
+    int bytesPerPixel);
+void Opencv_sendTelemetry(uint32_t channel, uint8_t *data, int stride);
+void Opencv_display(uint32_t channel);
+void Opencv_startRecording(uint32_t channel, int fps, char *filename);
+void Opencv_stopRecording(uint32_t channel);
+void Opencv_recordFrame(uint32_t channel, uint8_t *data, int width, int height,
+    int bytesPerPixel);
+uint32_t Opencv_getSerialNumber(uint32_t channel);
+void Opencv_getFrame(uint32_t channel, uint8_t *data);
+void Opencv_getTelemetry(uint32_t channel, uint8_t *telemetry);
+void Opencv_captureImage(uint32_t channel, char *filename);
 
 #ifdef __cplusplus
 }
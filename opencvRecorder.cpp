@@ -10,12 +10,11 @@ OpencvRecorder::OpencvRecorder() {
 }
 
 OpencvRecorder::OpencvRecorder(cv::Mat img, int fps, std::string filename) {
-    image = img;
     width = img.cols;
     height = img.rows;
 
     // there does not seem to be a codec for saving 16 bit grayscale video
-    recorder = cv::VideoWriter(filename, image.type(), 
+    recorder = cv::VideoWriter(filename, img.type(), 
         fps, cv::Size(width, height), false);
     recording = true;
 }
@@ -24,8 +23,8 @@ OpencvRecorder::~OpencvRecorder() {
     stop();
 }
 
-void OpencvRecorder::captureFrame() {
-    recorder.write(image);
+void OpencvRecorder::captureFrame(const cv::Mat &frame) {
+    recorder.write(frame);
 }
 
 void OpencvRecorder::stop() {
@@ -22,11 +22,10 @@ class OpencvRecorder {
         OpencvRecorder();
         OpencvRecorder(cv::Mat img, int fps, std::string filename);
         ~OpencvRecorder();
-        void captureFrame();
+        void captureFrame(const cv::Mat &frame);
         void stop();
     private:
         cv::VideoWriter recorder;
-        cv::Mat image;
 };
 
 #endif
\ No newline at end of file
@@ -7,11 +7,16 @@
 
 #include "opencvWrapper.h"
 
-OpencvWrapper::OpencvWrapper(int width, int height, int bytesPerPixel) :
+std::mutex OpencvWrapper::guiMutex;
+
+OpencvWrapper::OpencvWrapper(int width, int height, int bytesPerPixel,
+    std::string windowName) :
     width(width),
     height(height),
     bytesPerPixel(bytesPerPixel),
-    imgBuffer(nullptr)
+    windowName(windowName),
+    imgBuffer(nullptr),
+    telemetry(nullptr)
 {
 }
 
@@ -35,15 +40,45 @@ void OpencvWrapper::hello() {
     cv::waitKey();
 }
 
+bool OpencvWrapper::setFormat(int width, int height, int bytesPerPixel) {
+    std::lock_guard<std::mutex> lock(imgMutex);
+    if(width == this->width && height == this->height &&
+        bytesPerPixel == this->bytesPerPixel)
+    {
+        return false;
+    }
+
+    // the recorder writes frames of the old size from the old buffer
+    if(recorder.recording) {
+        recorder.stop();
+    }
+
+    // buffers are allocated again by the next frame and telemetry
+    delete[] imgBuffer;
+    delete[] telemetry;
+    imgBuffer = nullptr;
+    telemetry = nullptr;
+    img = cv::Mat();
+    this->width = width;
+    this->height = height;
+    this->bytesPerPixel = bytesPerPixel;
+    return true;
+}
+
 void OpencvWrapper::sendFrame(uint8_t *data) {
     setImgBuffer(data);
 }
 
 void OpencvWrapper::getFrame(uint8_t *data) {
+    std::lock_guard<std::mutex> lock(imgMutex);
+    if(!imgBuffer) {
+        return;
+    }
     memcpy(data, imgBuffer, width * height * bytesPerPixel * sizeof(uint8_t));
 }
 
 void OpencvWrapper::getTelemetry(uint8_t *data) {
+    std::lock_guard<std::mutex> lock(imgMutex);
     if(!telemetry) {
         return;
     }
@@ -51,11 +86,19 @@ void OpencvWrapper::getTelemetry(uint8_t *data) {
 }
 
 void OpencvWrapper::display() {
-    cv::imshow("Boson", img);
+    std::lock_guard<std::mutex> guiLock(guiMutex);
+    {
+        std::lock_guard<std::mutex> lock(imgMutex);
+        if(img.empty()) {
+            return;
+        }
+        cv::imshow(windowName, img);
+    }
     cv::waitKey(1);
 }
 
 void OpencvWrapper::setImgBuffer(uint8_t *data) {
+    std::lock_guard<std::mutex> lock(imgMutex);
     if(!imgBuffer) {
         imgBuffer = new uint8_t[width * height * bytesPerPixel];
         int pixelType = CV_8UC1;
@@ -65,29 +108,49 @@ void OpencvWrapper::setImgBuffer(uint8_t *data) {
         img = cv::Mat(height, width, pixelType, 
             reinterpret_cast<void *>(imgBuffer));
     }
+    // the capture stage already stretched the frame
     memcpy(imgBuffer, data, width * height * bytesPerPixel);
-
-    agc();
 }
 
 void OpencvWrapper::startRecording(int fps, std::string filename) {
+    std::lock_guard<std::mutex> lock(imgMutex);
     // assume that a frame as been captured (img has been initialized) before calling this
     recorder = OpencvRecorder(img, fps, filename);
 }
 
 void OpencvWrapper::stopRecording() {
+    std::lock_guard<std::mutex> lock(imgMutex);
     recorder.stop();
 }
 
-void OpencvWrapper::recordFrame() {
+void OpencvWrapper::recordFrame(uint8_t *data, int width, int height,
+    int bytesPerPixel)
+{
+    std::lock_guard<std::mutex> lock(imgMutex);
     if(!recorder.recording) {
         return;
     }
+    // the recording was started with this channel's current format
+    if(width != this->width || height != this->height ||
+        bytesPerPixel != this->bytesPerPixel)
+    {
+        return;
+    }
 
-    recorder.captureFrame();
+    int pixelType = CV_8UC1;
+    if(bytesPerPixel == 2) {
+        pixelType = CV_16UC1;
+    }
+    // stretched by the capture stage like the displayed frames
+    cv::Mat frame(height, width, pixelType, reinterpret_cast<void *>(data));
+    recorder.captureFrame(frame);
 }
 
 void OpencvWrapper::saveImage(std::string filename) {
+    std::lock_guard<std::mutex> lock(imgMutex);
+    if(!imgBuffer) {
+        return;
+    }
     uint8_t *tempBuffer = (uint8_t*)malloc(width * height * bytesPerPixel * sizeof(uint8_t));
     memcpy(tempBuffer, imgBuffer, width * height * bytesPerPixel);
     int pixelType = CV_8UC1;
@@ -101,6 +164,7 @@ void OpencvWrapper::saveImage(std::string filename) {
 }
 
 void OpencvWrapper::sendTelemetry(uint8_t *data, int stride) {
+    std::lock_guard<std::mutex> lock(imgMutex);
     int serialStart = 2;
 
     if(!telemetry) {
@@ -116,13 +180,4 @@ void OpencvWrapper::sendTelemetry(uint8_t *data, int stride) {
 
 uint32_t OpencvWrapper::getSerialNumber() {
     return serialNumber;
-}
-
-void OpencvWrapper::agc() {
-    int bytesPerPixel = 1;
-    if(img.type() == CV_16UC1) {
-        bytesPerPixel = 2;
-    }
-
-    cv::normalize(img, img, 0, 1 << (8 * bytesPerPixel) - 1, cv::NORM_MINMAX);
 }
\ No newline at end of file
@@ -8,6 +8,8 @@
 
 #include <stdint.h>
 #include <iostream>
+#include <mutex>
+#include <string>
 
 #include <opencv2/highgui/highgui.hpp>
 #include "opencv2/imgproc.hpp"
@@ -16,10 +18,14 @@
 
 class OpencvWrapper {
     public:
-        OpencvWrapper(int width, int height, int bytesPerPixel);
+        OpencvWrapper(int width, int height, int bytesPerPixel,
+            std::string windowName);
         ~OpencvWrapper();
         // hello world display for testing openCV operability
         void hello();
+        // reallocates the frame buffers and stops recording when the frame
+        // format changes, returns whether it did
+        bool setFormat(int width, int height, int bytesPerPixel);
         // saves new frame to object state
         void sendFrame(uint8_t *data);
         // saves telemetry data to object state
@@ -28,28 +34,33 @@ class OpencvWrapper {
         void getFrame(uint8_t *data);
         // returns a copy of the telemetry data
         void getTelemetry(uint8_t *data);
-        // sends frame to openCV display window
+        // sends frame to this channel's openCV display window
         void display();
         // starts recording video
         void startRecording(int fps, std::string filename);
         // stops recording video
         void stopRecording();
-        // writes frame to video
-        void recordFrame();
+        // writes the given frame to video, frames not in the recorded format
+        // are skipped
+        void recordFrame(uint8_t *data, int width, int height,
+            int bytesPerPixel);
         // saves still image
         void saveImage(std::string filename);
         // gets serial number from telemetry data
         uint32_t getSerialNumber();
     private:
         int width, height, bytesPerPixel;
+        std::string windowName;
         uint8_t *imgBuffer;
         uint8_t *telemetry;
         cv::Mat img;
+        std::mutex imgMutex;
+        // HighGUI is shared by the windows of all channels
+        static std::mutex guiMutex;
         OpencvRecorder recorder;
         uint32_t serialNumber;
 
         void setImgBuffer(uint8_t *data);
-        void agc();
 };
 
 #endif
\ No newline at end of file
@@ -15,6 +15,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "testutil_i2c.h"
@@ -22,10 +23,257 @@
 #include "parser.h"
 #include "nvmedia_image.h"
 
+typedef struct {
+    char                        name[MAX_VARIABLE_NAME];
+    char                        value[MAX_STRING_SIZE];
+} ScriptVariable;
+
+typedef struct {
+    ScriptVariable              variables[MAX_SCRIPT_VARIABLES];
+    uint32_t                    numVariables;
+    FILE                       *out;
+    ScriptSources              *sources;        // NULL if not wanted
+} FlattenState;
+
+static ScriptVariable *
+_FindVariable(FlattenState *state, const char *name)
+{
+    uint32_t i;
+
+    for (i = 0; i < state->numVariables; i++) {
+        if (!strcmp(state->variables[i].name, name)) {
+            return &state->variables[i];
+        }
+    }
+    return NULL;
+}
+
+/* Adds the file just opened to the sources, so a cache of the flattened
+ * script can tell when one of them changed */
+static void
+_AddSource(FlattenState *state, const char *filename, FILE *file)
+{
+    ScriptSources *sources = state->sources;
+    ScriptSource *source;
+    struct stat st;
+
+    if (!sources) {
+        return;
+    }
+    if (sources->numFiles == MAX_SCRIPT_SOURCES ||
+        strlen(filename) >= MAX_SCRIPT_PATH ||
+        fstat(fileno(file), &st)) {
+        sources->overflow = NVMEDIA_TRUE;
+        return;
+    }
+
+    source = &sources->files[sources->numFiles++];
+    memset(source, 0, sizeof(ScriptSource));
+    strcpy(source->path, filename);
+    source->size = st.st_size;
+    source->mtimeSec = st.st_mtime;
+#ifndef NVMEDIA_QNX
+    source->mtimeNsec = st.st_mtim.tv_nsec;
+#endif
+}
+
+/* Replaces every ${NAME} of line, comments already removed */
+static NvMediaStatus
+_SubstituteVariables(FlattenState *state, const char *line, char *out,
+                     const char *filename, uint32_t lineNumber)
+{
+    char name[MAX_VARIABLE_NAME];
+    ScriptVariable *variable;
+    const char *end;
+    size_t length = 0, n;
+
+    while (*line) {
+        if (line[0] != '$' || line[1] != '{') {
+            if (length + 1 >= MAX_STRING_SIZE) {
+                goto overflow;
+            }
+            out[length++] = *line++;
+            continue;
+        }
+
+        end = strchr(line + 2, '}');
+        n = end ? (size_t)(end - line - 2) : 0;
+        if (!end || !n || n >= MAX_VARIABLE_NAME) {
+            LOG_ERR("%s: %s:%u: Malformed variable reference\n", __func__,
+                    filename, lineNumber);
+            return NVMEDIA_STATUS_ERROR;
+        }
+        memcpy(name, line + 2, n);
+        name[n] = '\0';
+
+        variable = _FindVariable(state, name);
+        if (!variable) {
+            LOG_ERR("%s: %s:%u: Unknown variable %s\n", __func__,
+                    filename, lineNumber, name);
+            return NVMEDIA_STATUS_ERROR;
+        }
+        n = strlen(variable->value);
+        if (length + n >= MAX_STRING_SIZE) {
+            goto overflow;
+        }
+        memcpy(out + length, variable->value, n);
+        length += n;
+        line = end + 1;
+    }
+
+    out[length] = '\0';
+    return NVMEDIA_STATUS_OK;
+
+overflow:
+    LOG_ERR("%s: %s:%u: Line too long after substitution\n", __func__,
+            filename, lineNumber);
+    return NVMEDIA_STATUS_ERROR;
+}
+
+static NvMediaStatus
+_FlattenFile(FlattenState *state, const char *filename, uint32_t depth)
+{
+    char readLine[MAX_STRING_SIZE];
+    char parsedLine[MAX_STRING_SIZE];
+    char name[MAX_VARIABLE_NAME];
+    char value[MAX_STRING_SIZE];
+    char path[2 * MAX_STRING_SIZE];
+    NvMediaStatus status = NVMEDIA_STATUS_ERROR;
+    ScriptVariable *variable;
+    uint32_t lineNumber = 0;
+    const char *slash;
+    char *memPointer;
+    FILE *file;
+
+    if (depth > MAX_INCLUDE_DEPTH) {
+        LOG_ERR("%s: Includes nested too deep at \"%s\"\n", __func__, filename);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    file = fopen(filename, "r");
+    if (!file) {
+        LOG_ERR("%s: Failed to open file \"%s\"\n", __func__, filename);
+        return NVMEDIA_STATUS_ERROR;
+    }
+    _AddSource(state, filename, file);
+
+    while (fgets(readLine, MAX_STRING_SIZE, file) != NULL) {
+        lineNumber++;
+
+        // Comments and blank lines never reach the flat script
+        memPointer = strpbrk(readLine, "#\r\n");
+        if (memPointer != NULL)
+            *memPointer = '\0';
+
+        if (_SubstituteVariables(state, readLine, parsedLine,
+                                 filename, lineNumber) != NVMEDIA_STATUS_OK) {
+            goto done;
+        }
+
+        // Parse variable in format "; Set NAME VALUE"
+        if (sscanf(parsedLine, "; Set %63s %255s", name, value) == 2) {
+            variable = _FindVariable(state, name);
+            if (!variable) {
+                if (state->numVariables == MAX_SCRIPT_VARIABLES) {
+                    LOG_ERR("%s: %s:%u: Too many variables\n", __func__,
+                            filename, lineNumber);
+                    goto done;
+                }
+                variable = &state->variables[state->numVariables++];
+                strcpy(variable->name, name);
+            }
+            strcpy(variable->value, value);
+        // Parse include in format "; Include FILE", relative to this file
+        } else if (sscanf(parsedLine, "; Include %255s", value) == 1) {
+            slash = strrchr(filename, '/');
+            if (value[0] == '/' || !slash) {
+                strcpy(path, value);
+            } else {
+                snprintf(path, sizeof(path), "%.*s/%s",
+                         (int)(slash - filename), filename, value);
+            }
+            if (_FlattenFile(state, path, depth + 1) != NVMEDIA_STATUS_OK) {
+                LOG_ERR("%s: Included from %s:%u\n", __func__,
+                        filename, lineNumber);
+                goto done;
+            }
+        } else if (parsedLine[strspn(parsedLine, " \t")] != '\0') {
+            fprintf(state->out, "%s\n", parsedLine);
+        }
+    }
+    status = NVMEDIA_STATUS_OK;
+
+done:
+    fclose(file);
+    return status;
+}
+
+NvMediaStatus
+FlattenRegistersFile(const char *filename,
+                     char **text,
+                     size_t *size,
+                     ScriptSources *sources)
+{
+    FlattenState *state;
+    NvMediaStatus status;
+
+    *text = NULL;
+    *size = 0;
+
+    state = calloc(1, sizeof(FlattenState));
+    if (!state) {
+        LOG_ERR("%s: Out of memory\n", __func__);
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+    if (sources) {
+        sources->numFiles = 0;
+        sources->overflow = NVMEDIA_FALSE;
+        state->sources = sources;
+    }
+
+    state->out = open_memstream(text, size);
+    if (!state->out) {
+        LOG_ERR("%s: Out of memory\n", __func__);
+        free(state);
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+
+    status = _FlattenFile(state, filename, 0);
+    fclose(state->out);
+    free(state);
+
+    if (status != NVMEDIA_STATUS_OK) {
+        free(*text);
+        *text = NULL;
+        *size = 0;
+    }
+    return status;
+}
+
 NvMediaStatus
 ParseRegistersFile(char *filename,
                    CaptureConfigParams *params,
                    I2cCommands *allCommands)
+{
+    NvMediaStatus status;
+    size_t size;
+    char *text;
+
+    status = FlattenRegistersFile(filename, &text, &size, NULL);
+    if (status != NVMEDIA_STATUS_OK) {
+        return status;
+    }
+
+    status = ParseRegistersText(text, size, params, allCommands);
+    free(text);
+    return status;
+}
+
+NvMediaStatus
+ParseRegistersText(char *text,
+                   size_t size,
+                   CaptureConfigParams *params,
+                   I2cCommands *allCommands)
 {
     char readLine [MAX_STRING_SIZE];
     char parsedLine [MAX_STRING_SIZE];
@@ -42,17 +290,19 @@ ParseRegistersFile(char *filename,
     uint32_t arrayIndex = 0;
     uint32_t frameNumber = 0;
     uint32_t delayVal = 0;
-    char timeUnit[2];
+    char timeUnit[3];
     char * memPointer = NULL;
     uint8_t i;
     uint8_t count;
+    int numArgs;
     char subAdd[8];
+    uint32_t linkValues[5];
     uint32_t readAddress;
     uint32_t writeAddress;
 
-    FILE * file = fopen(filename, "r");
+    FILE * file = size ? fmemopen(text, size, "r") : NULL;
     if (!file) {
-        LOG_ERR("%s: Failed to open file \"%s\"\n",__func__, filename);
+        LOG_ERR("%s: Script is empty\n",__func__);
         goto failed;
     }
 
@@ -70,6 +320,11 @@ ParseRegistersFile(char *filename,
         arrayIndex = 0;
         frameNumber = 0;
 
+        if (I2cReserveCommands(allCommands, numCommands + 1) !=
+            NVMEDIA_STATUS_OK) {
+            goto failed;
+        }
+
         // Parse for comments ('#' symbol)
         memPointer = strchr(readLine, '#');
         if (memPointer != NULL) // Found comment so set it to line terminator
@@ -86,7 +341,7 @@ ParseRegistersFile(char *filename,
         }
 
         // Parse for delay (starts with ';' symbol)
-        if (sscanf(parsedLine, "; Delay %u%s", &delayVal, timeUnit) == 2) {
+        if (sscanf(parsedLine, "; Delay %u%2s", &delayVal, timeUnit) == 2) {
             if (strcmp(timeUnit, "ms") == 0) {
                 // Convert time to microseconds
                 allCommands->commands[numCommands].delay = delayVal*1000;
@@ -118,6 +373,116 @@ ParseRegistersFile(char *filename,
             LOG_DBG("%s: Do not check for I2C errors\n", __func__);
 #endif
             numCommands++;
+        // Parse burst opt-in in format "; Burst on|off [DEV_ADDR [SUB_ADDR]]",
+        // without a device it applies to all devices
+        } else if ((numArgs = sscanf(parsedLine, "; Burst %3s %x %x", stringBuf,
+                                     &deviceAddress, &address)) >= 1) {
+            if (strcmp(stringBuf, "on") && strcmp(stringBuf, "off")) {
+                LOG_ERR("%s: Burst must be followed by on or off\n", __func__);
+                goto failed;
+            }
+            allCommands->commands[numCommands].commandType = BURST_CFG;
+            allCommands->commands[numCommands].deviceAddress =
+                numArgs == 1 ? BURST_ALL_DEVICES : deviceAddress >> 1;
+            allCommands->commands[numCommands].buffer[0] = !strcmp(stringBuf, "on");
+            allCommands->commands[numCommands].dataLength = 0;
+            if (numArgs == 3) {
+                // check subAdd 1 or 2 bytes
+                sscanf(parsedLine,"%*s %*s %*s %*s %7s", subAdd);
+                if (subAdd[2] != '\0') {
+                    allCommands->commands[numCommands].buffer[1] =
+                        (uint8_t)((address >> 8) & 0xFF);
+                    allCommands->commands[numCommands].buffer[2] =
+                        (uint8_t)(address & 0xFF);
+                    allCommands->commands[numCommands].dataLength = 2;
+                } else {
+                    allCommands->commands[numCommands].buffer[1] =
+                        (uint8_t)(address & 0xFF);
+                    allCommands->commands[numCommands].dataLength = 1;
+                }
+            }
+            numCommands++;
+        // Parse write spacing in format "; Write spacing DEV_ADDR TIME(ms|us)"
+        } else if (sscanf(parsedLine, "; Write spacing %x %u%2s", &deviceAddress,
+                          &delayVal, timeUnit) == 3) {
+            if (strcmp(timeUnit, "ms") == 0) {
+                delayVal *= 1000;
+            } else if (strcmp(timeUnit, "us") != 0) {
+                LOG_ERR("%s: Unknown time unit found!\n", __func__);
+                goto failed;
+            }
+            allCommands->commands[numCommands].commandType = WRITE_SPACING;
+            allCommands->commands[numCommands].deviceAddress = deviceAddress >> 1;
+            memcpy(allCommands->commands[numCommands].buffer, &delayVal,
+                   sizeof(uint32_t));
+            numCommands++;
+        // Parse register poll in format
+        // "; Poll DEV_ADDR SUB_ADDR VALUE MASK TIMEOUT(ms|us)"
+        } else if (sscanf(parsedLine, "; Poll %x %x %x %x %u%2s", &deviceAddress,
+                          &address, &value, &uIntBuf, &delayVal, timeUnit) == 6) {
+            if (strcmp(timeUnit, "ms") == 0) {
+                delayVal *= 1000;
+            } else if (strcmp(timeUnit, "us") != 0) {
+                LOG_ERR("%s: Unknown time unit found!\n", __func__);
+                goto failed;
+            }
+            allCommands->commands[numCommands].commandType = POLL_REG;
+            allCommands->commands[numCommands].deviceAddress = deviceAddress >> 1;
+            // check subAdd 1 or 2 bytes
+            sscanf(parsedLine, "%*s %*s %*s %7s", subAdd);
+            if (subAdd[2] != '\0') {
+                allCommands->commands[numCommands].buffer[0] =
+                    (uint8_t)((address >> 8) & 0xFF);
+                allCommands->commands[numCommands].buffer[1] =
+                    (uint8_t)(address & 0xFF);
+                allCommands->commands[numCommands].dataLength = 2;
+            } else {
+                allCommands->commands[numCommands].buffer[0] =
+                    (uint8_t)(address & 0xFF);
+                allCommands->commands[numCommands].dataLength = 1;
+            }
+            allCommands->commands[numCommands].buffer[2] = (uint8_t)value;
+            allCommands->commands[numCommands].buffer[3] = (uint8_t)uIntBuf;
+            memcpy(&allCommands->commands[numCommands].buffer[4], &delayVal,
+                   sizeof(uint32_t));
+            numCommands++;
+        // Parse link select in format
+        // "; Link select DEV_ADDR SUB_ADDR ALL_LINKS LINK0 [LINK1 [LINK2 [LINK3]]]"
+        } else if ((numArgs = sscanf(parsedLine, "; Link select %x %x %x %x %x %x %x",
+                                     &deviceAddress, &address, &linkValues[0],
+                                     &linkValues[1], &linkValues[2],
+                                     &linkValues[3], &linkValues[4])) >= 4) {
+            allCommands->commands[numCommands].commandType = LINK_SEL_CFG;
+            allCommands->commands[numCommands].deviceAddress = deviceAddress >> 1;
+            // check subAdd 1 or 2 bytes
+            sscanf(parsedLine,"%*s %*s %*s %*s %7s", subAdd);
+            allCommands->commands[numCommands].buffer[LINK_SEL_SUB_LENGTH] =
+                (subAdd[2] != '\0') ? 2 : 1;
+            allCommands->commands[numCommands].buffer[LINK_SEL_SUB_ADDRESS] =
+                (uint8_t)((address >> 8) & 0xFF);
+            allCommands->commands[numCommands].buffer[LINK_SEL_SUB_ADDRESS + 1] =
+                (uint8_t)(address & 0xFF);
+            for (i = 0; i < numArgs - 2; i++) {
+                allCommands->commands[numCommands].buffer[LINK_SEL_ALL + i] =
+                    (uint8_t)linkValues[i];
+            }
+            allCommands->commands[numCommands].dataLength = numArgs - 3;
+            numCommands++;
+        } else if (strstr(parsedLine, "; Link all") != NULL) {
+            allCommands->commands[numCommands].commandType = LINK_SEL;
+            allCommands->commands[numCommands].link = I2C_LINK_ALL;
+            numCommands++;
+        } else if (sscanf(parsedLine, "; Link %u", &uIntBuf) == 1) {
+            allCommands->commands[numCommands].commandType = LINK_SEL;
+            allCommands->commands[numCommands].link = uIntBuf;
+            numCommands++;
+        } else if (sscanf(parsedLine, "; Warm skip %x", &deviceAddress) == 1) {
+            allCommands->commands[numCommands].commandType = WARM_SKIP;
+            allCommands->commands[numCommands].deviceAddress = deviceAddress >> 1;
+            numCommands++;
+        } else if (strstr(parsedLine, "; Barrier") != NULL) {
+            allCommands->commands[numCommands].commandType = BARRIER;
+            numCommands++;
         } else if (sscanf(parsedLine, "; I2C %u",
                   (uint32_t *)&i2cDevice) == 1) {
             allCommands->commands[numCommands].commandType = I2C_DEVICE;
@@ -140,7 +505,7 @@ ParseRegistersFile(char *filename,
             allCommands->commands[numCommands].processType = GROUP_REG;
             allCommands->commands[numCommands].triggerFrame = frameNumber;
             numCommands++;
-        } else if (sscanf(parsedLine, "; End frame %u regsiters",
+        } else if (sscanf(parsedLine, "; End frame %u registers",
                    &frameNumber) == 1) {
             isGroupRegister = NVMEDIA_FALSE;
             allCommands->commands[numCommands].commandType = SECTION_STOP;
@@ -218,6 +583,21 @@ ParseRegistersFile(char *filename,
             //save data length
             allCommands->commands[numCommands].dataLength = 1;
             numCommands++;
+        // Parse Boson command in format "; Boson DEV_ADDR CMD_ID [VALUE]"
+        // Consecutive Boson commands are sent in one spooling window
+        } else if ((numArgs = sscanf(parsedLine, "; Boson %x %x %x", &deviceAddress,
+                                     &address, &value)) >= 2) {
+            allCommands->commands[numCommands].commandType = BOSON_CMD;
+            allCommands->commands[numCommands].deviceAddress = deviceAddress >> 1;
+            for (i = 0; i < 4; i++) {
+                allCommands->commands[numCommands].buffer[i] =
+                    (uint8_t)((address >> (24 - 8 * i)) & 0xFF);
+                allCommands->commands[numCommands].buffer[i + 4] =
+                    (uint8_t)((value >> (24 - 8 * i)) & 0xFF);
+            }
+            //save data length (command id and optional value)
+            allCommands->commands[numCommands].dataLength = (numArgs == 3) ? 8 : 4;
+            numCommands++;
         } else if (sscanf(parsedLine,"%x %x %x", &deviceAddress, &address,
                          (uint32_t *)&value) == 3) {
             allCommands->commands[numCommands].deviceAddress = deviceAddress >> 1;
@@ -353,6 +733,7 @@ ParseRegistersFile(char *filename,
     }
 
     allCommands->numCommands = numCommands;
+    I2cTrimCommands(allCommands);
     if (file)
         fclose(file);
     return NVMEDIA_STATUS_OK;
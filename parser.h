@@ -22,6 +22,11 @@
 #include "i2cCommands.h"
 
 #define MAX_STRING_SIZE         256
+#define MAX_VARIABLE_NAME       64
+#define MAX_SCRIPT_VARIABLES    32
+#define MAX_INCLUDE_DEPTH       8
+#define MAX_SCRIPT_SOURCES      16   // script and the files it includes
+#define MAX_SCRIPT_PATH         (2 * MAX_STRING_SIZE)
 
 typedef struct {
     NvMediaBool                 isUsed;
@@ -46,9 +51,40 @@ typedef struct {
     int                          multiplex;
 } CaptureConfigParams;
 
+/* A file read by FlattenRegistersFile, as it was when read */
+typedef struct {
+    char                         path[MAX_SCRIPT_PATH];
+    uint64_t                     size;
+    int64_t                      mtimeSec;
+    int64_t                      mtimeNsec;
+} ScriptSource;
+
+typedef struct {
+    ScriptSource                 files[MAX_SCRIPT_SOURCES];
+    uint32_t                     numFiles;
+    NvMediaBool                  overflow;      // more files than listed
+} ScriptSources;
+
+/* Resolves "; Include FILE" and "; Set NAME VALUE" lines and ${NAME}
+ * references into one script without comments. text is allocated and
+ * must be freed by the caller. sources, if not NULL, lists the script and
+ * every file it included. */
+NvMediaStatus
+FlattenRegistersFile(const char *filename,
+                     char **text,
+                     size_t *size,
+                     ScriptSources *sources);
+
 NvMediaStatus
 ParseRegistersFile(char *filename,
                    CaptureConfigParams *params,
                    I2cCommands *allCommands);
 
+/* Parses a script returned by FlattenRegistersFile */
+NvMediaStatus
+ParseRegistersText(char *text,
+                   size_t size,
+                   CaptureConfigParams *params,
+                   I2cCommands *allCommands);
+
 #endif
@@ -0,0 +1,427 @@
+/* NVIDIA CORPORATION gave permission to FLIR Systems, Inc to modify this code
+  * and distribute it as part of the ADAS GMSL Kit.
+  * http://www.flir.com/
+  * October-2019
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "pipeline.h"
+#include "capture.h"
+#include "save.h"
+#include "display.h"
+#include "helpers.h"
+#include "log_utils.h"
+
+/* Recording is lossless by default, display always shows the newest frame */
+static const PipelineStage _stages[] = {
+    { "capture", CAPTURE_ELEMENT, CaptureInit, CaptureProc, CaptureStop,
+      CaptureFini, NULL, QUEUE_POLICY_BLOCK },
+    { "save",    SAVE_ELEMENT,    SaveInit,    SaveProc,    SaveStop,
+      SaveFini,    SaveGetInputQueue, QUEUE_POLICY_BLOCK },
+    { "display", DISPLAY_ELEMENT, DisplayInit, DisplayProc, DisplayStop,
+      DisplayFini, DisplayGetInputQueue, QUEUE_POLICY_LATEST },
+};
+
+static const char *_policyNames[] = { "block", "drop", "latest" };
+
+#define NUM_STAGES  (sizeof(_stages) / sizeof(_stages[0]))
+
+static const PipelineStage *
+_FindStage(const char *name)
+{
+    uint32_t i;
+
+    for (i = 0; i < NUM_STAGES; i++) {
+        if (!strcasecmp(_stages[i].name, name)) {
+            return &_stages[i];
+        }
+    }
+    return NULL;
+}
+
+static NvMediaBool
+_ParsePolicy(const char *name,
+             QueuePolicy *policy)
+{
+    uint32_t i;
+
+    for (i = 0; i < sizeof(_policyNames) / sizeof(_policyNames[0]); i++) {
+        if (!strcasecmp(_policyNames[i], name)) {
+            *policy = (QueuePolicy)i;
+            return NVMEDIA_TRUE;
+        }
+    }
+    return NVMEDIA_FALSE;
+}
+
+static const PipelineStage *
+_StageOf(uint32_t element)
+{
+    uint32_t i;
+
+    for (i = 0; i < NUM_STAGES; i++) {
+        if (_stages[i].element == element) {
+            return &_stages[i];
+        }
+    }
+    return NULL;
+}
+
+NvMediaStatus
+PipelineConfigure(NvMainContext *mainCtx,
+                  const char *spec)
+{
+    char buf[MAX_STRING_SIZE];
+    const PipelineStage *stage;
+    PipelineNode *node;
+    char *token, *field, *next, *save = NULL;
+
+    strncpy(buf, spec ? spec : PIPELINE_DEFAULT, MAX_STRING_SIZE - 1);
+    buf[MAX_STRING_SIZE - 1] = '\0';
+    mainCtx->numStages = 0;
+
+    for (token = strtok_r(buf, ",", &save); token;
+         token = strtok_r(NULL, ",", &save)) {
+        field = strchr(token, ':');
+        if (field) {
+            *field++ = '\0';
+        }
+
+        stage = _FindStage(token);
+        if (!stage) {
+            LOG_ERR("%s: Unknown pipeline stage \"%s\"\n", __func__, token);
+            return NVMEDIA_STATUS_BAD_PARAMETER;
+        }
+        if (PipelineHasStage(mainCtx, stage->element)) {
+            LOG_ERR("%s: Stage %s listed twice\n", __func__, stage->name);
+            return NVMEDIA_STATUS_BAD_PARAMETER;
+        }
+        if ((mainCtx->numStages == 0) != (stage->inputQueue == NULL)) {
+            LOG_ERR("%s: The pipeline must start with capture\n", __func__);
+            return NVMEDIA_STATUS_BAD_PARAMETER;
+        }
+
+        node = &mainCtx->pipeline[mainCtx->numStages++];
+        node->element = stage->element;
+        node->queueDepth = 0;
+        node->policy = stage->policy;
+        memset(node->sched, 0, sizeof(node->sched));
+        memset(node->output, 0, sizeof(node->output));
+
+        /* Queue depth and policy in any order */
+        for (; field; field = next) {
+            next = strchr(field, ':');
+            if (next) {
+                *next++ = '\0';
+            }
+            if (!stage->inputQueue) {
+                LOG_ERR("%s: %s has no input queue\n", __func__, stage->name);
+                return NVMEDIA_STATUS_BAD_PARAMETER;
+            }
+            if (_ParsePolicy(field, &node->policy)) {
+                continue;
+            }
+            if (sscanf(field, "%u", &node->queueDepth) != 1 ||
+                !node->queueDepth ||
+                node->queueDepth > MAX_BUFFER_POOL_SIZE) {
+                LOG_ERR("%s: Bad queue depth or policy \"%s\" for %s\n",
+                        __func__, field, stage->name);
+                return NVMEDIA_STATUS_BAD_PARAMETER;
+            }
+        }
+    }
+
+    if (!mainCtx->numStages) {
+        LOG_ERR("%s: Empty pipeline\n", __func__);
+        return NVMEDIA_STATUS_BAD_PARAMETER;
+    }
+
+    if (mainCtx->testArgs && mainCtx->testArgs->displayEnabled &&
+        !PipelineHasStage(mainCtx, DISPLAY_ELEMENT)) {
+        LOG_WARN("%s: No display stage, -d is ignored\n", __func__);
+    }
+
+    return NVMEDIA_STATUS_OK;
+}
+
+static PipelineNode *
+_NodeOf(NvMainContext *mainCtx,
+        uint32_t element)
+{
+    uint32_t i;
+
+    for (i = 0; i < mainCtx->numStages; i++) {
+        if (mainCtx->pipeline[i].element == element) {
+            return &mainCtx->pipeline[i];
+        }
+    }
+    return NULL;
+}
+
+NvMediaStatus
+PipelineSchedule(NvMainContext *mainCtx,
+                 const char *spec)
+{
+    char buf[MAX_STRING_SIZE];
+    const PipelineStage *stage;
+    PipelineNode *node;
+    ThreadSched sched;
+    char *token, *value, *channel, *save = NULL;
+    uint32_t vc, first, last;
+
+    strncpy(buf, spec, MAX_STRING_SIZE - 1);
+    buf[MAX_STRING_SIZE - 1] = '\0';
+
+    for (token = strtok_r(buf, ",", &save); token;
+         token = strtok_r(NULL, ",", &save)) {
+        value = strchr(token, '=');
+        if (!value) {
+            LOG_ERR("%s: Expected stage=cpus[:priority], got \"%s\"\n",
+                    __func__, token);
+            return NVMEDIA_STATUS_BAD_PARAMETER;
+        }
+        *value++ = '\0';
+        channel = strchr(token, '.');
+        if (channel) {
+            *channel++ = '\0';
+        }
+
+        stage = _FindStage(token);
+        node = stage ? _NodeOf(mainCtx, stage->element) : NULL;
+        if (!node) {
+            LOG_ERR("%s: No stage \"%s\" in the pipeline\n", __func__, token);
+            return NVMEDIA_STATUS_BAD_PARAMETER;
+        }
+
+        first = 0;
+        last = PIPELINE_MAX_CHANNELS - 1;
+        if (channel) {
+            if (sscanf(channel, "%u", &first) != 1 ||
+                first >= PIPELINE_MAX_CHANNELS) {
+                LOG_ERR("%s: Bad channel \"%s\" for %s\n", __func__,
+                        channel, stage->name);
+                return NVMEDIA_STATUS_BAD_PARAMETER;
+            }
+            last = first;
+        }
+
+        if (ThreadSchedParse(value, &sched) != NVMEDIA_STATUS_OK) {
+            return NVMEDIA_STATUS_BAD_PARAMETER;
+        }
+        for (vc = first; vc <= last; vc++) {
+            node->sched[vc] = sched;
+        }
+    }
+
+    return NVMEDIA_STATUS_OK;
+}
+
+NvMediaStatus
+PipelineInit(NvMainContext *mainCtx)
+{
+    const PipelineStage *stage;
+    uint32_t i;
+
+    for (i = 0; i < mainCtx->numStages; i++) {
+        stage = _StageOf(mainCtx->pipeline[i].element);
+        if (stage->init(mainCtx) != NVMEDIA_STATUS_OK) {
+            LOG_ERR("%s: Failed to initialize %s\n", __func__, stage->name);
+            return NVMEDIA_STATUS_ERROR;
+        }
+    }
+
+    return NVMEDIA_STATUS_OK;
+}
+
+NvMediaStatus
+PipelineProc(NvMainContext *mainCtx)
+{
+    const PipelineStage *stage;
+    uint32_t i;
+
+    for (i = 0; i < mainCtx->numStages; i++) {
+        stage = _StageOf(mainCtx->pipeline[i].element);
+        if (stage->proc(mainCtx) != NVMEDIA_STATUS_OK) {
+            LOG_ERR("%s: Failed to start %s\n", __func__, stage->name);
+            return NVMEDIA_STATUS_ERROR;
+        }
+    }
+
+    return NVMEDIA_STATUS_OK;
+}
+
+void
+PipelineFini(NvMainContext *mainCtx)
+{
+    PipelineLink *link;
+    uint32_t i, vc;
+
+    /* A stage frees queues the stages around it still use */
+    for (i = 0; i < mainCtx->numStages; i++) {
+        _StageOf(mainCtx->pipeline[i].element)->stop(mainCtx);
+    }
+
+    for (i = 0; i + 1 < mainCtx->numStages; i++) {
+        for (vc = 0; vc < PIPELINE_MAX_CHANNELS; vc++) {
+            link = &mainCtx->pipeline[i].output[vc];
+            if (!link->queue) {
+                continue;
+            }
+            LOG_MSG("%s -> %s %u (%s): %llu frames, %llu dropped newest, "
+                    "%llu dropped oldest, %llu full waits\n",
+                    _StageOf(mainCtx->pipeline[i].element)->name,
+                    _StageOf(mainCtx->pipeline[i + 1].element)->name, vc,
+                    _policyNames[link->policy],
+                    (unsigned long long)link->frames,
+                    (unsigned long long)link->droppedNewest,
+                    (unsigned long long)link->droppedOldest,
+                    (unsigned long long)link->waits);
+        }
+    }
+
+    for (i = mainCtx->numStages; i > 0; i--) {
+        _StageOf(mainCtx->pipeline[i - 1].element)->fini(mainCtx);
+    }
+}
+
+uint32_t
+PipelineQueueDepth(NvMainContext *mainCtx,
+                   uint32_t element)
+{
+    uint32_t i;
+
+    for (i = 0; i < mainCtx->numStages; i++) {
+        if (mainCtx->pipeline[i].element == element &&
+            mainCtx->pipeline[i].queueDepth) {
+            return mainCtx->pipeline[i].queueDepth;
+        }
+    }
+    return mainCtx->testArgs->bufferPoolSize;
+}
+
+PipelineLink *
+PipelineOutput(NvMainContext *mainCtx,
+               uint32_t element,
+               uint32_t virtualChannel)
+{
+    PipelineLink *link;
+    uint32_t i;
+
+    if (virtualChannel >= PIPELINE_MAX_CHANNELS) {
+        return NULL;
+    }
+
+    for (i = 0; i < mainCtx->numStages; i++) {
+        if (mainCtx->pipeline[i].element != element) {
+            continue;
+        }
+        link = &mainCtx->pipeline[i].output[virtualChannel];
+        link->quit = &mainCtx->quit;
+        if (i + 1 < mainCtx->numStages) {
+            link->queue = _StageOf(mainCtx->pipeline[i + 1].element)->
+                              inputQueue(mainCtx, virtualChannel);
+            link->policy = mainCtx->pipeline[i + 1].policy;
+        }
+        return link;
+    }
+    return NULL;
+}
+
+static NvMediaStatus
+_ReturnToPool(NvMediaImage *image)
+{
+    if (NvQueuePut(IMAGE_POOL(image), (void *)&image, 0) != NVMEDIA_STATUS_OK) {
+        LOG_ERR("%s: Failed to put image back into its pool\n", __func__);
+        return NVMEDIA_STATUS_ERROR;
+    }
+    return NVMEDIA_STATUS_OK;
+}
+
+NvMediaStatus
+PipelinePut(PipelineLink *link,
+            NvMediaImage **image)
+{
+    NvMediaImage *oldest = NULL;
+    NvMediaStatus status;
+
+    if (!link->queue) {
+        status = _ReturnToPool(*image);
+        goto done;
+    }
+
+    switch (link->policy) {
+        case QUEUE_POLICY_BLOCK:
+            while (NvQueuePut(link->queue, (void *)image,
+                              PIPELINE_PUT_TIMEOUT) != NVMEDIA_STATUS_OK) {
+                link->waits++;
+                if (*link->quit) {
+                    link->droppedNewest++;
+                    status = _ReturnToPool(*image);
+                    goto done;
+                }
+            }
+            break;
+        case QUEUE_POLICY_DROP_NEWEST:
+            if (NvQueuePut(link->queue, (void *)image, 0) != NVMEDIA_STATUS_OK) {
+                link->droppedNewest++;
+                status = _ReturnToPool(*image);
+                goto done;
+            }
+            break;
+        case QUEUE_POLICY_LATEST:
+            while (NvQueuePut(link->queue, (void *)image, 0) != NVMEDIA_STATUS_OK) {
+                oldest = NULL;
+                if (NvQueueGet(link->queue, (void *)&oldest, 0) != NVMEDIA_STATUS_OK) {
+                    link->droppedNewest++;
+                    status = _ReturnToPool(*image);
+                    goto done;
+                }
+                /* NULL asks the consumer to stop, leave it queued */
+                if (!oldest) {
+                    NvQueuePut(link->queue, (void *)&oldest, 0);
+                    link->droppedNewest++;
+                    status = _ReturnToPool(*image);
+                    goto done;
+                }
+                link->droppedOldest++;
+                if (_ReturnToPool(oldest) != NVMEDIA_STATUS_OK) {
+                    return NVMEDIA_STATUS_ERROR;
+                }
+            }
+            break;
+        default:
+            return NVMEDIA_STATUS_BAD_PARAMETER;
+    }
+
+    link->frames++;
+    status = NVMEDIA_STATUS_OK;
+
+done:
+    if (status == NVMEDIA_STATUS_OK) {
+        *image = NULL;
+    }
+    return status;
+}
+
+const ThreadSched *
+PipelineThreadSched(NvMainContext *mainCtx,
+                    uint32_t element,
+                    uint32_t virtualChannel)
+{
+    PipelineNode *node = _NodeOf(mainCtx, element);
+
+    if (!node || virtualChannel >= PIPELINE_MAX_CHANNELS) {
+        return NULL;
+    }
+    return &node->sched[virtualChannel];
+}
+
+NvMediaBool
+PipelineHasStage(NvMainContext *mainCtx,
+                 uint32_t element)
+{
+    return _NodeOf(mainCtx, element) ? NVMEDIA_TRUE : NVMEDIA_FALSE;
+}
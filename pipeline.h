@@ -0,0 +1,85 @@
+/* NVIDIA CORPORATION gave permission to FLIR Systems, Inc to modify this code
+  * and distribute it as part of the ADAS GMSL Kit.
+  * http://www.flir.com/
+  * October-2019
+*/
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+#include "main.h"
+#include "thread_utils.h"
+#include "nvmedia_image.h"
+
+/* Stages named in order as "name[:queue depth][:policy],...". The first
+ * stage must be capture; every other stage takes frames from one input
+ * queue per virtual channel and hands them to the next stage, the last
+ * stage gives them back to the capture pool. The policy (block, drop or
+ * latest) decides what happens when the input queue is full. */
+#define PIPELINE_DEFAULT        "capture,save,display"
+#define PIPELINE_PUT_TIMEOUT    100     // ms between quit checks while blocking
+
+typedef struct {
+    const char                 *name;
+    uint32_t                    element;        // slot in NvMainContext.ctxs
+    NvMediaStatus             (*init)(NvMainContext *mainCtx);
+    NvMediaStatus             (*proc)(NvMainContext *mainCtx);
+    NvMediaStatus             (*stop)(NvMainContext *mainCtx);
+    NvMediaStatus             (*fini)(NvMainContext *mainCtx);
+    /* NULL for the source stage */
+    NvQueue                  *(*inputQueue)(NvMainContext *mainCtx,
+                                            uint32_t virtualChannel);
+    QueuePolicy                 policy;         // default for the input queue
+} PipelineStage;
+
+/* Builds mainCtx->pipeline from spec, NULL selects PIPELINE_DEFAULT */
+NvMediaStatus
+PipelineConfigure(NvMainContext *mainCtx,
+                  const char *spec);
+
+/* Sets thread placement from "stage[.channel]=cpus[:priority],...", see
+ * ThreadSchedParse. Without a channel it applies to every channel. */
+NvMediaStatus
+PipelineSchedule(NvMainContext *mainCtx,
+                 const char *spec);
+
+/* Init every stage, then start their threads */
+NvMediaStatus
+PipelineInit(NvMainContext *mainCtx);
+
+NvMediaStatus
+PipelineProc(NvMainContext *mainCtx);
+
+/* Joins the threads of every stage, logs the queue counters, then frees
+ * the stages last to first */
+void
+PipelineFini(NvMainContext *mainCtx);
+
+/* Input queue depth of a stage, the buffer pool size unless configured */
+uint32_t
+PipelineQueueDepth(NvMainContext *mainCtx,
+                   uint32_t element);
+
+/* Link a stage thread hands frames to, its queue is NULL for the last
+ * stage */
+PipelineLink *
+PipelineOutput(NvMainContext *mainCtx,
+               uint32_t element,
+               uint32_t virtualChannel);
+
+/* Hands *image to the next stage following the link policy, or back to
+ * its pool if dropped. *image is NULL afterwards unless this fails. */
+NvMediaStatus
+PipelinePut(PipelineLink *link,
+            NvMediaImage **image);
+
+/* Placement a stage thread applies to itself when it starts */
+const ThreadSched *
+PipelineThreadSched(NvMainContext *mainCtx,
+                    uint32_t element,
+                    uint32_t virtualChannel);
+
+NvMediaBool
+PipelineHasStage(NvMainContext *mainCtx,
+                 uint32_t element);
+
+#endif
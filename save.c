@@ -17,7 +17,7 @@
 
 #include "capture.h"
 #include "save.h"
-#include "display.h"
+#include "pipeline.h"
 #include "opencvConnector.h"
 #include "helpers.h"
 
@@ -52,6 +52,7 @@ _SaveThreadFunc(void *data)
 {
     SaveThreadCtx *threadCtx = (SaveThreadCtx *)data;
     NvMediaImage *image = NULL;
+    ImageFrame *frame = NULL;
     NvMediaStatus status;
 
     char outputFileName[MAX_STRING_SIZE];
@@ -60,6 +61,8 @@ _SaveThreadFunc(void *data)
 
     NVM_SURF_FMT_DEFINE_ATTR(attr);
 
+    ThreadSchedApply(threadCtx->sched, "save", threadCtx->virtualGroupIndex);
+
     while (!(*threadCtx->quit)) {
         image=NULL;
         /* Wait for captured frames */
@@ -71,22 +74,27 @@ _SaveThreadFunc(void *data)
                 goto loop_done;
         }
 
-        if(threadCtx->videoEnabled) {
-            Opencv_recordFrame();
+        /* NULL is posted by SaveStop to wake the thread */
+        if (!image)
+            goto loop_done;
+
+        /* Record the frame dequeued, not the newest one sent to OpenCV */
+        if(*threadCtx->videoEnabled & (1 << threadCtx->virtualGroupIndex)) {
+            frame = IMAGE_FRAME(image);
+            Opencv_recordFrame(threadCtx->virtualGroupIndex, frame->pixels,
+                frame->width, frame->height, frame->bytesPerPixel);
         }
 
     loop_done:
         if (image) {
-            if (NvQueuePut(threadCtx->outputQueue,
-                           (void *)&image,
-                           0) != NVMEDIA_STATUS_OK) {
+            if (PipelinePut(threadCtx->output, &image) != NVMEDIA_STATUS_OK) {
                 LOG_ERR("%s: Failed to put image back in queue\n", __func__);
                 *threadCtx->quit = NVMEDIA_TRUE;
             };
         }
     }
     LOG_INFO("%s: Save thread exited\n", __func__);
-    threadCtx->exitedFlag = NVMEDIA_TRUE;
+    ThreadExitNotify(&threadCtx->exited);
     return NVMEDIA_STATUS_OK;
 }
 
@@ -117,7 +125,12 @@ SaveInit(NvMainContext *mainCtx)
     saveCtx->testArgs  = testArgs;
     saveCtx->numVirtualChannels = testArgs->numVirtualChannels;
     saveCtx->displayEnabled = testArgs->displayEnabled;
-    saveCtx->inputQueueSize = testArgs->bufferPoolSize;
+    saveCtx->inputQueueSize = PipelineQueueDepth(mainCtx, SAVE_ELEMENT);
+
+    for (i = 0; i < saveCtx->numVirtualChannels; i++) {
+        ThreadExitInit(&saveCtx->threadCtx[i].exited);
+    }
+
     /* Create NvMedia Device */
     saveCtx->device = NvMediaDeviceCreate();
     if (!saveCtx->device) {
@@ -130,12 +143,12 @@ SaveInit(NvMainContext *mainCtx)
     for (i = 0; i < saveCtx->numVirtualChannels; i++) {
         saveCtx->threadCtx[i].quit = saveCtx->quit;
         saveCtx->threadCtx[i].videoEnabled = &mainCtx->videoEnabled;
-        saveCtx->threadCtx[i].exitedFlag = NVMEDIA_FALSE;
         saveCtx->threadCtx[i].saveFilePrefix = testArgs->filePrefix;
         saveCtx->threadCtx[i].virtualGroupIndex = captureCtx->threadCtx[i].virtualGroupIndex;
         saveCtx->threadCtx[i].numFramesToSave = (testArgs->frames.isUsed)?
                                                  testArgs->frames.uIntValue : 0;
         saveCtx->threadCtx[i].rawBytesPerPixel = captureCtx->threadCtx[i].rawBytesPerPixel;
+        saveCtx->threadCtx[i].fps = &captureCtx->threadCtx[i].fps;
         NVM_SURF_FMT_DEFINE_ATTR(attr);
         status = NvMediaSurfaceFormatGetAttrs(captureCtx->threadCtx[i].surfType,
                                               attr,
@@ -164,7 +177,7 @@ failed:
 }
 
 NvMediaStatus
-SaveFini(NvMainContext *mainCtx)
+SaveStop(NvMainContext *mainCtx)
 {
     NvSaveContext *saveCtx = NULL;
     NvMediaImage *image = NULL;
@@ -180,33 +193,55 @@ SaveFini(NvMainContext *mainCtx)
 
     *saveCtx->quit = NVMEDIA_TRUE;
 
-    /* Wait for threads to exit */
+    /* Wake the threads waiting on an empty input queue */
     for (i = 0; i < saveCtx->numVirtualChannels; i++) {
-        if (saveCtx->saveThread[i]) {
-            while (!saveCtx->threadCtx[i].exitedFlag) {
-                LOG_DBG("%s: Waiting for save thread %d to quit\n",
-                        __func__, i);
-            }
+        if (saveCtx->saveThread[i] && saveCtx->threadCtx[i].inputQueue) {
+            NvQueuePut(saveCtx->threadCtx[i].inputQueue, (void *)&image, 0);
         }
     }
 
-    /* Destroy threads */
+    /* Join threads, waiting longer than the timeout only if one is stuck */
     for (i = 0; i < saveCtx->numVirtualChannels; i++) {
-        if (saveCtx->saveThread[i]) {
-            status = NvThreadDestroy(saveCtx->saveThread[i]);
-            if (status != NVMEDIA_STATUS_OK)
-                LOG_ERR("%s: Failed to destroy save thread %d\n",
-                        __func__, i);
+        if (!saveCtx->saveThread[i])
+            continue;
+        if (ThreadExitWait(&saveCtx->threadCtx[i].exited,
+                           SAVE_EXIT_TIMEOUT) != NVMEDIA_STATUS_OK) {
+            LOG_WARN("%s: Save thread %d did not exit within %d ms\n",
+                     __func__, i, SAVE_EXIT_TIMEOUT);
         }
+        status = NvThreadDestroy(saveCtx->saveThread[i]);
+        if (status != NVMEDIA_STATUS_OK)
+            LOG_ERR("%s: Failed to destroy save thread %d\n",
+                    __func__, i);
+        saveCtx->saveThread[i] = NULL;
     }
 
+    return status;
+}
+
+NvMediaStatus
+SaveFini(NvMainContext *mainCtx)
+{
+    NvSaveContext *saveCtx = NULL;
+    NvMediaImage *image = NULL;
+    uint32_t i;
+
+    if (!mainCtx)
+        return NVMEDIA_STATUS_OK;
+
+    saveCtx = mainCtx->ctxs[SAVE_ELEMENT];
+    if (!saveCtx)
+        return NVMEDIA_STATUS_OK;
+
+    SaveStop(mainCtx);
+
     for (i = 0; i < saveCtx->numVirtualChannels; i++) {
         /*Flush and destroy the input queues*/
         if (saveCtx->threadCtx[i].inputQueue) {
             LOG_DBG("%s: Flushing the save input queue %d\n", __func__, i);
             while (IsSucceed(NvQueueGet(saveCtx->threadCtx[i].inputQueue, &image, 0))) {
                 if (image) {
-                    if (NvQueuePut((NvQueue *)image->tag,
+                    if (NvQueuePut(IMAGE_POOL(image),
                                    (void *)&image,
                                    0) != NVMEDIA_STATUS_OK) {
                         LOG_ERR("%s: Failed to put image back in queue\n", __func__);
@@ -217,6 +252,7 @@ SaveFini(NvMainContext *mainCtx)
             }
             NvQueueDestroy(saveCtx->threadCtx[i].inputQueue);
         }
+        ThreadExitDestroy(&saveCtx->threadCtx[i].exited);
     }
 
     if (saveCtx->device)
@@ -233,7 +269,6 @@ NvMediaStatus
 SaveProc(NvMainContext *mainCtx)
 {
     NvSaveContext        *saveCtx = NULL;
-    NvDisplayContext     *displayCtx = NULL;
     uint32_t i;
     NvMediaStatus status= NVMEDIA_STATUS_OK;
 
@@ -242,18 +277,16 @@ SaveProc(NvMainContext *mainCtx)
         return NVMEDIA_STATUS_ERROR;
     }
     saveCtx = mainCtx->ctxs[SAVE_ELEMENT];
-    displayCtx = mainCtx->ctxs[DISPLAY_ELEMENT];
 
     /* Setting the queues */
-    if (saveCtx->displayEnabled) {
-        for (i = 0; i < saveCtx->numVirtualChannels; i++) {
-            saveCtx->threadCtx[i].outputQueue = &displayCtx->threadCtx->inputQueue[i];
-        }
+    for (i = 0; i < saveCtx->numVirtualChannels; i++) {
+        saveCtx->threadCtx[i].output = PipelineOutput(mainCtx, SAVE_ELEMENT, i);
+        saveCtx->threadCtx[i].sched = PipelineThreadSched(mainCtx, SAVE_ELEMENT, i);
     }
 
     /* Create thread to save images */
     for (i = 0; i < saveCtx->numVirtualChannels; i++) {
-        saveCtx->threadCtx[i].exitedFlag = NVMEDIA_FALSE;
+        ThreadExitStart(&saveCtx->threadCtx[i].exited);
         status = NvThreadCreate(&saveCtx->saveThread[i],
                                 &_SaveThreadFunc,
                                 (void *)&saveCtx->threadCtx[i],
@@ -261,8 +294,17 @@ SaveProc(NvMainContext *mainCtx)
         if (status != NVMEDIA_STATUS_OK) {
             LOG_ERR("%s: Failed to create save Thread\n",
                     __func__);
-            saveCtx->threadCtx[i].exitedFlag = NVMEDIA_TRUE;
+            ThreadExitNotify(&saveCtx->threadCtx[i].exited);
         }
     }
     return status;
 }
+
+NvQueue *
+SaveGetInputQueue(NvMainContext *mainCtx,
+                  uint32_t virtualChannel)
+{
+    NvSaveContext *saveCtx = mainCtx->ctxs[SAVE_ELEMENT];
+
+    return saveCtx ? saveCtx->threadCtx[virtualChannel].inputQueue : NULL;
+}
@@ -23,17 +23,20 @@ extern "C" {
 #include "cmdline.h"
 #include "thread_utils.h"
 #include "surf_utils.h"
+#include "threadExit.h"
 
 #define SAVE_QUEUE_SIZE                 3      /* min no. of buffers to be in circulation at any point */
 #define SAVE_DEQUEUE_TIMEOUT            1000
 #define SAVE_ENQUEUE_TIMEOUT            100
+#define SAVE_EXIT_TIMEOUT               1000
 
 typedef struct {
     NvQueue                    *inputQueue;
-    NvQueue                    *outputQueue;
+    PipelineLink               *output;         // to the next stage
     volatile NvMediaBool       *quit;
-    NvMediaBool                *videoEnabled;
-    NvMediaBool                 exitedFlag;
+    volatile uint32_t          *videoEnabled;   // bit per recording channel
+    ThreadExit                  exited;
+    const ThreadSched          *sched;          // applied by the thread
 
     /* save params */
     uint32_t                    rawBytesPerPixel;
@@ -64,12 +67,20 @@ typedef struct {
 NvMediaStatus
 SaveInit(NvMainContext *mainCtx);
 
+/* Stops and joins the save threads, SaveFini does it if needed */
+NvMediaStatus
+SaveStop(NvMainContext *mainCtx);
+
 NvMediaStatus
 SaveFini(NvMainContext *mainCtx);
 
 NvMediaStatus
 SaveProc(NvMainContext *mainCtx);
 
+NvQueue *
+SaveGetInputQueue(NvMainContext *mainCtx,
+                  uint32_t virtualChannel);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,284 @@
+/* NVIDIA CORPORATION gave permission to FLIR Systems, Inc to modify this code
+  * and distribute it as part of the ADAS GMSL Kit.
+  * http://www.flir.com/
+  * October-2019
+*/
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "log_utils.h"
+#include "scriptCache.h"
+
+typedef struct {
+    void                       *data;
+    size_t                      size;
+} MappedFile;
+
+static NvMediaStatus
+_MapFile(const char *filename, MappedFile *map)
+{
+    struct stat st;
+    int fd;
+
+    map->data = NULL;
+    map->size = 0;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return NVMEDIA_STATUS_ERROR;
+    }
+    if (fstat(fd, &st) || st.st_size <= 0) {
+        close(fd);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    map->data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map->data == MAP_FAILED) {
+        map->data = NULL;
+        return NVMEDIA_STATUS_ERROR;
+    }
+    map->size = st.st_size;
+
+    return NVMEDIA_STATUS_OK;
+}
+
+static void
+_UnmapFile(MappedFile *map)
+{
+    if (map->data) {
+        munmap(map->data, map->size);
+        map->data = NULL;
+    }
+}
+
+/* Checks the files the cache was compiled from are unchanged, without
+ * reading them */
+static NvMediaStatus
+_CheckSources(const ScriptSource *sources, uint32_t numSources)
+{
+    struct stat st;
+    uint32_t i;
+
+    for (i = 0; i < numSources; i++) {
+        if (memchr(sources[i].path, '\0', MAX_SCRIPT_PATH) == NULL ||
+            stat(sources[i].path, &st) ||
+            (uint64_t)st.st_size != sources[i].size ||
+            (int64_t)st.st_mtime != sources[i].mtimeSec
+#ifndef NVMEDIA_QNX
+            || (int64_t)st.st_mtim.tv_nsec != sources[i].mtimeNsec
+#endif
+            ) {
+            return NVMEDIA_STATUS_ERROR;
+        }
+    }
+
+    return NVMEDIA_STATUS_OK;
+}
+
+static void
+_CachePath(const char *filename, char *path)
+{
+    snprintf(path, MAX_STRING_SIZE + sizeof(SCRIPT_CACHE_SUFFIX), "%s%s",
+             filename, SCRIPT_CACHE_SUFFIX);
+}
+
+static NvMediaStatus
+_ValidateCommands(const Command *commands, uint32_t numCommands)
+{
+    uint32_t i;
+
+    for (i = 0; i < numCommands; i++) {
+        if (commands[i].commandType > LINK_SEL_CFG ||
+            commands[i].processType > PRESET_REG ||
+            commands[i].dataLength > MAX_BUF_LENGTH) {
+            LOG_WARN("%s: Command %u is invalid\n", __func__, i);
+            return NVMEDIA_STATUS_ERROR;
+        }
+    }
+
+    return NVMEDIA_STATUS_OK;
+}
+
+/* Maps the cache and checks it belongs to this build and its sources are
+ * unchanged */
+static NvMediaStatus
+_MapCache(const char *filename, MappedFile *map,
+          const ScriptCacheHeader **header)
+{
+    char path[MAX_STRING_SIZE + sizeof(SCRIPT_CACHE_SUFFIX)];
+    const ScriptCacheHeader *h;
+
+    _CachePath(filename, path);
+    if (_MapFile(path, map) != NVMEDIA_STATUS_OK) {
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    h = (const ScriptCacheHeader *)map->data;
+    if (map->size < sizeof(ScriptCacheHeader) ||
+        h->magic != SCRIPT_CACHE_MAGIC ||
+        h->version != SCRIPT_CACHE_VERSION ||
+        h->sourceSize != sizeof(ScriptSource) ||
+        h->commandSize != sizeof(Command) ||
+        h->paramsSize != sizeof(CaptureConfigParams) ||
+        h->numSources == 0 || h->numSources > MAX_SCRIPT_SOURCES ||
+        map->size != sizeof(ScriptCacheHeader) + sizeof(CaptureConfigParams) +
+                     (size_t)h->numSources * sizeof(ScriptSource) +
+                     (size_t)h->numCommands * sizeof(Command) ||
+        _CheckSources((const ScriptSource *)
+                      ((const uint8_t *)map->data + sizeof(ScriptCacheHeader) +
+                       sizeof(CaptureConfigParams)),
+                      h->numSources) != NVMEDIA_STATUS_OK) {
+        LOG_DBG("%s: %s is stale\n", __func__, path);
+        _UnmapFile(map);
+        return NVMEDIA_STATUS_ERROR;
+    }
+
+    *header = h;
+    return NVMEDIA_STATUS_OK;
+}
+
+static void
+_WriteCache(const char *filename, const ScriptSources *sources,
+            CaptureConfigParams *params, I2cCommands *allCommands)
+{
+    char path[MAX_STRING_SIZE + sizeof(SCRIPT_CACHE_SUFFIX)];
+    char tmpPath[MAX_STRING_SIZE + sizeof(SCRIPT_CACHE_SUFFIX) + 4];
+    ScriptCacheHeader header;
+    FILE *fp;
+
+    /* Too many includes to track, a stale image could be reused */
+    if (sources->overflow) {
+        LOG_WARN("%s: %s includes too many files to be cached\n", __func__,
+                 filename);
+        return;
+    }
+
+    _CachePath(filename, path);
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+
+    memset(&header, 0, sizeof(header));
+    header.magic = SCRIPT_CACHE_MAGIC;
+    header.version = SCRIPT_CACHE_VERSION;
+    header.numSources = sources->numFiles;
+    header.sourceSize = sizeof(ScriptSource);
+    header.numCommands = allCommands->numCommands;
+    header.commandSize = sizeof(Command);
+    header.paramsSize = sizeof(CaptureConfigParams);
+
+    /* Write aside and rename so a reader never maps a partial image */
+    fp = fopen(tmpPath, "wb");
+    if (!fp) {
+        LOG_WARN("%s: Cannot write %s, scripts will be parsed each run\n",
+                 __func__, path);
+        return;
+    }
+    if (fwrite(&header, sizeof(header), 1, fp) != 1 ||
+        fwrite(params, sizeof(CaptureConfigParams), 1, fp) != 1 ||
+        fwrite(sources->files, sizeof(ScriptSource),
+               sources->numFiles, fp) != sources->numFiles ||
+        fwrite(allCommands->commands, sizeof(Command),
+               allCommands->numCommands, fp) != allCommands->numCommands) {
+        LOG_WARN("%s: Failed to write %s\n", __func__, tmpPath);
+        fclose(fp);
+        unlink(tmpPath);
+        return;
+    }
+    fclose(fp);
+
+    if (rename(tmpPath, path)) {
+        LOG_WARN("%s: Failed to rename %s\n", __func__, tmpPath);
+        unlink(tmpPath);
+    }
+}
+
+NvMediaStatus
+LoadRegistersFile(char *filename,
+                  CaptureConfigParams *params,
+                  I2cCommands *allCommands)
+{
+    const ScriptCacheHeader *header;
+    const uint8_t *commands;
+    ScriptSources *sources;
+    MappedFile cache;
+    NvMediaStatus status;
+    size_t size;
+    char *text;
+
+    if (_MapCache(filename, &cache, &header) == NVMEDIA_STATUS_OK) {
+        commands = (const uint8_t *)cache.data + sizeof(ScriptCacheHeader) +
+                   sizeof(CaptureConfigParams) +
+                   header->numSources * sizeof(ScriptSource);
+        status = _ValidateCommands((const Command *)commands,
+                                   header->numCommands);
+        if (status == NVMEDIA_STATUS_OK) {
+            allCommands->numCommands = 0;
+            status = I2cReserveCommands(allCommands, header->numCommands);
+        }
+        if (status == NVMEDIA_STATUS_OK) {
+            memcpy(params, (const uint8_t *)cache.data +
+                   sizeof(ScriptCacheHeader), sizeof(CaptureConfigParams));
+            memcpy(allCommands->commands, commands,
+                   header->numCommands * sizeof(Command));
+            allCommands->numCommands = header->numCommands;
+            _UnmapFile(&cache);
+            LOG_DBG("%s: Loaded %u compiled commands for %s\n", __func__,
+                    allCommands->numCommands, filename);
+            return NVMEDIA_STATUS_OK;
+        }
+        _UnmapFile(&cache);
+    }
+
+    sources = calloc(1, sizeof(ScriptSources));
+    if (!sources) {
+        LOG_ERR("%s: Out of memory\n", __func__);
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+
+    /* Includes are listed as sources, so editing one recompiles */
+    status = FlattenRegistersFile(filename, &text, &size, sources);
+    if (status != NVMEDIA_STATUS_OK) {
+        goto done;
+    }
+
+    status = ParseRegistersText(text, size, params, allCommands);
+    free(text);
+    if (status != NVMEDIA_STATUS_OK) {
+        goto done;
+    }
+
+    _WriteCache(filename, sources, params, allCommands);
+
+done:
+    free(sources);
+    return status;
+}
+
+NvMediaStatus
+LoadRegistersParams(char *filename,
+                    CaptureConfigParams *params)
+{
+    const ScriptCacheHeader *header;
+    I2cCommands allCommands;
+    MappedFile cache;
+    NvMediaStatus status;
+
+    if (_MapCache(filename, &cache, &header) == NVMEDIA_STATUS_OK) {
+        memcpy(params, (const uint8_t *)cache.data + sizeof(ScriptCacheHeader),
+               sizeof(CaptureConfigParams));
+        _UnmapFile(&cache);
+        return NVMEDIA_STATUS_OK;
+    }
+
+    /* Compile the script now so that capture bring-up finds it cached */
+    memset(&allCommands, 0, sizeof(allCommands));
+    status = LoadRegistersFile(filename, params, &allCommands);
+    I2cFreeCommands(&allCommands);
+
+    return status;
+}
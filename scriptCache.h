@@ -0,0 +1,49 @@
+/* NVIDIA CORPORATION gave permission to FLIR Systems, Inc to modify this code
+  * and distribute it as part of the ADAS GMSL Kit.
+  * http://www.flir.com/
+  * October-2019
+*/
+#ifndef __SCRIPT_CACHE_H__
+#define __SCRIPT_CACHE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "parser.h"
+
+/* Compiled register scripts are stored next to the script as
+ * "<script>.bin" and reused as long as the script and every file it
+ * includes keep their size and modification time */
+#define SCRIPT_CACHE_MAGIC      0x43535256  // "VRSC"
+#define SCRIPT_CACHE_VERSION    8
+#define SCRIPT_CACHE_SUFFIX     ".bin"
+
+typedef struct {
+    uint32_t                    magic;
+    uint32_t                    version;
+    uint32_t                    numSources;     // ScriptSource after params
+    uint32_t                    sourceSize;
+    uint32_t                    numCommands;
+    uint32_t                    commandSize;
+    uint32_t                    paramsSize;
+    uint32_t                    reserved;
+} ScriptCacheHeader;
+
+/* Same contract as ParseRegistersFile, but loads the compiled image when
+ * it is up to date and (re)writes it otherwise */
+NvMediaStatus
+LoadRegistersFile(char *filename,
+                  CaptureConfigParams *params,
+                  I2cCommands *allCommands);
+
+/* Loads only the capture parameters of a script */
+NvMediaStatus
+LoadRegistersParams(char *filename,
+                    CaptureConfigParams *params);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
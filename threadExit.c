@@ -0,0 +1,72 @@
+/* NVIDIA CORPORATION gave permission to FLIR Systems, Inc to modify this code
+  * and distribute it as part of the ADAS GMSL Kit.
+  * http://www.flir.com/
+  * October-2019
+*/
+#include <errno.h>
+#include <time.h>
+
+#include "threadExit.h"
+
+void
+ThreadExitInit(ThreadExit *threadExit)
+{
+    pthread_condattr_t attr;
+
+    pthread_mutex_init(&threadExit->mutex, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&threadExit->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    threadExit->exited = NVMEDIA_TRUE;
+}
+
+void
+ThreadExitDestroy(ThreadExit *threadExit)
+{
+    pthread_cond_destroy(&threadExit->cond);
+    pthread_mutex_destroy(&threadExit->mutex);
+}
+
+void
+ThreadExitStart(ThreadExit *threadExit)
+{
+    pthread_mutex_lock(&threadExit->mutex);
+    threadExit->exited = NVMEDIA_FALSE;
+    pthread_mutex_unlock(&threadExit->mutex);
+}
+
+void
+ThreadExitNotify(ThreadExit *threadExit)
+{
+    pthread_mutex_lock(&threadExit->mutex);
+    threadExit->exited = NVMEDIA_TRUE;
+    pthread_cond_broadcast(&threadExit->cond);
+    pthread_mutex_unlock(&threadExit->mutex);
+}
+
+NvMediaStatus
+ThreadExitWait(ThreadExit *threadExit,
+               uint32_t timeout)
+{
+    struct timespec deadline;
+    int err = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (timeout % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&threadExit->mutex);
+    while (!threadExit->exited && err != ETIMEDOUT) {
+        err = pthread_cond_timedwait(&threadExit->cond, &threadExit->mutex,
+                                     &deadline);
+    }
+    err = threadExit->exited ? 0 : ETIMEDOUT;
+    pthread_mutex_unlock(&threadExit->mutex);
+
+    return err ? NVMEDIA_STATUS_TIMED_OUT : NVMEDIA_STATUS_OK;
+}
@@ -0,0 +1,51 @@
+/* NVIDIA CORPORATION gave permission to FLIR Systems, Inc to modify this code
+  * and distribute it as part of the ADAS GMSL Kit.
+  * http://www.flir.com/
+  * October-2019
+*/
+#ifndef __THREAD_EXIT_H__
+#define __THREAD_EXIT_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "nvmedia_core.h"
+
+/* Lets a *Fini sleep until a worker thread has left its loop instead of
+ * polling a flag. A thread that is not running counts as exited. */
+
+typedef struct {
+    pthread_mutex_t             mutex;
+    pthread_cond_t              cond;
+    NvMediaBool                 exited;
+} ThreadExit;
+
+void
+ThreadExitInit(ThreadExit *threadExit);
+
+void
+ThreadExitDestroy(ThreadExit *threadExit);
+
+/* Called before creating the thread */
+void
+ThreadExitStart(ThreadExit *threadExit);
+
+/* Called by the thread as it returns, or when it could not be created */
+void
+ThreadExitNotify(ThreadExit *threadExit);
+
+/* Returns NVMEDIA_STATUS_TIMED_OUT if the thread is still running after
+ * timeout ms */
+NvMediaStatus
+ThreadExitWait(ThreadExit *threadExit,
+               uint32_t timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,174 @@
+/* NVIDIA CORPORATION gave permission to FLIR Systems, Inc to modify this code
+  * and distribute it as part of the ADAS GMSL Kit.
+  * http://www.flir.com/
+  * October-2019
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "threadSched.h"
+#include "log_utils.h"
+
+static NvMediaStatus
+_ParseCpu(const char *text,
+          char **end,
+          uint32_t *cpu)
+{
+    unsigned long value;
+
+    value = strtoul(text, end, 10);
+    if (*end == text || value >= THREAD_SCHED_MAX_CPUS) {
+        return NVMEDIA_STATUS_BAD_PARAMETER;
+    }
+    *cpu = (uint32_t)value;
+    return NVMEDIA_STATUS_OK;
+}
+
+NvMediaStatus
+ThreadSchedParse(const char *spec,
+                 ThreadSched *sched)
+{
+    const char *p = spec;
+    char *end;
+    uint32_t first, last, cpu;
+    unsigned long priority;
+
+    memset(sched, 0, sizeof(ThreadSched));
+
+    /* An empty cpu list only sets the priority */
+    while (*p && *p != ':') {
+        if (_ParseCpu(p, &end, &first) != NVMEDIA_STATUS_OK) {
+            goto bad;
+        }
+        last = first;
+        if (*end == '-' &&
+            (_ParseCpu(end + 1, &end, &last) != NVMEDIA_STATUS_OK || last < first)) {
+            goto bad;
+        }
+        for (cpu = first; cpu <= last; cpu++) {
+            sched->cpus |= 1ULL << cpu;
+        }
+
+        p = end;
+        if (*p == '+' && p[1] && p[1] != ':') {
+            p++;
+        } else if (*p && *p != ':') {
+            goto bad;
+        }
+    }
+
+    if (*p == ':') {
+        priority = strtoul(p + 1, &end, 10);
+        if (end == p + 1 || *end ||
+            priority < (unsigned long)sched_get_priority_min(SCHED_FIFO) ||
+            priority > (unsigned long)sched_get_priority_max(SCHED_FIFO)) {
+            LOG_ERR("%s: Bad SCHED_FIFO priority in \"%s\"\n", __func__, spec);
+            return NVMEDIA_STATUS_BAD_PARAMETER;
+        }
+        sched->priority = (uint32_t)priority;
+    }
+
+    return NVMEDIA_STATUS_OK;
+
+bad:
+    LOG_ERR("%s: Bad cpu list in \"%s\"\n", __func__, spec);
+    return NVMEDIA_STATUS_BAD_PARAMETER;
+}
+
+/* Writes the cpus of set as "0-3+6" */
+static void
+_FormatCpus(uint64_t set,
+            char *buf,
+            size_t size)
+{
+    uint32_t cpu, last;
+    size_t len = 0;
+
+    buf[0] = '\0';
+    for (cpu = 0; cpu < THREAD_SCHED_MAX_CPUS && len < size; cpu++) {
+        if (!(set >> cpu & 1)) {
+            continue;
+        }
+        for (last = cpu; last + 1 < THREAD_SCHED_MAX_CPUS &&
+                         (set >> (last + 1) & 1); last++);
+        if (last == cpu) {
+            len += snprintf(buf + len, size - len, "%s%u", len ? "+" : "", cpu);
+        } else {
+            len += snprintf(buf + len, size - len, "%s%u-%u", len ? "+" : "",
+                            cpu, last);
+        }
+        cpu = last;
+    }
+}
+
+void
+ThreadSchedApply(const ThreadSched *sched,
+                 const char *stage,
+                 uint32_t virtualChannel)
+{
+    pthread_t self = pthread_self();
+    struct sched_param param;
+    char cpuList[128] = "unknown";
+    uint64_t mask = 0;
+    int policy, err;
+#ifndef NVMEDIA_QNX
+    cpu_set_t cpus;
+    uint32_t cpu;
+
+    if (sched && sched->cpus) {
+        CPU_ZERO(&cpus);
+        for (cpu = 0; cpu < THREAD_SCHED_MAX_CPUS; cpu++) {
+            if (sched->cpus >> cpu & 1) {
+                CPU_SET(cpu, &cpus);
+            }
+        }
+        err = pthread_setaffinity_np(self, sizeof(cpu_set_t), &cpus);
+        if (err) {
+            LOG_WARN("%s: Could not pin %s thread %u: %s\n", __func__,
+                     stage, virtualChannel, strerror(err));
+        }
+    }
+#else
+    if (sched && sched->cpus) {
+        LOG_WARN("%s: Thread pinning is not supported, %s thread %u is not pinned\n",
+                 __func__, stage, virtualChannel);
+    }
+#endif
+
+    if (sched && sched->priority) {
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = (int)sched->priority;
+        err = pthread_setschedparam(self, SCHED_FIFO, &param);
+        if (err) {
+            LOG_WARN("%s: Could not set SCHED_FIFO %u on %s thread %u: %s\n",
+                     __func__, sched->priority, stage, virtualChannel,
+                     strerror(err));
+        }
+    }
+
+    /* Report what the kernel actually applied */
+#ifndef NVMEDIA_QNX
+    CPU_ZERO(&cpus);
+    if (!pthread_getaffinity_np(self, sizeof(cpu_set_t), &cpus)) {
+        for (cpu = 0; cpu < THREAD_SCHED_MAX_CPUS; cpu++) {
+            if (CPU_ISSET(cpu, &cpus)) {
+                mask |= 1ULL << cpu;
+            }
+        }
+        _FormatCpus(mask, cpuList, sizeof(cpuList));
+    }
+#endif
+    if (pthread_getschedparam(self, &policy, &param)) {
+        LOG_WARN("%s: Could not read the policy of %s thread %u\n",
+                 __func__, stage, virtualChannel);
+        return;
+    }
+    LOG_MSG("%s thread %u: cpus %s, %s %d\n", stage, virtualChannel, cpuList,
+            policy == SCHED_FIFO ? "SCHED_FIFO" :
+            policy == SCHED_RR ? "SCHED_RR" : "SCHED_OTHER",
+            param.sched_priority);
+}
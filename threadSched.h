@@ -0,0 +1,43 @@
+/* NVIDIA CORPORATION gave permission to FLIR Systems, Inc to modify this code
+  * and distribute it as part of the ADAS GMSL Kit.
+  * http://www.flir.com/
+  * October-2019
+*/
+#ifndef __THREAD_SCHED_H__
+#define __THREAD_SCHED_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "nvmedia_core.h"
+
+/* CPU placement and real-time priority of a worker thread. NvThreadCreate
+ * takes no attributes, so each thread applies its own at startup. */
+
+#define THREAD_SCHED_MAX_CPUS       64
+
+typedef struct {
+    uint64_t                    cpus;           // bit n for cpu n, 0 to inherit
+    uint32_t                    priority;       // SCHED_FIFO if not 0
+} ThreadSched;
+
+/* Parses "cpus[:priority]", cpus being "2", "2-3" or "2+5" */
+NvMediaStatus
+ThreadSchedParse(const char *spec,
+                 ThreadSched *sched);
+
+/* Applies sched to the calling thread, NULL keeps the inherited placement,
+ * then logs the effective placement. Failing to apply only warns. */
+void
+ThreadSchedApply(const ThreadSched *sched,
+                 const char *stage,
+                 uint32_t virtualChannel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
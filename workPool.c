@@ -0,0 +1,211 @@
+/* NVIDIA CORPORATION gave permission to FLIR Systems, Inc to modify this code
+  * and distribute it as part of the ADAS GMSL Kit.
+  * http://www.flir.com/
+  * October-2019
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "workPool.h"
+#include "thread_utils.h"
+#include "log_utils.h"
+
+typedef struct WorkBatch {
+    WorkPoolFunc                func;
+    uint8_t                    *tasks;
+    size_t                      taskSize;
+    uint32_t                    numTasks;
+    uint32_t                    nextTask;       // next one to hand out
+    uint32_t                    doneTasks;
+    struct WorkBatch           *next;
+} WorkBatch;
+
+typedef struct {
+    WorkPool                   *pool;
+    NvThread                   *thread;
+    uint64_t                    tasksRun;
+} WorkPoolWorker;
+
+struct WorkPool {
+    pthread_mutex_t             mutex;
+    pthread_cond_t              workCond;       // a batch was posted
+    pthread_cond_t              doneCond;       // a batch finished
+    WorkBatch                  *head;           // batches with tasks left
+    WorkBatch                  *tail;
+    NvMediaBool                 quit;
+    WorkPoolWorker              workers[WORK_POOL_MAX_WORKERS];
+    uint32_t                    numWorkers;
+    uint64_t                    callerTasks;    // run by the posting threads
+};
+
+/* Takes the next task of batch, called with the mutex held. A batch
+ * leaves the list once all its tasks are handed out. */
+static uint8_t *
+_ClaimTask(WorkPool *pool,
+           WorkBatch *batch)
+{
+    WorkBatch **link;
+    uint8_t *task = batch->tasks + batch->nextTask * batch->taskSize;
+
+    if (++batch->nextTask == batch->numTasks) {
+        for (link = &pool->head; *link != batch; link = &(*link)->next);
+        *link = batch->next;
+        if (pool->tail == batch) {
+            pool->tail = NULL;
+            for (batch = pool->head; batch; batch = batch->next) {
+                pool->tail = batch;
+            }
+        }
+    }
+    return task;
+}
+
+/* Called with the mutex held, returns with it held */
+static void
+_RunTask(WorkPool *pool,
+         WorkBatch *batch,
+         uint8_t *task)
+{
+    pthread_mutex_unlock(&pool->mutex);
+    batch->func(task);
+    pthread_mutex_lock(&pool->mutex);
+
+    if (++batch->doneTasks == batch->numTasks) {
+        pthread_cond_broadcast(&pool->doneCond);
+    }
+}
+
+static uint32_t
+_WorkPoolFunc(void *data)
+{
+    WorkPoolWorker *worker = (WorkPoolWorker *)data;
+    WorkPool *pool = worker->pool;
+    WorkBatch *batch;
+
+    pthread_mutex_lock(&pool->mutex);
+    while (!pool->quit) {
+        if (!pool->head) {
+            pthread_cond_wait(&pool->workCond, &pool->mutex);
+            continue;
+        }
+        batch = pool->head;
+        _RunTask(pool, batch, _ClaimTask(pool, batch));
+        worker->tasksRun++;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return 0;
+}
+
+NvMediaStatus
+WorkPoolCreate(WorkPool **pool,
+               uint32_t numWorkers)
+{
+    WorkPool *ctx;
+    uint32_t i;
+
+    if (!pool || !numWorkers || numWorkers > WORK_POOL_MAX_WORKERS) {
+        LOG_ERR("%s: Bad parameter\n", __func__);
+        return NVMEDIA_STATUS_BAD_PARAMETER;
+    }
+
+    ctx = calloc(1, sizeof(WorkPool));
+    if (!ctx) {
+        LOG_ERR("%s: Out of memory\n", __func__);
+        return NVMEDIA_STATUS_OUT_OF_MEMORY;
+    }
+    pthread_mutex_init(&ctx->mutex, NULL);
+    pthread_cond_init(&ctx->workCond, NULL);
+    pthread_cond_init(&ctx->doneCond, NULL);
+
+    for (i = 0; i < numWorkers; i++) {
+        ctx->workers[i].pool = ctx;
+        if (NvThreadCreate(&ctx->workers[i].thread, &_WorkPoolFunc,
+                           (void *)&ctx->workers[i],
+                           NV_THREAD_PRIORITY_NORMAL) != NVMEDIA_STATUS_OK) {
+            LOG_ERR("%s: Failed to create worker thread %u\n", __func__, i);
+            WorkPoolDestroy(ctx);
+            return NVMEDIA_STATUS_ERROR;
+        }
+        ctx->numWorkers++;
+    }
+
+    *pool = ctx;
+    return NVMEDIA_STATUS_OK;
+}
+
+void
+WorkPoolDestroy(WorkPool *pool)
+{
+    uint32_t i;
+
+    if (!pool) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->quit = NVMEDIA_TRUE;
+    pthread_cond_broadcast(&pool->workCond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (i = 0; i < pool->numWorkers; i++) {
+        NvThreadDestroy(pool->workers[i].thread);
+        LOG_INFO("%s: Worker %u ran %llu tasks\n", __func__, i,
+                 (unsigned long long)pool->workers[i].tasksRun);
+    }
+    LOG_INFO("%s: Callers ran %llu tasks\n", __func__,
+             (unsigned long long)pool->callerTasks);
+
+    pthread_cond_destroy(&pool->doneCond);
+    pthread_cond_destroy(&pool->workCond);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool);
+}
+
+void
+WorkPoolRun(WorkPool *pool,
+            WorkPoolFunc func,
+            void *tasks,
+            size_t taskSize,
+            uint32_t numTasks)
+{
+    WorkBatch batch;
+    uint32_t i;
+
+    if (!numTasks) {
+        return;
+    }
+
+    if (!pool || numTasks == 1) {
+        for (i = 0; i < numTasks; i++) {
+            func((uint8_t *)tasks + i * taskSize);
+        }
+        return;
+    }
+
+    memset(&batch, 0, sizeof(batch));
+    batch.func = func;
+    batch.tasks = (uint8_t *)tasks;
+    batch.taskSize = taskSize;
+    batch.numTasks = numTasks;
+
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->tail) {
+        pool->tail->next = &batch;
+    } else {
+        pool->head = &batch;
+    }
+    pool->tail = &batch;
+    pthread_cond_broadcast(&pool->workCond);
+
+    /* Help with our own batch rather than sleep */
+    while (batch.nextTask < batch.numTasks) {
+        _RunTask(pool, &batch, _ClaimTask(pool, &batch));
+        pool->callerTasks++;
+    }
+    while (batch.doneTasks < batch.numTasks) {
+        pthread_cond_wait(&pool->doneCond, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
@@ -0,0 +1,49 @@
+/* NVIDIA CORPORATION gave permission to FLIR Systems, Inc to modify this code
+  * and distribute it as part of the ADAS GMSL Kit.
+  * http://www.flir.com/
+  * October-2019
+*/
+#ifndef __WORK_POOL_H__
+#define __WORK_POOL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nvmedia_core.h"
+
+/* Worker threads shared by every channel for per-frame pixel work. A
+ * caller hands over an array of tasks and helps run them until all are
+ * done; batches from several channels are served in the order posted. */
+
+#define WORK_POOL_MAX_WORKERS       16
+
+typedef void (*WorkPoolFunc)(void *task);
+
+typedef struct WorkPool WorkPool;
+
+NvMediaStatus
+WorkPoolCreate(WorkPool **pool,
+               uint32_t numWorkers);
+
+/* Logs the tasks run by each thread */
+void
+WorkPoolDestroy(WorkPool *pool);
+
+/* Runs func on numTasks tasks of taskSize bytes each and returns once all
+ * have run. A NULL pool runs them on the calling thread. */
+void
+WorkPoolRun(WorkPool *pool,
+            WorkPoolFunc func,
+            void *tasks,
+            size_t taskSize,
+            uint32_t numTasks);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif